@@ -1,10 +1,29 @@
 #include "build_task.h"
+#include <map>
+#include <cmath>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <future>
+#include <random>
+#include <thread>
 #include <fstream>
+#include <algorithm>
+
+#include <omp.h>
 
 #include <absl/strings/str_cat.h>
+#include <absl/strings/str_join.h>
+#include <boost/filesystem.hpp>
+#include <boost/system/error_code.hpp>
 #include <faiss/Index.h>
 #include <faiss/index_io.h>
 #include <faiss/index_factory.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/Clustering.h>
+#include <faiss/AutoTune.h>
+#include <faiss/utils/distances.h>
 #include <glog/logging.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/text_format.h>
@@ -14,7 +33,44 @@
 #include "common/path.h"
 #include "common/constants.h"
 #include "common/timer.h"
+#include "common/label_store.h"
+
+namespace {
 
+constexpr size_t kDecodeChunkSize = 4096;
+constexpr uint64_t kSampleSeed = 1234;
+
+// 一个分块的原始记录和解析结果
+struct SourceChunk {
+  std::string buffer;
+  // <offset, len>
+  std::vector<std::pair<size_t, size_t>> records;
+  std::vector<proto::Source> sources;
+  std::vector<float> matrix;
+};
+
+void DecodeChunk(uint32_t dim, SourceChunk* chunk) {
+  chunk->sources.reserve(chunk->records.size());
+  chunk->matrix.reserve(chunk->records.size() * dim);
+  for (const auto& record : chunk->records) {
+    proto::Source source;
+    if (!source.ParseFromArray(chunk->buffer.data() + record.first, record.second)) {
+      LOG(WARNING) << "parse buffer error";
+      continue;
+    }
+    if (source.vec_size() != dim) {
+      LOG(WARNING) << "source dim error: <" << source.vec_size() << "," << dim << ">";
+      continue;
+    }
+    chunk->matrix.insert(chunk->matrix.end(), source.vec().begin(), source.vec().end());
+    source.clear_vec();
+    chunk->sources.push_back(std::move(source));
+  }
+  chunk->buffer.clear();
+  chunk->buffer.shrink_to_fit();
+}
+
+}
 
 BuildTask::BuildTask(const proto::TaskConfig &task_config, const std::string& output_path): task_config_(task_config), output_path_(output_path) {
   for (const auto& entry : index_type_names) {
@@ -30,26 +86,108 @@ bool BuildTask::BuildIndex() {
     return false;
   }
 
-  std::string source_file = absl::StrCat(task_config_.input_path(), "/", kSourceFileName, kSourceBinarySuffix);
-  std::string ids_file = absl::StrCat(model_dir, "/", kFaissIdsName);
-
   Timer timer;
-  if (!ReadBinary(source_file)) {
+  if (!ReadSource()) {
     LOG(WARNING) << "read source error";
     return false;
   }
+  RecordStage("read", timer.MsCost());
 
-  if (!WriteIds(ids_file)) {
+  if (!WriteIds(model_dir)) {
     LOG(WARNING) << "write idsfile error";
     return false;
   }
+  if (task_config_.vector_store() != proto::TaskConfig::NONE && !WriteVectors(model_dir)) {
+    LOG(WARNING) << "write vectors error";
+    return false;
+  }
+
+  if (task_config_.tune_config().query_size() > 0 && task_config_.tune_config().topk() > 0) {
+    std::string query_file = absl::StrCat(task_config_.input_path(), "/", kQueryFileName, kSourceFileSuffix);
+    if (!ReadTuneQueries(query_file)) {
+      LOG(WARNING) << "read tune queries error";
+      return false;
+    }
+  }
 
   if (!WriteMultiIndex(model_dir, {task_config_.index_types().begin(), task_config_.index_types().end()})) {
     LOG(WARNING) << "write index error";
     return false;
   }
+  std::vector<std::string> stages;
+  for (const auto& stage : stage_costs_) {
+    stages.push_back(absl::StrCat(stage.first, ":", stage.second, "ms"));
+  }
   LOG(INFO) << "build " << model_name << " success with <" << this->length_ << "," << this->dim_
-    << ">, cost: " << timer.MsCost() << "ms";
+    << ">, cost: " << timer.MsCost() << "ms, stages: " << absl::StrJoin(stages, " ");
+  return true;
+}
+
+bool BuildTask::ReadSource() {
+  std::string vector_file = absl::StrCat(task_config_.input_path(), "/", kSourceFileName, kSourceVectorSuffix);
+  boost::system::error_code ec;
+  if (boost::filesystem::is_regular_file(vector_file, ec)) {
+    return ReadVectorFile(vector_file);
+  }
+  return ReadBinary(absl::StrCat(task_config_.input_path(), "/", kSourceFileName, kSourceBinarySuffix));
+}
+
+bool BuildTask::BenchRead() {
+  std::string vector_file = absl::StrCat(task_config_.input_path(), "/", kSourceFileName, kSourceVectorSuffix);
+  std::string binary_file = absl::StrCat(task_config_.input_path(), "/", kSourceFileName, kSourceBinarySuffix);
+  // 第一轮可能受page cache冷热影响, 每种格式读两轮
+  std::vector<std::unique_ptr<BuildTask>> tasks;
+  for (int round = 0; round < 2; ++round) {
+    for (bool columnar : {false, true}) {
+      auto task = std::make_unique<BuildTask>(task_config_, output_path_);
+      Timer timer;
+      if (!(columnar ? task->ReadVectorFile(vector_file) : task->ReadBinary(binary_file))) {
+        LOG(WARNING) << "read " << (columnar ? vector_file : binary_file) << " error";
+        return false;
+      }
+      LOG(INFO) << "round " << round << " " << (columnar ? "vector" : "binary") << " read "
+        << task->length_ << " records, cost: " << timer.MsCost() << "ms";
+      tasks.push_back(std::move(task));
+    }
+  }
+  const auto& binary = *tasks[0];
+  const auto& columnar = *tasks[1];
+  if (binary.length_ != columnar.length_ || binary.dim_ != columnar.dim_ || binary.labels_ != columnar.labels_) {
+    LOG(WARNING) << "sources mismatch: <" << binary.length_ << "," << columnar.length_ << ">";
+    return false;
+  }
+  // float16会有精度损失, 记录最大误差
+  float max_error{0};
+  for (size_t i = 0; i < static_cast<size_t>(binary.length_) * binary.dim_; ++i) {
+    max_error = std::max(max_error, std::abs(binary.data_[i] - columnar.data_[i]));
+  }
+  LOG(INFO) << "sources match, max error: " << max_error;
+  return true;
+}
+
+bool BuildTask::ReadVectorFile(const std::string &path) {
+  if (!vector_file_.Open(path)) {
+    return false;
+  }
+  this->dim_ = vector_file_.Dim();
+  this->length_ = vector_file_.Size();
+  if (vector_file_.Matrix() != nullptr) {
+    this->data_ = vector_file_.Matrix();
+  } else {
+    this->matrix_.resize(static_cast<size_t>(this->length_) * this->dim_);
+    vector_file_.Decode(0, this->length_, this->matrix_.data());
+    this->data_ = this->matrix_.data();
+  }
+  this->labels_.reserve(this->length_);
+  for (size_t i = 0; i < this->length_; ++i) {
+    this->labels_.emplace_back(vector_file_.Label(i));
+  }
+  // 属性不是定长列, 单独放在source目录的attrs.pb
+  if (!attributes_.Load(task_config_.input_path())) {
+    LOG(WARNING) << "load attributes error";
+    return false;
+  }
+  LOG(INFO) << "read from " << path << " get " << this->length_ << " with dim " << this->dim_;
   return true;
 }
 
@@ -118,8 +256,6 @@ bool BuildTask::ReadBinary(const std::string &path) {
     LOG(WARNING) << "open " << path << " error";
     return false;
   }
-  std::string buffer;
-  buffer.resize(1024*1024);
   uint64_t len{0};
   {
     reader.read((char*)&len, sizeof(uint64_t));
@@ -127,6 +263,7 @@ bool BuildTask::ReadBinary(const std::string &path) {
       LOG(WARNING) << "meta len error";
       return false;
     }
+    std::string buffer(len, '\0');
     reader.read(buffer.data(), len);
     proto::SourceMeta source_meta;
     if (!source_meta.ParseFromArray(buffer.c_str(), len)) {
@@ -139,34 +276,68 @@ bool BuildTask::ReadBinary(const std::string &path) {
   this->labels_.reserve(this->length_);
   this->matrix_.reserve(this->length_ * this->dim_);
 
-  for (int i=0;i<length_ && !reader.eof(); ++i) {
-    reader.read((char*)&len, sizeof(uint64_t));
-    if (len == 0) {
-      break;
+  // 主线程顺序读取分块, 解析交给后台线程, 按分块顺序合并
+  uint32_t decode_threads = std::max(1u, task_config_.train_config().decode_threads());
+  std::deque<std::future<std::unique_ptr<SourceChunk>>> pending;
+  auto merge = [this](std::unique_ptr<SourceChunk> chunk) {
+    for (auto& source : chunk->sources) {
+      this->attributes_.Add(this->labels_.size(), source.attrs());
+      this->labels_.push_back(std::move(*source.mutable_label()));
     }
-    buffer.clear();
-    reader.read(buffer.data(), len);
-
-    proto::Source source;
-    if (!source.ParseFromArray(buffer.c_str(), len)) {
-      LOG(WARNING) << "parse buffer error";
-      continue;
+    this->matrix_.insert(matrix_.end(), chunk->matrix.begin(), chunk->matrix.end());
+  };
+  uint32_t read_count{0};
+  bool eof{false};
+  while (read_count < length_ && !eof) {
+    auto chunk = std::make_unique<SourceChunk>();
+    while (read_count < length_ && chunk->records.size() < kDecodeChunkSize) {
+      size_t offset = chunk->buffer.size();
+      if (!reader.read((char*)&len, sizeof(uint64_t)) || len == 0) {
+        eof = true;
+        break;
+      }
+      chunk->buffer.resize(offset + len);
+      if (!reader.read(chunk->buffer.data() + offset, len)) {
+        LOG(WARNING) << "read record error, size: " << len;
+        chunk->buffer.resize(offset);
+        eof = true;
+        break;
+      }
+      chunk->records.emplace_back(offset, len);
+      ++read_count;
     }
-    if (source.vec_size() != this->dim_) {
-      LOG(WARNING) << "source dim error: <" << source.vec_size() << "," << dim_ << ">";
-      continue;
+    if (chunk->records.empty()) {
+      break;
+    }
+    pending.push_back(std::async(std::launch::async, [dim = this->dim_, chunk = std::move(chunk)]() mutable {
+      DecodeChunk(dim, chunk.get());
+      return std::move(chunk);
+    }));
+    if (pending.size() > decode_threads) {
+      merge(pending.front().get());
+      pending.pop_front();
     }
-
-    this->labels_.push_back(source.label());
-    this->matrix_.insert(matrix_.end(), source.vec().begin(), source.vec().end());
+  }
+  while (!pending.empty()) {
+    merge(pending.front().get());
+    pending.pop_front();
   }
   this->length_ = this->labels_.size();
+  this->data_ = this->matrix_.data();
   LOG(INFO) << "read from " << path << " get " << this->length_ << " with dim " << this->dim_;
 
   return true;
 }
 
-bool BuildTask::WriteIds(const std::string &path) {
+bool BuildTask::WriteIds(const std::string &model_dir) {
+  // labels.bin供server mmap加载, ids.txt保留用于查看和兼容旧版本server, 有属性时一并写出attrs.pb
+  if (!WriteLabelFile(absl::StrCat(model_dir, "/", kFaissLabelsName), this->labels_)) {
+    return false;
+  }
+  if (!attributes_.Empty() && !attributes_.Write(absl::StrCat(model_dir, "/", kFaissAttrsName))) {
+    return false;
+  }
+  std::string path = absl::StrCat(model_dir, "/", kFaissIdsName);
   std::ofstream writer(path);
   if (!writer.is_open()) {
     LOG(WARNING) << "open " << path << " error";
@@ -180,7 +351,28 @@ bool BuildTask::WriteIds(const std::string &path) {
 }
 
 
+bool BuildTask::WriteVectors(const std::string &model_dir) {
+  Timer timer;
+  auto dtype = task_config_.vector_store() == proto::TaskConfig::FLOAT16 ? kFloat16 : kFloat32;
+  VectorFileWriter writer;
+  if (!writer.Open(absl::StrCat(model_dir, "/", kFaissVectorsName), this->dim_, dtype)) {
+    return false;
+  }
+  for (size_t i = 0; i < this->length_; ++i) {
+    if (!writer.Add(this->labels_[i], this->data_ + i * this->dim_)) {
+      return false;
+    }
+  }
+  if (!writer.Close()) {
+    return false;
+  }
+  RecordStage("vectors", timer.MsCost());
+  return true;
+}
+
 bool BuildTask::WriteMultiIndex(const std::string &model_dir, const std::vector<int>& index_types) {
+  std::vector<proto::Constants::IndexType> types;
+  std::vector<std::unique_ptr<faiss::Index>> indexes;
   for (const auto& number : index_types) {
     if (!proto::Constants::IndexType_IsValid(number)) {
       continue;
@@ -201,16 +393,231 @@ bool BuildTask::WriteMultiIndex(const std::string &model_dir, const std::vector<
       LOG(WARNING) << "build " << type_it->second << " error";
       return false;
     }
-    index->train(length_, matrix_.data());
-    index->add(this->length_, this->matrix_.data());
-    std::string file_path = absl::StrCat(model_dir, "/", GetIndexFileName(index_type));
+    types.push_back(index_type);
+    indexes.push_back(std::move(index));
+  }
+
+  SampleTrainData();
+  std::vector<faiss::Index*> raw_indexes;
+  for (const auto& index : indexes) {
+    raw_indexes.push_back(index.get());
+  }
+  if (!TrainSharedQuantizers(raw_indexes)) {
+    return false;
+  }
+
+  // 各索引类型互不依赖, 并发训练和添加
+  uint32_t build_threads = std::min<uint32_t>(std::max(1u, task_config_.train_config().build_threads()), indexes.size());
+  int omp_threads = std::max(1, omp_get_max_threads() / static_cast<int>(std::max(1u, build_threads)));
+  // 调参测量耗时, 并发构建时在所有构建结束后串行进行; 索引写出并调参后立即释放
+  bool tune_after_build = this->tune_size_ > 0 && build_threads > 1;
+  auto tune = [&](size_t i) {
+    Timer timer;
+    if (!TuneIndex(indexes[i].get(), types[i], model_dir)) {
+      LOG(WARNING) << "tune " << proto::Constants::IndexType_Name(types[i]) << " error";
+      return false;
+    }
+    RecordStage(absl::StrCat(proto::Constants::IndexType_Name(types[i]), ".tune"), timer.MsCost());
+    return true;
+  };
+  std::atomic_size_t next{0};
+  std::atomic_bool success{true};
+  auto worker = [&]() {
+    omp_set_num_threads(omp_threads);
+    for (size_t i = next++; i < indexes.size() && success.load(); i = next++) {
+      if (!BuildOne(types[i], indexes[i].get(), model_dir)
+          || (this->tune_size_ > 0 && !tune_after_build && !tune(i))) {
+        success.store(false);
+      }
+      if (!tune_after_build) {
+        indexes[i].reset();
+      }
+    }
+  };
+  if (build_threads <= 1) {
+    worker();
+  } else {
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < build_threads; ++i) {
+      threads.emplace_back(worker);
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+  if (!success.load()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < indexes.size() && tune_after_build; ++i) {
+    if (!tune(i)) {
+      return false;
+    }
+    indexes[i].reset();
+  }
+  return true;
+}
+
+bool BuildTask::BuildOne(proto::Constants::IndexType index_type, faiss::Index *index, const std::string &model_dir) {
+  std::string type_name = proto::Constants::IndexType_Name(index_type);
+  try {
+    Timer train_timer;
+    index->train(train_size_, TrainData());
+    RecordStage(absl::StrCat(type_name, ".train"), train_timer.MsCost());
+    Timer add_timer;
+    index->add(this->length_, this->data_);
+    RecordStage(absl::StrCat(type_name, ".add"), add_timer.MsCost());
+  } catch (std::exception& e) {
+    LOG(WARNING) << "build " << type_name << " error " << e.what();
+    return false;
+  }
+  Timer write_timer;
+  std::string file_path = absl::StrCat(model_dir, "/", GetIndexFileName(index_type));
+  try {
+    faiss::write_index(index, file_path.c_str());
+  } catch (std::exception& e) {
+    LOG(WARNING) << "write " << file_path << " error " << e.what();
+    return false;
+  }
+  RecordStage(absl::StrCat(type_name, ".write"), write_timer.MsCost());
+  return true;
+}
+
+void BuildTask::SampleTrainData() {
+  uint32_t sample_size = task_config_.train_config().sample_size();
+  this->train_size_ = this->length_;
+  if (sample_size == 0 || sample_size >= this->length_) {
+    return;
+  }
+  Timer timer;
+  // 顺序抽样(Knuth算法S), 不需要额外的下标数组, 固定种子保证可复现
+  std::mt19937_64 rng{kSampleSeed};
+  train_matrix_.reserve(static_cast<size_t>(sample_size) * dim_);
+  uint32_t needed = sample_size;
+  for (uint32_t i = 0; i < this->length_ && needed > 0; ++i) {
+    if (rng() % (this->length_ - i) < needed) {
+      const float* row = data_ + static_cast<size_t>(i) * dim_;
+      train_matrix_.insert(train_matrix_.end(), row, row + dim_);
+      --needed;
+    }
+  }
+  this->train_size_ = sample_size;
+  RecordStage("sample", timer.MsCost());
+}
+
+const float *BuildTask::TrainData() const {
+  return train_matrix_.empty() ? data_ : train_matrix_.data();
+}
+
+bool BuildTask::TrainSharedQuantizers(const std::vector<faiss::Index *> &indexes) {
+  // 只处理没有预变换, 粗量化器为L2 Flat的IVF, 如IVF4096_Flat/IVF4096_PQ8_16/IVF4096_PQ32
+  std::map<size_t, std::vector<faiss::IndexIVF*>> nlist_to_ivfs;
+  for (auto* index : indexes) {
+    auto* ivf = dynamic_cast<faiss::IndexIVF*>(index);
+    if (ivf == nullptr || ivf->metric_type != faiss::METRIC_L2 || ivf->quantizer->ntotal != 0
+        || dynamic_cast<faiss::IndexFlat*>(ivf->quantizer) == nullptr) {
+      continue;
+    }
+    nlist_to_ivfs[ivf->nlist].push_back(ivf);
+  }
+  for (const auto& entry : nlist_to_ivfs) {
+    if (entry.second.size() < 2) {
+      continue;
+    }
+    Timer timer;
+    faiss::IndexFlatL2 centroids(dim_);
+    faiss::Clustering clustering(dim_, entry.first);
     try {
-      faiss::write_index(index.get(), file_path.c_str());
+      clustering.train(train_size_, TrainData(), centroids);
     } catch (std::exception& e) {
-      LOG(WARNING) << "write " << file_path << " error " << e.what();
+      // 如训练样本少于nlist
+      LOG(WARNING) << "train IVF" << entry.first << " quantizer error " << e.what();
       return false;
     }
+    // 量化器已有nlist个中心时, IndexIVF::train跳过粗量化器训练, 只训练编码器
+    for (auto* ivf : entry.second) {
+      ivf->quantizer->add(entry.first, centroids.get_xb());
+    }
+    RecordStage(absl::StrCat("IVF", entry.first, ".quantizer"), timer.MsCost());
   }
+  return true;
+}
 
+void BuildTask::RecordStage(const std::string &stage, uint64_t ms) {
+  std::lock_guard lock(stage_mutex_);
+  stage_costs_.emplace_back(stage, ms);
+}
+
+bool BuildTask::ReadTuneQueries(const std::string &path) {
+  std::ifstream reader(path);
+  if (!reader.is_open()) {
+    LOG(WARNING) << "open " << path << " error";
+    return false;
+  }
+  std::string line;
+  while (tune_size_ < task_config_.tune_config().query_size() && std::getline(reader, line)) {
+    proto::Source source;
+    if (!google::protobuf::TextFormat::ParseFromString(line, &source) || source.vec_size() != this->dim_) {
+      LOG(WARNING) << "parse query error: " << line.substr(0, 64);
+      continue;
+    }
+    this->tune_queries_.insert(tune_queries_.end(), source.vec().begin(), source.vec().end());
+    ++this->tune_size_;
+  }
+  if (this->tune_size_ == 0) {
+    return false;
+  }
+
+  Timer timer;
+  uint32_t topk = task_config_.tune_config().topk();
+  std::vector<float> distances(tune_size_ * topk);
+  this->tune_ground_truth_.resize(tune_size_ * topk);
+  faiss::float_maxheap_array_t heap{tune_size_, topk, tune_ground_truth_.data(), distances.data()};
+  faiss::knn_L2sqr(tune_queries_.data(), data_, dim_, tune_size_, length_, &heap);
+  LOG(INFO) << "read " << tune_size_ << " tune queries, ground truth cost: " << timer.MsCost() << "ms";
+  return true;
+}
+
+bool BuildTask::TuneIndex(faiss::Index *index, proto::Constants::IndexType index_type, const std::string &model_dir) {
+  faiss::ParameterSpace space;
+  space.verbose = 0;
+  space.initialize(index);
+  // Flat等索引没有可调的参数
+  if (space.n_combinations() <= 1) {
+    return true;
+  }
+
+  Timer timer;
+  uint32_t topk = task_config_.tune_config().topk();
+  faiss::IntersectionCriterion criterion(tune_size_, topk);
+  criterion.set_groundtruth(topk, nullptr, tune_ground_truth_.data());
+  faiss::OperatingPoints points;
+  try {
+    space.explore(index, tune_size_, tune_queries_.data(), criterion, &points);
+  } catch (std::exception& e) {
+    LOG(WARNING) << "explore error: " << e.what();
+    return false;
+  }
+
+  proto::TuneResult tune_result;
+  tune_result.set_index_type(index_type);
+  tune_result.set_topk(topk);
+  for (const auto& point : points.optimal_pts) {
+    auto* operating_point = tune_result.add_points();
+    operating_point->set_recall(point.perf);
+    operating_point->set_latency_us(point.t * 1e6 / tune_size_);
+    operating_point->set_key(point.key);
+  }
+  std::string buffer;
+  google::protobuf::TextFormat::PrintToString(tune_result, &buffer);
+  std::string file_path = absl::StrCat(model_dir, "/", GetTuneFileName(index_type));
+  std::ofstream writer(file_path);
+  if (!writer.is_open()) {
+    LOG(WARNING) << "open " << file_path << " error";
+    return false;
+  }
+  writer << buffer;
+  LOG(INFO) << "tune " << proto::Constants::IndexType_Name(index_type) << " with " << space.n_combinations()
+    << " combinations, get " << tune_result.points_size() << " operating points, cost: " << timer.MsCost() << "ms";
   return true;
 }
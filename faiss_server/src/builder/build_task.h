@@ -1,7 +1,12 @@
 #pragma once
 
+#include <mutex>
+#include <faiss/Index.h>
+
 #include "builder_config.pb.h"
 #include "index_constants.pb.h"
+#include "common/attribute_index.h"
+#include "common/vector_file.h"
 
 class BuildTask {
  public:
@@ -9,20 +14,52 @@ class BuildTask {
 
   bool BuildIndex();
 
+  // 对比proto记录格式和列式mmap格式的读取耗时
+  bool BenchRead();
+
  private:
   // bool ReadBinaryStream(const std::string& path);
   bool ReadBinary(const std::string& path);
+  // float32矩阵直接使用mmap的指针, float16解码到matrix_
+  bool ReadVectorFile(const std::string& path);
+  bool ReadSource();
 
-  bool WriteIds(const std::string& path);
+  bool WriteIds(const std::string& model_dir);
+  bool WriteVectors(const std::string& model_dir);
   bool WriteMultiIndex(const std::string& model_dir, const std::vector<int>& index_types);
 
+  // 从全量数据中无放回随机抽取训练样本
+  void SampleTrainData();
+  const float* TrainData() const;
+  // nlist相同的多个IVF索引只训练一次粗量化器, 聚类失败时返回false
+  bool TrainSharedQuantizers(const std::vector<faiss::Index*>& indexes);
+  bool BuildOne(proto::Constants::IndexType index_type, faiss::Index* index, const std::string& model_dir);
+
+  void RecordStage(const std::string& stage, uint64_t ms);
+
+  // 读取调参用的query并暴力检索出真实近邻
+  bool ReadTuneQueries(const std::string& path);
+  // 在query上探索索引参数空间, 帕累托最优点写到索引旁
+  bool TuneIndex(faiss::Index* index, proto::Constants::IndexType index_type, const std::string& model_dir);
+
  private:
   proto::TaskConfig task_config_;
   std::string output_path_;
   uint32_t dim_{0};
   uint32_t length_{0};
   std::vector<std::string> labels_;
+  AttributeIndex attributes_;
   std::vector<float> matrix_;
+  VectorFile vector_file_;
+  // 全量向量, 指向matrix_或vector_file_
+  const float* data_{nullptr};
+  uint32_t train_size_{0};
+  std::vector<float> train_matrix_;
+  std::mutex stage_mutex_;
+  std::vector<std::pair<std::string, uint64_t>> stage_costs_;
+  uint32_t tune_size_{0};
+  std::vector<float> tune_queries_;
+  std::vector<faiss::idx_t> tune_ground_truth_;
   std::unordered_map<proto::Constants::IndexType, std::string> type_to_keys_;
 };
 
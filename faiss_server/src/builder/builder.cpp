@@ -19,6 +19,10 @@ int main(int argc, char** argv) {
 
   for (const auto& sub_config : builder_config.tasks()) {
     BuildTask task{sub_config, builder_config.output_path()};
+    if (FLAGS_bench_read) {
+      task.BenchRead();
+      continue;
+    }
     task.BuildIndex();
   }
   return 0;
@@ -3,3 +3,4 @@
 #include <gflags/gflags.h>
 
 DEFINE_string(conf, "../conf/builder.pb_txt", "path of config");
+DEFINE_bool(bench_read, false, "only compare reading source.dat and source.vec, no index is built");
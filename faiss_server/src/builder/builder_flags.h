@@ -3,3 +3,4 @@
 #include <gflags/gflags_declare.h>
 
 DECLARE_string(conf);
+DECLARE_bool(bench_read);
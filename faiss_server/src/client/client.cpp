@@ -1,6 +1,10 @@
 #include <iostream>
 #include <sstream>
 #include <random>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
@@ -14,8 +18,36 @@ DEFINE_string(method, "recall", "method of rpc");
 DEFINE_uint32(dim, 128, "dim");
 DEFINE_uint32(query_size, 2, "size");
 DEFINE_uint32(topk, 10, "topk");
+DEFINE_string(index_type, "DEFAULT", "name of index type");
+DEFINE_uint32(nprobe, 0, "nprobe of ivf index, 0 for default");
+DEFINE_uint32(refine_factor, 0, "rerank topk * refine_factor candidates with raw vectors, 0 for no refine");
+DEFINE_string(filter, "", "conditions joined by ';', like 'category=c1|c2;region!=r0'");
+DEFINE_string(label, "label_new", "label to upsert or delete");
+DEFINE_bool(delete_label, false, "delete label instead of upsert");
+DEFINE_uint32(threads, 32, "concurrent callers of bench");
+DEFINE_uint32(requests, 1000, "requests per caller of bench");
 
 
+void BuildFilter(const std::string& text, proto::Filter* filter) {
+  std::stringstream conditions(text);
+  std::string condition_text;
+  while (std::getline(conditions, condition_text, ';')) {
+    auto pos = condition_text.find('=');
+    if (pos == std::string::npos || pos == 0) {
+      continue;
+    }
+    auto* condition = filter->add_conditions();
+    bool exclude = condition_text[pos - 1] == '!';
+    condition->set_exclude(exclude);
+    condition->set_field(condition_text.substr(0, exclude ? pos - 1 : pos));
+    std::stringstream values(condition_text.substr(pos + 1));
+    std::string value;
+    while (std::getline(values, value, '|')) {
+      condition->add_values(value);
+    }
+  }
+}
+
 void BuildRequest(proto::RetrievalRequest* request, uint32_t size, uint32_t dim, uint32_t topk) {
   std::mt19937 rng{std::random_device{}()};
   std::uniform_real_distribution<> distrib;
@@ -28,6 +60,13 @@ void BuildRequest(proto::RetrievalRequest* request, uint32_t size, uint32_t dim,
   }
 
   request->set_model_name(proto::Constants::DSSM_V2);
+  proto::Constants::IndexType index_type;
+  if (proto::Constants::IndexType_Parse(FLAGS_index_type, &index_type)) {
+    request->set_index_type(index_type);
+  }
+  request->mutable_search_params()->set_nprobe(FLAGS_nprobe);
+  request->mutable_search_params()->set_refine_factor(FLAGS_refine_factor);
+  BuildFilter(FLAGS_filter, request->mutable_filter());
 }
 
 void Recall(const std::unique_ptr<proto::IndexService::Stub>& stub) {
@@ -44,6 +83,31 @@ void Recall(const std::unique_ptr<proto::IndexService::Stub>& stub) {
   }
 }
 
+void Update(const std::unique_ptr<proto::IndexService::Stub>& stub) {
+  proto::UpdateRequest request;
+  proto::UpdateResponse response;
+  request.set_model_name(proto::Constants::DSSM_V2);
+  if (FLAGS_delete_label) {
+    request.add_deletes(FLAGS_label);
+  } else {
+    std::mt19937 rng{std::random_device{}()};
+    std::uniform_real_distribution<> distrib;
+    auto* item = request.add_upserts();
+    item->set_label(FLAGS_label);
+    for (int i = 0; i < FLAGS_dim; ++i) {
+      item->add_vec(distrib(rng));
+    }
+  }
+
+  grpc::ClientContext context;
+  auto status = stub->Update(&context, request, &response);
+  if (status.ok()) {
+    LOG(INFO) << response.DebugString();
+  } else {
+    LOG(INFO) << status.error_message();
+  }
+}
+
 void Status(const std::unique_ptr<proto::IndexService::Stub>& stub) {
   proto::StatusRequest request;
   proto::StatusResponse response;
@@ -56,6 +120,51 @@ void Status(const std::unique_ptr<proto::IndexService::Stub>& stub) {
   }
 }
 
+// 并发压测Retrieval, 对比server开启search_batch前后的qps和延迟
+void Bench(const std::unique_ptr<proto::IndexService::Stub>& stub) {
+  std::vector<std::vector<uint64_t>> costs(FLAGS_threads);
+  std::atomic_uint32_t errors{0};
+  std::vector<std::thread> threads;
+  auto begin = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < FLAGS_threads; ++i) {
+    threads.emplace_back([&stub, &costs, &errors, i]() {
+      proto::RetrievalRequest request;
+      BuildRequest(&request, FLAGS_query_size, FLAGS_dim, FLAGS_topk);
+      costs[i].reserve(FLAGS_requests);
+      for (uint32_t j = 0; j < FLAGS_requests; ++j) {
+        proto::RetrievalResponse response;
+        grpc::ClientContext context;
+        auto start = std::chrono::steady_clock::now();
+        auto status = stub->Retrieval(&context, request, &response);
+        auto end = std::chrono::steady_clock::now();
+        costs[i].push_back(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        if (!status.ok()) {
+          ++errors;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto total_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+
+  std::vector<uint64_t> all;
+  for (const auto& cost : costs) {
+    all.insert(all.end(), cost.begin(), cost.end());
+  }
+  if (all.empty()) {
+    return;
+  }
+  std::sort(all.begin(), all.end());
+  auto percentile = [&all](double p) {
+    return all[std::min<size_t>(all.size() - 1, all.size() * p)];
+  };
+  LOG(INFO) << "threads: " << FLAGS_threads << "; requests: " << all.size() << "; errors: " << errors.load()
+    << "; qps: " << all.size() * 1000.0 / std::max<int64_t>(total_ms, 1)
+    << "; p50: " << percentile(0.5) << "us; p99: " << percentile(0.99) << "us; max: " << all.back() << "us";
+}
+
 int main(int argc, char** argv) {
   gflags::ParseCommandLineFlags(&argc, &argv, true);
 
@@ -66,6 +175,10 @@ int main(int argc, char** argv) {
     Recall(stub);
   } else if (FLAGS_method == "status") {
     Status(stub);
+  } else if (FLAGS_method == "update") {
+    Update(stub);
+  } else if (FLAGS_method == "bench") {
+    Bench(stub);
   }
 
   return 0;
@@ -0,0 +1,101 @@
+#include "common/attribute_index.h"
+
+#include <fstream>
+#include <algorithm>
+
+#include <glog/logging.h>
+#include <absl/strings/str_cat.h>
+#include <boost/filesystem.hpp>
+#include <boost/system/error_code.hpp>
+
+#include "common/constants.h"
+
+void AttributeIndex::Add(int64_t id, const google::protobuf::RepeatedPtrField<proto::Attribute> &attrs) {
+  for (const auto& attr : attrs) {
+    auto& ids = postings_[attr.field()][attr.value()];
+    // id递增分配, 同一item重复的属性只记一次
+    if (ids.empty() || ids.back() != id) {
+      ids.push_back(id);
+    }
+  }
+}
+
+bool AttributeIndex::Write(const std::string &path) const {
+  proto::AttributeFile attribute_file;
+  for (const auto& field : postings_) {
+    for (const auto& value : field.second) {
+      auto* posting = attribute_file.add_postings();
+      posting->set_field(field.first);
+      posting->set_value(value.first);
+      posting->mutable_ids()->Add(value.second.begin(), value.second.end());
+    }
+  }
+  std::ofstream writer(path, std::ios::binary);
+  if (!writer.is_open() || !attribute_file.SerializeToOstream(&writer)) {
+    LOG(WARNING) << "write " << path << " error";
+    return false;
+  }
+  return true;
+}
+
+bool AttributeIndex::Load(const std::string &dir) {
+  std::string path = absl::StrCat(dir, "/", kFaissAttrsName);
+  boost::system::error_code ec;
+  if (!boost::filesystem::is_regular_file(path, ec)) {
+    return true;
+  }
+  std::ifstream reader(path, std::ios::binary);
+  proto::AttributeFile attribute_file;
+  if (!attribute_file.ParseFromIstream(&reader)) {
+    LOG(WARNING) << "parse " << path << " error";
+    return false;
+  }
+  for (auto& posting : *attribute_file.mutable_postings()) {
+    postings_[posting.field()][posting.value()].assign(posting.ids().begin(), posting.ids().end());
+  }
+  return true;
+}
+
+Bitmap AttributeIndex::Compile(const proto::Filter &filter, size_t size) const {
+  Bitmap result(size);
+  result.Not();
+  for (const auto& condition : filter.conditions()) {
+    Bitmap match(size);
+    auto field_it = postings_.find(condition.field());
+    if (field_it != postings_.end()) {
+      for (const auto& value : condition.values()) {
+        auto value_it = field_it->second.find(value);
+        if (value_it == field_it->second.end()) {
+          continue;
+        }
+        for (auto id : value_it->second) {
+          if (id < size) {
+            match.Set(id);
+          }
+        }
+      }
+    }
+    if (condition.exclude()) {
+      result.AndNot(match);
+    } else {
+      result.And(match);
+    }
+  }
+  return result;
+}
+
+std::vector<std::vector<proto::Attribute>> AttributeIndex::Get(int64_t begin, int64_t end) const {
+  std::vector<std::vector<proto::Attribute>> attrs(end - begin);
+  for (const auto& field : postings_) {
+    for (const auto& value : field.second) {
+      auto it = std::lower_bound(value.second.begin(), value.second.end(), begin);
+      for (; it != value.second.end() && *it < end; ++it) {
+        proto::Attribute attr;
+        attr.set_field(field.first);
+        attr.set_value(value.first);
+        attrs[*it - begin].push_back(std::move(attr));
+      }
+    }
+  }
+  return attrs;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "source.pb.h"
+#include "service.pb.h"
+#include "common/bitmap.h"
+
+// 属性倒排: field -> value -> 升序id, 过滤条件编译为bitmap
+class AttributeIndex {
+ public:
+  void Add(int64_t id, const google::protobuf::RepeatedPtrField<proto::Attribute>& attrs);
+
+  bool Empty() const {
+    return postings_.empty();
+  }
+
+  bool Write(const std::string& path) const;
+
+  // 文件不存在时为空, 此时只有exclude条件能命中
+  bool Load(const std::string& dir);
+
+  Bitmap Compile(const proto::Filter& filter, size_t size) const;
+
+  // 取[begin, end)范围内id的属性, 用于压缩增量日志
+  std::vector<std::vector<proto::Attribute>> Get(int64_t begin, int64_t end) const;
+
+ private:
+  std::unordered_map<std::string, std::unordered_map<std::string, std::vector<uint32_t>>> postings_;
+};
@@ -0,0 +1,43 @@
+#include "common/bitmap.h"
+
+#include <cstring>
+#include <algorithm>
+
+void Bitmap::And(const Bitmap &other) {
+  size_t common = std::min(bits_.size(), other.bits_.size());
+  for (size_t i = 0; i < common; ++i) {
+    bits_[i] &= other.bits_[i];
+  }
+  std::fill(bits_.begin() + common, bits_.end(), 0);
+}
+
+void Bitmap::AndNot(const Bitmap &other) {
+  size_t common = std::min(bits_.size(), other.bits_.size());
+  for (size_t i = 0; i < common; ++i) {
+    bits_[i] &= ~other.bits_[i];
+  }
+}
+
+void Bitmap::Not() {
+  for (auto& byte : bits_) {
+    byte = ~byte;
+  }
+  // 清掉末尾多余的位
+  if (size_ & 7) {
+    bits_.back() &= (1 << (size_ & 7)) - 1;
+  }
+}
+
+size_t Bitmap::Count() const {
+  size_t count{0};
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= bits_.size(); i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, bits_.data() + i, sizeof(uint64_t));
+    count += __builtin_popcountll(word);
+  }
+  for (; i < bits_.size(); ++i) {
+    count += __builtin_popcount(bits_[i]);
+  }
+  return count;
+}
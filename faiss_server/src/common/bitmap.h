@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 按faiss::IDSelectorBitmap的布局存储: 第i位在bits[i >> 3]的第(i & 7)位
+class Bitmap {
+ public:
+  Bitmap() = default;
+  explicit Bitmap(size_t size) : size_(size), bits_((size + 7) >> 3, 0) {}
+
+  void Resize(size_t size) {
+    size_ = size;
+    bits_.resize((size + 7) >> 3, 0);
+  }
+  void Set(size_t i) {
+    bits_[i >> 3] |= 1 << (i & 7);
+  }
+  bool Test(size_t i) const {
+    return bits_[i >> 3] >> (i & 7) & 1;
+  }
+  size_t Size() const {
+    return size_;
+  }
+  const uint8_t* Data() const {
+    return bits_.data();
+  }
+  size_t ByteSize() const {
+    return bits_.size();
+  }
+
+  // 长度不同时按较短的计算, 超出部分视为0
+  void And(const Bitmap& other);
+  void AndNot(const Bitmap& other);
+  void Not();
+  size_t Count() const;
+
+ private:
+  size_t size_{0};
+  std::vector<uint8_t> bits_;
+};
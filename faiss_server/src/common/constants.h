@@ -9,8 +9,15 @@ constexpr char kQueryFileName[] = "query";
 constexpr char kSourceMetaSuffix[] = ".meta.txt";
 constexpr char kSourceFileSuffix[] = ".source.txt";
 constexpr char kSourceBinarySuffix[] = ".dat";
+constexpr char kSourceVectorSuffix[] = ".vec";
 constexpr char kFaissIndexSuffix[] = ".index";
+constexpr char kFaissTuneSuffix[] = ".tune.pb_txt";
 constexpr char kFaissIdsName[] = "ids.txt";
+constexpr char kFaissLabelsName[] = "labels.bin";
+constexpr char kDeltaLogName[] = "delta.log";
+constexpr char kFaissAttrsName[] = "attrs.pb";
+constexpr char kFaissVectorsName[] = "vectors.vec";
+constexpr uint32_t kDefaultBruteForceSize = 20000;
 
 // <proto中索引类型名，faiss索引类型,文件后缀>
 extern const std::vector<std::pair<proto::Constants::IndexType, std::string>> index_type_names;
@@ -0,0 +1,113 @@
+#include "common/label_store.h"
+
+#include <fstream>
+
+#include <glog/logging.h>
+#include <absl/strings/str_cat.h>
+#include <boost/filesystem.hpp>
+#include <boost/system/error_code.hpp>
+
+#include "common/constants.h"
+
+bool WriteLabelFile(const std::string &path, const std::vector<std::string> &labels) {
+  std::ofstream writer(path, std::ios::binary);
+  if (!writer.is_open()) {
+    LOG(WARNING) << "open " << path << " error";
+    return false;
+  }
+  LabelHeader header{kLabelMagic, kLabelVersion, labels.size()};
+  writer.write((char*) &header, sizeof(header));
+  uint64_t offset{0};
+  writer.write((char*) &offset, sizeof(uint64_t));
+  for (const auto& label : labels) {
+    offset += label.size();
+    writer.write((char*) &offset, sizeof(uint64_t));
+  }
+  for (const auto& label : labels) {
+    writer.write(label.data(), label.size());
+  }
+  writer.close();
+  return writer.good();
+}
+
+bool LabelStore::Load(const std::string &dir) {
+  boost::system::error_code ec;
+  std::string mapped_file = absl::StrCat(dir, "/", kFaissLabelsName);
+  if (boost::filesystem::is_regular_file(mapped_file, ec)) {
+    return LoadMapped(mapped_file);
+  }
+  return LoadText(absl::StrCat(dir, "/", kFaissIdsName));
+}
+
+absl::string_view LabelStore::Get(int64_t id) const {
+  if (id < 0 || id >= size_) {
+    return {};
+  }
+  if (id >= base_size_) {
+    return appended_[id - base_size_];
+  }
+  if (offsets_ == nullptr) {
+    return texts_[id];
+  }
+  return {blob_ + offsets_[id], offsets_[id + 1] - offsets_[id]};
+}
+
+bool LabelStore::LoadMapped(const std::string &path) {
+  if (!file_.Open(path)) {
+    return false;
+  }
+  if (file_.Size() < sizeof(LabelHeader)) {
+    LOG(WARNING) << path << " header error";
+    return false;
+  }
+  const auto* header = reinterpret_cast<const LabelHeader*>(file_.Data());
+  if (header->magic != kLabelMagic || header->version != kLabelVersion) {
+    LOG(WARNING) << path << " magic or version error: " << header->version;
+    return false;
+  }
+  // 先按文件大小限制count, 避免(count + 1) * 8溢出
+  const uint64_t max_count = (file_.Size() - sizeof(LabelHeader)) / sizeof(uint64_t);
+  if (header->count >= max_count) {
+    LOG(WARNING) << path << " offsets error, count: " << header->count;
+    return false;
+  }
+  size_t blob_begin = sizeof(LabelHeader) + (header->count + 1) * sizeof(uint64_t);
+  offsets_ = reinterpret_cast<const uint64_t*>(file_.Data() + sizeof(LabelHeader));
+  blob_ = file_.Data() + blob_begin;
+  if (offsets_[0] != 0 || offsets_[header->count] != file_.Size() - blob_begin) {
+    LOG(WARNING) << path << " blob size error";
+    offsets_ = nullptr;
+    return false;
+  }
+  // 偏移递增, Get中的长度不会下溢
+  for (uint64_t i = 0; i < header->count; ++i) {
+    if (offsets_[i] > offsets_[i + 1]) {
+      LOG(WARNING) << path << " offsets not sorted at " << i;
+      offsets_ = nullptr;
+      return false;
+    }
+  }
+  size_ = header->count;
+  base_size_ = size_;
+  return true;
+}
+
+bool LabelStore::LoadText(const std::string &path) {
+  std::ifstream reader{path};
+  if (!reader.is_open()) {
+    LOG(WARNING) << path << " not found";
+    return false;
+  }
+  std::string line;
+  while (std::getline(reader, line)) {
+    texts_.push_back(std::move(line));
+  }
+  size_ = texts_.size();
+  base_size_ = size_;
+  return true;
+}
+
+int64_t LabelStore::Append(std::string label) {
+  appended_.push_back(std::move(label));
+  return size_++;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <absl/strings/string_view.h>
+#include <boost/noncopyable.hpp>
+
+#include "common/mapped_file.h"
+
+// labels.bin: LabelHeader | uint64 offsets[count + 1] | 字符串blob, 第i个label为blob[offsets[i], offsets[i+1])
+struct LabelHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t count;
+};
+
+constexpr uint32_t kLabelMagic = 0x4c424c46;
+constexpr uint32_t kLabelVersion = 1;
+
+bool WriteLabelFile(const std::string& path, const std::vector<std::string>& labels);
+
+// 索引id到label的映射, 优先mmap labels.bin, 不存在时读取ids.txt
+class LabelStore : public boost::noncopyable {
+ public:
+  bool Load(const std::string& dir);
+
+  size_t Size() const {
+    return size_;
+  }
+
+  // faiss结果不足topk时id为-1, 返回空串
+  absl::string_view Get(int64_t id) const;
+
+  // 追加的label只在内存中, 由调用方负责持久化, 返回新label的id
+  int64_t Append(std::string label);
+
+ private:
+  bool LoadMapped(const std::string& path);
+
+  bool LoadText(const std::string& path);
+
+ private:
+  size_t size_{0};
+  // 文件中加载的label数, 之后的id在appended_中
+  size_t base_size_{0};
+  MappedFile file_;
+  const uint64_t* offsets_{nullptr};
+  const char* blob_{nullptr};
+  std::vector<std::string> texts_;
+  std::vector<std::string> appended_;
+};
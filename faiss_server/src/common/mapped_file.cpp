@@ -0,0 +1,38 @@
+#include "common/mapped_file.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glog/logging.h>
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+bool MappedFile::Open(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG(WARNING) << "open " << path << " fail";
+    return false;
+  }
+  struct stat st{};
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    LOG(WARNING) << "stat " << path << " fail";
+    close(fd);
+    return false;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  // 映射建立后fd可以关闭
+  close(fd);
+  if (data == MAP_FAILED) {
+    LOG(WARNING) << "mmap " << path << " fail";
+    return false;
+  }
+  data_ = static_cast<const char*>(data);
+  size_ = st.st_size;
+  return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <boost/noncopyable.hpp>
+
+// 只读mmap文件, 多个进程/版本共享page cache
+class MappedFile : public boost::noncopyable {
+ public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  bool Open(const std::string& path);
+
+  const char* Data() const {
+    return data_;
+  }
+  size_t Size() const {
+    return size_;
+  }
+
+ private:
+  const char* data_{nullptr};
+  size_t size_{0};
+};
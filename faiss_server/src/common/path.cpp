@@ -31,3 +31,7 @@ std::string GetIndexFileName(proto::Constants::IndexType index_type) {
   return absl::StrCat(proto::Constants::IndexType_Name(index_type), kFaissIndexSuffix);
 }
 
+std::string GetTuneFileName(proto::Constants::IndexType index_type) {
+  return absl::StrCat(proto::Constants::IndexType_Name(index_type), kFaissTuneSuffix);
+}
+
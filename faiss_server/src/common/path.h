@@ -8,3 +8,5 @@ std::string GenTimePath(const std::string& dir, const std::string& sub_dir);
 bool MkdirIfNotExist(const std::string& dir);
 
 std::string GetIndexFileName(proto::Constants::IndexType index_type);
+
+std::string GetTuneFileName(proto::Constants::IndexType index_type);
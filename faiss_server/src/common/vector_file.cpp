@@ -0,0 +1,201 @@
+#include "common/vector_file.h"
+
+#include <cmath>
+#include <cstring>
+
+#include <glog/logging.h>
+
+namespace {
+
+constexpr size_t kMatrixAlign = 64;
+// offsets按uint64访问, float16矩阵的长度可能不是8的倍数
+constexpr size_t kOffsetsAlign = sizeof(uint64_t);
+
+size_t ElementSize(uint32_t dtype) {
+  return dtype == kFloat16 ? sizeof(uint16_t) : sizeof(float);
+}
+
+}
+
+uint16_t EncodeFp16(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000;
+  int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+  if (((bits >> 23) & 0xff) == 0xff) {
+    // inf和nan
+    return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+  }
+  if (exponent >= 0x1f) {
+    return sign | 0x7c00;
+  }
+  if (exponent <= 0) {
+    // 非规格化数, 太小时为0
+    if (exponent < -10) {
+      return sign;
+    }
+    mantissa |= 0x800000;
+    uint32_t shift = 14 - exponent;
+    uint32_t half = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t middle = 1u << (shift - 1);
+    if (rest > middle || (rest == middle && (half & 1))) {
+      ++half;
+    }
+    return sign | half;
+  }
+  uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+  uint32_t rest = mantissa & 0x1fff;
+  // 四舍六入五成双, 进位可以自然进到指数
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+    ++half;
+  }
+  return half;
+}
+
+float DecodeFp16(uint16_t value) {
+  uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+  uint32_t exponent = (value >> 10) & 0x1f;
+  uint32_t mantissa = value & 0x3ff;
+  uint32_t bits;
+  if (exponent == 0x1f) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else if (exponent != 0) {
+    bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+  } else if (mantissa == 0) {
+    bits = sign;
+  } else {
+    // 非规格化数转为规格化的float
+    exponent = 127 - 15 + 1;
+    while ((mantissa & 0x400) == 0) {
+      mantissa <<= 1;
+      --exponent;
+    }
+    bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+  }
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+bool VectorFileWriter::Open(const std::string &path, uint32_t dim, VectorDType dtype) {
+  writer_.open(path, std::ios::binary);
+  if (!writer_.is_open()) {
+    LOG(WARNING) << "open " << path << " error";
+    return false;
+  }
+  header_ = {kVectorMagic, kVectorVersion, dim, dtype, 0, kMatrixAlign, 0, 0};
+  // 先写占位头, Close时回填
+  std::string head(kMatrixAlign, '\0');
+  writer_.write(head.data(), head.size());
+  offsets_.assign(1, 0);
+  return writer_.good();
+}
+
+bool VectorFileWriter::Add(absl::string_view label, const float *vec) {
+  if (header_.dtype == kFloat16) {
+    half_.resize(header_.dim);
+    for (uint32_t i = 0; i < header_.dim; ++i) {
+      half_[i] = EncodeFp16(vec[i]);
+    }
+    writer_.write((char*) half_.data(), half_.size() * sizeof(uint16_t));
+  } else {
+    writer_.write((const char*) vec, header_.dim * sizeof(float));
+  }
+  blob_.append(label.data(), label.size());
+  offsets_.push_back(blob_.size());
+  ++header_.count;
+  return writer_.good();
+}
+
+bool VectorFileWriter::Close() {
+  uint64_t matrix_end = header_.matrix_offset + header_.count * header_.dim * ElementSize(header_.dtype);
+  header_.labels_offset = (matrix_end + kOffsetsAlign - 1) / kOffsetsAlign * kOffsetsAlign;
+  std::string padding(header_.labels_offset - matrix_end, '\0');
+  writer_.write(padding.data(), padding.size());
+  writer_.write((char*) offsets_.data(), offsets_.size() * sizeof(uint64_t));
+  writer_.write(blob_.data(), blob_.size());
+  writer_.seekp(0);
+  writer_.write((char*) &header_, sizeof(header_));
+  writer_.close();
+  return writer_.good();
+}
+
+bool VectorFile::Open(const std::string &path) {
+  if (!file_.Open(path)) {
+    return false;
+  }
+  if (file_.Size() < sizeof(VectorHeader)) {
+    LOG(WARNING) << path << " header error";
+    return false;
+  }
+  const auto* header = reinterpret_cast<const VectorHeader*>(file_.Data());
+  if (header->magic != kVectorMagic || header->version != kVectorVersion || header->dtype > kFloat16) {
+    LOG(WARNING) << path << " magic or version error: " << header->version;
+    return false;
+  }
+  if (header->matrix_offset % kMatrixAlign != 0 || header->matrix_offset > file_.Size()
+      || header->labels_offset % kOffsetsAlign != 0 || header->labels_offset > file_.Size()) {
+    LOG(WARNING) << path << " layout error";
+    return false;
+  }
+  // 先按文件大小限制count, 避免矩阵大小和(count + 1) * 8溢出
+  const uint64_t row_size = uint64_t{header->dim} * ElementSize(header->dtype);
+  const uint64_t max_count = (file_.Size() - header->labels_offset) / sizeof(uint64_t);
+  if (header->count >= max_count
+      || (row_size != 0 && header->count > (file_.Size() - header->matrix_offset) / row_size)) {
+    LOG(WARNING) << path << " count error: " << header->count;
+    return false;
+  }
+  uint64_t matrix_end = header->matrix_offset + header->count * row_size;
+  uint64_t blob_begin = header->labels_offset + (header->count + 1) * sizeof(uint64_t);
+  if (header->labels_offset < matrix_end) {
+    LOG(WARNING) << path << " layout error";
+    return false;
+  }
+  const auto* offsets = reinterpret_cast<const uint64_t*>(file_.Data() + header->labels_offset);
+  if (offsets[0] != 0 || offsets[header->count] != file_.Size() - blob_begin) {
+    LOG(WARNING) << path << " blob size error";
+    return false;
+  }
+  // 偏移递增, Label中的长度不会下溢
+  for (uint64_t i = 0; i < header->count; ++i) {
+    if (offsets[i] > offsets[i + 1]) {
+      LOG(WARNING) << path << " offsets not sorted at " << i;
+      return false;
+    }
+  }
+  header_ = header;
+  matrix_ = file_.Data() + header->matrix_offset;
+  offsets_ = offsets;
+  blob_ = file_.Data() + blob_begin;
+  return true;
+}
+
+const float *VectorFile::Matrix() const {
+  return DType() == kFloat32 ? reinterpret_cast<const float*>(matrix_) : nullptr;
+}
+
+const uint16_t *VectorFile::HalfMatrix() const {
+  return DType() == kFloat16 ? reinterpret_cast<const uint16_t*>(matrix_) : nullptr;
+}
+
+void VectorFile::Decode(size_t begin, size_t n, float *out) const {
+  size_t elements = n * Dim();
+  if (DType() == kFloat32) {
+    std::memcpy(out, Matrix() + begin * Dim(), elements * sizeof(float));
+    return;
+  }
+  const uint16_t* half = HalfMatrix() + begin * Dim();
+  for (size_t i = 0; i < elements; ++i) {
+    out[i] = DecodeFp16(half[i]);
+  }
+}
+
+absl::string_view VectorFile::Label(size_t id) const {
+  if (id >= Size()) {
+    return {};
+  }
+  return {blob_ + offsets_[id], offsets_[id + 1] - offsets_[id]};
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <absl/strings/string_view.h>
+#include <boost/noncopyable.hpp>
+
+#include "common/mapped_file.h"
+
+// 列式向量文件: VectorHeader | 向量矩阵(count * dim, float32或float16) | 按8字节对齐的uint64 offsets[count + 1] | label blob
+// 矩阵按64字节对齐, float32时mmap后的指针可以直接交给faiss
+struct VectorHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t dim;
+  uint32_t dtype;
+  uint64_t count;
+  uint64_t matrix_offset;
+  uint64_t labels_offset;
+  uint64_t reserved;
+};
+
+constexpr uint32_t kVectorMagic = 0x43455646;
+constexpr uint32_t kVectorVersion = 1;
+
+enum VectorDType : uint32_t {
+  kFloat32 = 0,
+  kFloat16 = 1,
+};
+
+uint16_t EncodeFp16(float value);
+
+float DecodeFp16(uint16_t value);
+
+// 顺序写入, 矩阵直接落盘, label在Close时写入
+class VectorFileWriter : public boost::noncopyable {
+ public:
+  bool Open(const std::string& path, uint32_t dim, VectorDType dtype);
+
+  bool Add(absl::string_view label, const float* vec);
+
+  bool Close();
+
+ private:
+  std::ofstream writer_;
+  VectorHeader header_{};
+  std::vector<uint16_t> half_;
+  std::vector<uint64_t> offsets_;
+  std::string blob_;
+};
+
+// mmap只读访问, 不拷贝矩阵和label
+class VectorFile : public boost::noncopyable {
+ public:
+  bool Open(const std::string& path);
+
+  // 未打开时为0
+  uint32_t Dim() const {
+    return header_ == nullptr ? 0 : header_->dim;
+  }
+  size_t Size() const {
+    return header_ == nullptr ? 0 : header_->count;
+  }
+  VectorDType DType() const {
+    return static_cast<VectorDType>(header_->dtype);
+  }
+
+  // float16时为nullptr, 需要Decode
+  const float* Matrix() const;
+
+  const uint16_t* HalfMatrix() const;
+
+  // 把[begin, begin + n)行解码为float32
+  void Decode(size_t begin, size_t n, float* out) const;
+
+  absl::string_view Label(size_t id) const;
+
+ private:
+  MappedFile file_;
+  const VectorHeader* header_{nullptr};
+  const char* matrix_{nullptr};
+  const uint64_t* offsets_{nullptr};
+  const char* blob_{nullptr};
+};
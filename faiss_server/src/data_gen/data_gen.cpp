@@ -3,6 +3,7 @@
 #include <sstream>
 
 #include <gflags/gflags.h>
+#include <glog/logging.h>
 /*#include <google/protobuf/stubs/common.h>
 #include <google/protobuf/io/zero_copy_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
@@ -12,11 +13,20 @@
 
 #include "source.pb.h"
 #include "common/constants.h"
+#include "common/vector_file.h"
+#include "common/attribute_index.h"
 
 DEFINE_string(output_dir, ".", "");
 DEFINE_uint32(dim, 128, "");
 DEFINE_uint32(data_size, 200000, "");
 DEFINE_uint32(query_size, 10000, "");
+DEFINE_uint32(category_size, 20, "values of category attribute, 0 for no attributes");
+DEFINE_uint32(region_size, 5, "values of region attribute, 0 for no attributes");
+DEFINE_string(format, "both", "source format: dat for proto records, vec for columnar file, both for the same data in two formats");
+DEFINE_validator(format, [](const char* flagname, const std::string& value)->bool {
+    return value == "dat" || value == "vec" || value == "both";
+});
+DEFINE_bool(fp16, false, "store vectors of columnar file as float16");
 
 
 /*void MakeDataByStream(const std::string& path) {
@@ -52,11 +62,19 @@ DEFINE_uint32(query_size, 10000, "");
   file_writer.close();
 }*/
 
-void MakeData(const std::string& path) {
+bool MakeData() {
   std::mt19937 rng{std::random_device{}()};
   std::uniform_real_distribution<> distrib;
-  std::ofstream writer{absl::StrCat(FLAGS_output_dir, "/", kSourceFileName, kSourceBinarySuffix), std::ios::binary};
-  {
+  bool write_binary = FLAGS_format != "vec";
+  bool write_vector = FLAGS_format != "dat";
+  std::string binary_path = absl::StrCat(FLAGS_output_dir, "/", kSourceFileName, kSourceBinarySuffix);
+  std::ofstream writer;
+  if (write_binary) {
+    writer.open(binary_path, std::ios::binary);
+    if (!writer.is_open()) {
+      LOG(WARNING) << "open " << binary_path << " error";
+      return false;
+    }
     proto::SourceMeta meta;
     meta.set_dim(FLAGS_dim);
     meta.set_length(FLAGS_data_size);
@@ -65,17 +83,56 @@ void MakeData(const std::string& path) {
     writer.write((char *) &len, sizeof(uint64_t));
     writer.write(buffer.c_str(), len);
   }
+  VectorFileWriter vector_writer;
+  AttributeIndex attributes;
+  if (write_vector && !vector_writer.Open(absl::StrCat(FLAGS_output_dir, "/", kSourceFileName, kSourceVectorSuffix),
+                                          FLAGS_dim, FLAGS_fp16 ? kFloat16 : kFloat32)) {
+    return false;
+  }
   for (int i = 0; i < FLAGS_data_size; ++i) {
     proto::Source source;
     source.set_label("label_" + std::to_string(i));
     for (int j = 0; j < FLAGS_dim; ++j) {
       source.add_vec(distrib(rng));
     }
-    std::string buffer = source.SerializeAsString();
-    uint64_t len = buffer.size();
-    writer.write((char *) &len, sizeof(uint64_t));
-    writer.write(buffer.c_str(), len);
+    if (FLAGS_category_size > 0) {
+      auto* attr = source.add_attrs();
+      attr->set_field("category");
+      attr->set_value(absl::StrCat("c", rng() % FLAGS_category_size));
+    }
+    // 每个item可售卖的地区可以有多个
+    for (uint32_t region = 0; region < FLAGS_region_size; ++region) {
+      if (rng() % 2 == 0) {
+        auto* attr = source.add_attrs();
+        attr->set_field("region");
+        attr->set_value(absl::StrCat("r", region));
+      }
+    }
+    if (write_vector) {
+      if (!vector_writer.Add(source.label(), source.vec().data())) {
+        return false;
+      }
+      attributes.Add(i, source.attrs());
+    }
+    if (write_binary) {
+      std::string buffer = source.SerializeAsString();
+      uint64_t len = buffer.size();
+      writer.write((char *) &len, sizeof(uint64_t));
+      writer.write(buffer.c_str(), len);
+    }
+  }
+  if (write_binary) {
+    writer.close();
+    if (!writer) {
+      LOG(WARNING) << "write " << binary_path << " error";
+      return false;
+    }
   }
+  // 列式文件的属性写在同目录的attrs.pb
+  if (write_vector && (!vector_writer.Close() || !attributes.Write(absl::StrCat(FLAGS_output_dir, "/", kFaissAttrsName)))) {
+    return false;
+  }
+  return true;
 }
 
 void MakeTextData() {
@@ -107,7 +164,10 @@ void MakeTextData() {
 int main(int argc, char** argv) {
   gflags::ParseCommandLineFlags(&argc, &argv, true);
 
-  MakeData(absl::StrCat(FLAGS_output_dir, "/", kSourceFileName, kSourceBinarySuffix));
+  if (!MakeData()) {
+    LOG(WARNING) << "make data error";
+    return 1;
+  }
 
   MakeTextData();
   return 0;
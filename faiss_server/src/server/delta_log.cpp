@@ -0,0 +1,87 @@
+#include "server/delta_log.h"
+
+#include <cstdio>
+
+#include <glog/logging.h>
+#include <absl/strings/str_cat.h>
+#include <boost/filesystem.hpp>
+#include <boost/system/error_code.hpp>
+
+namespace {
+
+bool WriteRecord(const proto::UpdateRequest& request, std::ofstream* writer) {
+  std::string buffer = request.SerializeAsString();
+  uint64_t len = buffer.size();
+  writer->write((char *) &len, sizeof(uint64_t));
+  writer->write(buffer.c_str(), len);
+  writer->flush();
+  return writer->good();
+}
+
+}
+
+bool DeltaLog::Open(const std::string &path, const std::function<void(const proto::UpdateRequest&)>& replay) {
+  path_ = path;
+  boost::system::error_code ec;
+  uint64_t file_size = boost::filesystem::exists(path, ec) ? boost::filesystem::file_size(path, ec) : 0;
+  uint64_t records{0};
+  uint64_t valid_size{0};
+  {
+    std::ifstream reader(path, std::ios::binary);
+    std::string buffer;
+    uint64_t len{0};
+    while (valid_size < file_size && reader.read((char*) &len, sizeof(uint64_t))) {
+      // 进程退出时可能只写了一半, 丢弃尾部不完整的记录
+      proto::UpdateRequest request;
+      if (len > file_size - valid_size - sizeof(uint64_t)) {
+        break;
+      }
+      buffer.resize(len);
+      if (!reader.read(buffer.data(), len) || !request.ParseFromString(buffer)) {
+        break;
+      }
+      replay(request);
+      ++records;
+      valid_size += sizeof(uint64_t) + len;
+    }
+  }
+  // 截掉损坏的尾部, 否则之后追加的记录无法回放
+  if (valid_size < file_size) {
+    LOG(WARNING) << path << " drop broken tail at record " << records << ", size: " << file_size - valid_size;
+    boost::filesystem::resize_file(path, valid_size, ec);
+    if (ec) {
+      LOG(WARNING) << "truncate " << path << " error: " << ec.message();
+      return false;
+    }
+  }
+  if (records > 0) {
+    LOG(INFO) << "replay " << records << " records from " << path;
+  }
+  writer_.open(path, std::ios::binary | std::ios::app);
+  if (!writer_.is_open()) {
+    LOG(WARNING) << "open " << path << " error";
+    return false;
+  }
+  return true;
+}
+
+bool DeltaLog::Append(const proto::UpdateRequest &request) {
+  return WriteRecord(request, &writer_);
+}
+
+bool DeltaLog::Rewrite(const proto::UpdateRequest &snapshot) {
+  std::string tmp_path = absl::StrCat(path_, ".tmp");
+  {
+    std::ofstream writer(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!writer.is_open() || !WriteRecord(snapshot, &writer)) {
+      LOG(WARNING) << "write " << tmp_path << " error";
+      return false;
+    }
+  }
+  writer_.close();
+  if (std::rename(tmp_path.c_str(), path_.c_str()) != 0) {
+    LOG(WARNING) << "rename " << tmp_path << " error";
+  }
+  writer_.open(path_, std::ios::binary | std::ios::app);
+  return writer_.is_open();
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <functional>
+
+#include <boost/noncopyable.hpp>
+#include "service.pb.h"
+
+// 版本目录下的增量更新日志, 每条记录为uint64长度 + UpdateRequest, 与source数据文件格式一致
+// 新的全量版本包含此前的所有更新, 因此日志只对所在版本有效
+class DeltaLog : public boost::noncopyable {
+ public:
+  // 回放已有记录后以追加方式打开
+  bool Open(const std::string& path, const std::function<void(const proto::UpdateRequest&)>& replay);
+
+  bool Append(const proto::UpdateRequest& request);
+
+  // 用压缩后的快照替换整个日志, 先写临时文件再rename
+  bool Rewrite(const proto::UpdateRequest& snapshot);
+
+ private:
+  std::string path_;
+  std::ofstream writer_;
+};
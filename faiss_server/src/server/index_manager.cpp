@@ -18,12 +18,16 @@ IndexManager::IndexManager() : mulit_index_(proto::Constants::ModelName_ARRAYSIZ
 bool IndexManager::Init(const proto::IndexConfig& index_config) {
   this->index_path_ = index_config.index_path();
   this->model_configs_.insert(model_configs_.end(), index_config.model_config().begin(), index_config.model_config().end());
+  this->batcher_ = std::make_unique<SearchBatcher>(index_config.search_batch(), [this](const SearchParam& param, SearchResult* result) {
+    return SearchIndex(param, result);
+  });
 
   // 加载索引
   LoadModel();
   this->worker_ = std::thread([this](){
     while (this->running_.load()) {
       LoadModel();
+      CompactModel();
       sleep(10);
     }
   });
@@ -32,6 +36,12 @@ bool IndexManager::Init(const proto::IndexConfig& index_config) {
 }
 
 SearchStatus IndexManager::Search(const SearchParam &param, SearchResult *result) {
+  if (batcher_ != nullptr && batcher_->Accept(param)) {
+    return batcher_->Search(param, result);
+  }
+  return SearchIndex(param, result);
+}
+SearchStatus IndexManager::SearchIndex(const SearchParam &param, SearchResult *result) {
   auto& model_index = this->mulit_index_[param.model_name];
   if (model_index.version_.load() == 0) {
     return SearchStatus::MODEL_NOT_FOUND;
@@ -43,6 +53,31 @@ SearchStatus IndexManager::Search(const SearchParam &param, SearchResult *result
   result->version = model_index.version_.load();
   return index->Search(param, result);
 }
+SearchStatus IndexManager::Update(const proto::UpdateRequest &request, proto::UpdateResponse *response) {
+  if (!proto::Constants::ModelName_IsValid(request.model_name())) {
+    return SearchStatus::MODEL_NOT_FOUND;
+  }
+  auto& model_index = this->mulit_index_[request.model_name()];
+  boost::shared_ptr<IndexWrapper> index = model_index.index_.load();
+  if (index == nullptr) {
+    return SearchStatus::MODEL_NOT_FOUND;
+  }
+  uint32_t upserted{0};
+  uint32_t deleted{0};
+  auto status = index->Update(request, &upserted, &deleted);
+  response->set_version(model_index.version_.load());
+  response->set_upserted(upserted);
+  response->set_deleted(deleted);
+  return status;
+}
+void IndexManager::CompactModel() {
+  for (auto& model_index : mulit_index_) {
+    auto index = model_index.index_.load();
+    if (index != nullptr) {
+      index->Compact();
+    }
+  }
+}
 void IndexManager::LoadModel() {
   boost::filesystem::path index_dir(index_path_);
   boost::system::error_code ec;
@@ -64,8 +99,8 @@ void IndexManager::LoadModel() {
       if (current_version < new_version) {
         continue;
       }
-      auto ids_file = version_dir / kFaissIdsName;
-      if (!boost::filesystem::is_regular_file(ids_file, ec)) {
+      if (!boost::filesystem::is_regular_file(version_dir / kFaissLabelsName, ec)
+          && !boost::filesystem::is_regular_file(version_dir / kFaissIdsName, ec)) {
         continue;
       }
       new_version = current_version;
@@ -78,7 +113,7 @@ void IndexManager::LoadModel() {
     auto new_index = boost::make_shared<IndexWrapper>();
     auto version_path = model_dir / std::to_string(new_version);
     Timer timer;
-    if (!new_index->Init(version_path.string())) {
+    if (!new_index->Init(version_path.string(), sub_config)) {
       continue;
     }
     {
@@ -12,6 +12,7 @@
 
 #include "server/search_param.h"
 #include "server/index_wrapper.h"
+#include "server/search_batcher.h"
 
 class ModelIndex : public boost::noncopyable {
  public:
@@ -30,16 +31,23 @@ class IndexManager {
 
   SearchStatus Search(const SearchParam& param, SearchResult* result);
 
+  SearchStatus Update(const proto::UpdateRequest& request, proto::UpdateResponse* response);
+
   bool GetStatus(proto::Constants::ModelName model_name, uint64_t* version, std::vector<std::tuple<proto::Constants::IndexType, uint64_t, uint64_t>>* status);
 
  private:
   void LoadModel();
 
+  void CompactModel();
+
+  SearchStatus SearchIndex(const SearchParam& param, SearchResult* result);
+
  private:
   std::vector<ModelIndex> mulit_index_;
   std::vector<proto::ModelConfig> model_configs_;
   std::string index_path_;
   std::thread worker_;
   std::atomic_bool running_{true};
+  std::unique_ptr<SearchBatcher> batcher_;
 };
 
@@ -1,26 +1,93 @@
 #include "server/index_wrapper.h"
 
-#include <fstream>
+#include <limits>
+#include <algorithm>
 
 #include <glog/logging.h>
 #include <glog/stl_logging.h>
 #include <faiss/Index.h>
 #include <faiss/index_io.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/IndexPreTransform.h>
+#include <faiss/IVFlib.h>
+#include <faiss/AutoTune.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/clone_index.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/utils/distances.h>
 #include <absl/strings/str_cat.h>
 #include <boost/system/error_code.hpp>
 #include <boost/filesystem.hpp>
 
 #include "common/path.h"
 #include "common/constants.h"
+#include "common/config_loader.h"
+#include "common/timer.h"
+#include "builder_config.pb.h"
 
-bool IndexWrapper::Init(const std::string &path) {
-  std::string ids_file = absl::StrCat(path, "/", kFaissIdsName);
+namespace {
 
-  if (!LoadIds(ids_file)) {
+// 与ivflib::search_with_parameters支持的结构一致: 可选的一层预变换加IVF索引, 不是IVF时返回nullptr
+const faiss::IndexIVF* GetIvf(const faiss::Index* index) {
+  if (auto* pre_transform = dynamic_cast<const faiss::IndexPreTransform*>(index)) {
+    index = pre_transform->index;
+  }
+  return dynamic_cast<const faiss::IndexIVF*>(index);
+}
+
+bool IsIvf(const faiss::Index* index) {
+  return GetIvf(index) != nullptr;
+}
+
+// 请求未指定时沿用索引加载时设置的值; nprobe不超过倒排表数
+void FillIvfParams(const faiss::IndexIVF* ivf, const SearchParam& param, faiss::SearchParametersIVF* ivf_params) {
+  ivf_params->nprobe = std::min<size_t>(param.nprobe > 0 ? param.nprobe : ivf->nprobe, ivf->nlist);
+  ivf_params->max_codes = param.max_codes > 0 ? param.max_codes : ivf->max_codes;
+}
+
+// 结果不足时的填充值, 与faiss一致: L2为最大值, 内积为最小值
+float EmptyScore(const faiss::Index* index) {
+  return index->metric_type == faiss::METRIC_INNER_PRODUCT ? -std::numeric_limits<float>::max()
+                                                           : std::numeric_limits<float>::max();
+}
+
+// 预变换之后的IVF和Flat索引在检索时支持IDSelector
+bool SupportsSelector(const faiss::Index* index) {
+  if (auto* pre_transform = dynamic_cast<const faiss::IndexPreTransform*>(index)) {
+    index = pre_transform->index;
+  }
+  return dynamic_cast<const faiss::IndexIVF*>(index) != nullptr || dynamic_cast<const faiss::IndexFlat*>(index) != nullptr;
+}
+
+}
+
+bool IndexWrapper::Init(const std::string &path, const proto::ModelConfig& config) {
+  if (!labels_.Load(path) || !attributes_.Load(path)) {
+    return false;
+  }
+  if (config.brute_force_size() > 0) {
+    brute_force_size_ = config.brute_force_size();
+  }
+  std::string vectors_file = absl::StrCat(path, "/", kFaissVectorsName);
+  boost::system::error_code ec;
+  if (boost::filesystem::is_regular_file(vectors_file, ec)
+      && (!vectors_.Open(vectors_file) || vectors_.Size() != labels_.Size())) {
+    LOG(WARNING) << "load " << vectors_file << " error";
     return false;
   }
 
-  if (!LoadFaiss(path)) {
+  if (!LoadFaiss(path, config)) {
+    return false;
+  }
+  // 精排按索引的维度读取原始向量
+  for (const auto& index : indexes_) {
+    if (index != nullptr && vectors_.Size() > 0 && vectors_.Dim() != index->d) {
+      LOG(WARNING) << "vectors dim error: <" << vectors_.Dim() << "," << index->d << ">";
+      return false;
+    }
+  }
+
+  if (config.updatable() && !InitUpdate(path, config)) {
     return false;
   }
 
@@ -37,7 +104,8 @@ bool IndexWrapper::Init(const std::string &path) {
 }
 
 SearchStatus IndexWrapper::Search(const SearchParam &param, SearchResult *result) {
-  if (indexes_[param.index_type] == nullptr) {
+  std::shared_lock lock(mutex_);
+  if (!proto::Constants::IndexType_IsValid(param.index_type) || indexes_[param.index_type] == nullptr) {
     return SearchStatus::INDEX_NOT_FOUND;
   }
   auto& index = indexes_[param.index_type];
@@ -45,40 +113,264 @@ SearchStatus IndexWrapper::Search(const SearchParam &param, SearchResult *result
   if (index->d * param.query_size != param.vec_size) {
     return SearchStatus::DIM_ERROR;
   }
+  // 候选数随refine_factor成倍增长, 限制上限
+  if (param.refine_factor > kMaxRefineFactor) {
+    return SearchStatus::REFINE_FACTOR_ERROR;
+  }
+  if (param.filter != nullptr) {
+    return SearchFiltered(index.get(), param, result);
+  }
 
-  uint32_t result_size = param.query_size * param.topk;
-  std::vector<faiss::idx_t> ids(result_size);
-  std::vector<float> scores(result_size);
-  try {
-    index->search(param.query_size, param.vec, param.topk, scores.data(), ids.data());
-  } catch (std::exception& e) {
-    LOG(WARNING) << "search error: " << e.what();
-    return SearchStatus::FAISS_ERROR;
+  bool refine = param.refine_factor > 1;
+  if (refine && !CanRefine()) {
+    return SearchStatus::REFINE_NOT_SUPPORTED;
+  }
+
+  // 索引中有已删除的向量时多取一些; 过滤后仍不足topk时加倍重取, 最多取topk + 已删除数
+  uint32_t topk = refine ? param.topk * param.refine_factor : param.topk;
+  const uint64_t deleted = deleted_in_index_[param.index_type];
+  const uint64_t max_fetch = std::min<uint64_t>({topk + deleted, std::max<uint64_t>(index->ntotal, topk),
+                                                 std::numeric_limits<uint32_t>::max()});
+  uint32_t fetch_size = topk + std::min<uint64_t>(deleted, topk);
+  std::vector<faiss::idx_t> ids;
+  std::vector<float> scores;
+  while (true) {
+    ids.resize(param.query_size * fetch_size);
+    scores.resize(param.query_size * fetch_size);
+    try {
+      const faiss::IndexIVF* ivf = param.nprobe > 0 ? GetIvf(index.get()) : nullptr;
+      if (ivf != nullptr) {
+        faiss::IVFSearchParameters ivf_params;
+        FillIvfParams(ivf, param, &ivf_params);
+        faiss::ivflib::search_with_parameters(index.get(), param.query_size, param.vec, fetch_size, scores.data(), ids.data(), &ivf_params);
+      } else {
+        index->search(param.query_size, param.vec, fetch_size, scores.data(), ids.data());
+      }
+    } catch (std::exception& e) {
+      LOG(WARNING) << "search error: " << e.what();
+      return SearchStatus::FAISS_ERROR;
+    }
+    if (fetch_size >= max_fetch || !NeedMoreCandidates(ids, param.query_size, fetch_size, topk)) {
+      break;
+    }
+    fetch_size = std::min<uint64_t>(fetch_size * 2ull, max_fetch);
+  }
+  if (refine) {
+    Refine(index.get(), param, fetch_size, scores.data(), ids.data());
   }
 
-  result->scores = std::move(scores);
+  FillResult(param, fetch_size, std::move(scores), ids, result);
+  return SearchStatus::OK;
+}
+bool IndexWrapper::NeedMoreCandidates(const std::vector<faiss::idx_t> &ids, uint32_t query_size, uint32_t fetch_size, uint32_t need) const {
+  if (!updatable_) {
+    return false;
+  }
+  for (uint32_t i = 0; i < query_size; ++i) {
+    uint32_t count = 0;
+    bool exhausted = false;
+    for (uint32_t j = i * fetch_size; j < (i + 1) * fetch_size; ++j) {
+      if (ids[j] < 0) {
+        // 索引(或探查的倒排表)中已没有更多候选
+        exhausted = true;
+        break;
+      }
+      count += !deleted_.Test(ids[j]);
+    }
+    if (!exhausted && count < need) {
+      return true;
+    }
+  }
+  return false;
+}
+void IndexWrapper::FillResult(const SearchParam &param, uint32_t fetch_size, std::vector<float> &&scores,
+                              const std::vector<faiss::idx_t> &ids, SearchResult *result) {
+  uint32_t topk = param.topk;
+  uint32_t result_size = param.query_size * topk;
   result->labels.reserve(result_size);
-  for (const auto& id : ids) {
-    result->labels.push_back(this->labels_[id]);
+  if (fetch_size == topk) {
+    result->scores = std::move(scores);
+    for (const auto& id : ids) {
+      result->labels.emplace_back(this->labels_.Get(id));
+    }
+  } else {
+    float empty_score = EmptyScore(indexes_[param.index_type].get());
+    result->scores.reserve(result_size);
+    for (uint32_t i = 0; i < param.query_size; ++i) {
+      uint32_t count = 0;
+      for (uint32_t j = i * fetch_size; j < (i + 1) * fetch_size && count < topk; ++j) {
+        if (ids[j] >= 0 && updatable_ && deleted_.Test(ids[j])) {
+          continue;
+        }
+        result->labels.emplace_back(this->labels_.Get(ids[j]));
+        result->scores.push_back(scores[j]);
+        ++count;
+      }
+      // 与faiss结果不足时一致
+      for (; count < topk; ++count) {
+        result->labels.emplace_back();
+        result->scores.push_back(empty_score);
+      }
+    }
   }
 
   result->batch_size = param.query_size;
   result->size_per_batch = param.topk;
+}
+bool IndexWrapper::CanRefine() const {
+  return vectors_.Size() > 0 || dynamic_cast<const faiss::IndexFlat*>(indexes_[proto::Constants::DEFAULT].get()) != nullptr;
+}
+const float *IndexWrapper::RawVector(faiss::idx_t id, float *buffer) const {
+  if (id < vectors_.Size()) {
+    if (vectors_.Matrix() != nullptr) {
+      return vectors_.Matrix() + id * vectors_.Dim();
+    }
+    vectors_.Decode(id, 1, buffer);
+    return buffer;
+  }
+  if (vectors_.Size() > 0) {
+    // vectors.vec之后的id都是增量追加的
+    if (!updatable_ || id < base_size_ || (id - base_size_ + 1) * dim_ > appended_vecs_.size()) {
+      return nullptr;
+    }
+    return appended_vecs_.data() + (id - base_size_) * dim_;
+  }
+  auto* flat = dynamic_cast<const faiss::IndexFlat*>(indexes_[proto::Constants::DEFAULT].get());
+  if (flat == nullptr || id >= flat->ntotal) {
+    return nullptr;
+  }
+  return flat->get_xb() + id * flat->d;
+}
+void IndexWrapper::Refine(const faiss::Index *index, const SearchParam &param, uint32_t fetch_size, float *scores, faiss::idx_t *ids) {
+  bool inner_product = index->metric_type == faiss::METRIC_INNER_PRODUCT;
+  float empty_score = EmptyScore(index);
+  size_t dim = index->d;
+  std::vector<float> buffer(dim);
+  std::vector<std::pair<float, faiss::idx_t>> distances;
+  distances.reserve(fetch_size);
+  for (uint32_t i = 0; i < param.query_size; ++i) {
+    const float* query = param.vec + i * dim;
+    float* row_scores = scores + i * fetch_size;
+    faiss::idx_t* row_ids = ids + i * fetch_size;
+    distances.clear();
+    for (uint32_t j = 0; j < fetch_size; ++j) {
+      if (row_ids[j] < 0 || (updatable_ && deleted_.Test(row_ids[j]))) {
+        continue;
+      }
+      const float* vec = RawVector(row_ids[j], buffer.data());
+      if (vec == nullptr) {
+        continue;
+      }
+      // 内积越大越相似, 取负后统一按升序
+      float distance = inner_product ? -faiss::fvec_inner_product(query, vec, dim) : faiss::fvec_L2sqr(query, vec, dim);
+      distances.emplace_back(distance, row_ids[j]);
+    }
+    std::sort(distances.begin(), distances.end());
+    for (uint32_t j = 0; j < fetch_size; ++j) {
+      if (j < distances.size()) {
+        row_scores[j] = inner_product ? -distances[j].first : distances[j].first;
+        row_ids[j] = distances[j].second;
+      } else {
+        row_scores[j] = empty_score;
+        row_ids[j] = -1;
+      }
+    }
+  }
+}
+SearchStatus IndexWrapper::SearchFiltered(const faiss::Index *index, const SearchParam &param, SearchResult *result) {
+  bool refine = param.refine_factor > 1;
+  if (refine && !CanRefine()) {
+    return SearchStatus::REFINE_NOT_SUPPORTED;
+  }
+  const faiss::Index* origin_index = index;
+  Bitmap bitmap = attributes_.Compile(*param.filter, labels_.Size());
+  if (updatable_) {
+    bitmap.AndNot(deleted_);
+  }
+  size_t count = bitmap.Count();
+
+  uint32_t fetch_size = param.topk;
+  std::vector<faiss::idx_t> ids(param.query_size * fetch_size, -1);
+  std::vector<float> scores(param.query_size * fetch_size, EmptyScore(index));
+  bool has_flat = dynamic_cast<const faiss::IndexFlat*>(indexes_[proto::Constants::DEFAULT].get()) != nullptr;
+  try {
+    if (count == 0) {
+      // 没有满足条件的向量
+    } else if (has_flat && (count <= brute_force_size_ || !SupportsSelector(index))) {
+      BruteForce(bitmap, param, scores.data(), ids.data());
+    } else if (SupportsSelector(index)) {
+      // 暴力计算已是精确距离, 只有走索引时才精排
+      if (refine) {
+        fetch_size = param.topk * param.refine_factor;
+        ids.assign(param.query_size * fetch_size, -1);
+        scores.assign(param.query_size * fetch_size, EmptyScore(index));
+      }
+      faiss::IDSelectorBitmap selector(bitmap.ByteSize(), bitmap.Data());
+      const float* vec = param.vec;
+      std::unique_ptr<const float[]> transformed;
+      if (auto* pre_transform = dynamic_cast<const faiss::IndexPreTransform*>(index)) {
+        vec = pre_transform->apply_chain(param.query_size, param.vec);
+        if (vec != param.vec) {
+          transformed.reset(vec);
+        }
+        index = pre_transform->index;
+      }
+      if (auto* ivf = dynamic_cast<const faiss::IndexIVF*>(index)) {
+        faiss::SearchParametersIVF ivf_params;
+        ivf_params.sel = &selector;
+        FillIvfParams(ivf, param, &ivf_params);
+        ivf->search(param.query_size, vec, fetch_size, scores.data(), ids.data(), &ivf_params);
+      } else {
+        faiss::SearchParameters search_params;
+        search_params.sel = &selector;
+        index->search(param.query_size, vec, fetch_size, scores.data(), ids.data(), &search_params);
+      }
+      if (refine) {
+        Refine(origin_index, param, fetch_size, scores.data(), ids.data());
+      }
+    } else {
+      return SearchStatus::FILTER_NOT_SUPPORTED;
+    }
+  } catch (std::exception& e) {
+    LOG(WARNING) << "filtered search error: " << e.what();
+    return SearchStatus::FAISS_ERROR;
+  }
+
+  FillResult(param, fetch_size, std::move(scores), ids, result);
   return SearchStatus::OK;
 }
-bool IndexWrapper::LoadIds(const std::string &path) {
-  std::ifstream reader{path};
-  if (!reader.is_open()) {
-    LOG(WARNING) << path << " not found";
-    return false;
+void IndexWrapper::BruteForce(const Bitmap &bitmap, const SearchParam &param, float *scores, faiss::idx_t *ids) {
+  const auto& flat = dynamic_cast<const faiss::IndexFlat&>(*indexes_[proto::Constants::DEFAULT]);
+  std::vector<faiss::idx_t> candidates;
+  for (size_t byte = 0; byte < bitmap.ByteSize(); ++byte) {
+    if (bitmap.Data()[byte] == 0) {
+      continue;
+    }
+    for (size_t id = byte << 3; id < std::min<size_t>((byte + 1) << 3, flat.ntotal); ++id) {
+      if (bitmap.Test(id)) {
+        candidates.push_back(id);
+      }
+    }
   }
-  std::string line;
-  while (std::getline(reader, line)) {
-    labels_.push_back(std::move(line));
+  bool inner_product = flat.metric_type == faiss::METRIC_INNER_PRODUCT;
+  std::vector<std::pair<float, faiss::idx_t>> distances(candidates.size());
+  size_t topk = std::min<size_t>(param.topk, candidates.size());
+  for (uint32_t i = 0; i < param.query_size; ++i) {
+    const float* query = param.vec + i * flat.d;
+    for (size_t j = 0; j < candidates.size(); ++j) {
+      const float* vec = flat.get_xb() + candidates[j] * flat.d;
+      // 内积越大越相似, 取负后统一按升序
+      float distance = inner_product ? -faiss::fvec_inner_product(query, vec, flat.d) : faiss::fvec_L2sqr(query, vec, flat.d);
+      distances[j] = {distance, candidates[j]};
+    }
+    std::partial_sort(distances.begin(), distances.begin() + topk, distances.end());
+    for (size_t j = 0; j < topk; ++j) {
+      scores[i * param.topk + j] = inner_product ? -distances[j].first : distances[j].first;
+      ids[i * param.topk + j] = distances[j].second;
+    }
   }
-  return true;
 }
-bool IndexWrapper::LoadFaiss(const std::string &path) {
+bool IndexWrapper::LoadFaiss(const std::string &path, const proto::ModelConfig& config) {
   using proto::Constants;
   std::unordered_map<std::string, Constants::IndexType> file_to_types;
   for (int i=Constants::IndexType_MIN; i< Constants::IndexType_ARRAYSIZE; ++i) {
@@ -100,19 +392,59 @@ bool IndexWrapper::LoadFaiss(const std::string &path) {
     }
     faiss::Index* index = nullptr;
     try {
-      index = faiss::read_index(file.path().c_str());
+      // 非IVF索引会忽略IO_FLAG_MMAP, 仍读入堆内存
+      // 映射的倒排表只读, 可更新的模型不使用mmap
+      bool mmap = config.mmap() && !config.updatable();
+      index = faiss::read_index(file.path().c_str(), mmap ? faiss::IO_FLAG_MMAP : 0);
     } catch (std::exception& e) {
       LOG(WARNING) << "load faiss index error: " << e.what();
       return false;
     }
-    if (index == nullptr || index->ntotal != this->labels_.size()) {
+    if (index == nullptr || index->ntotal != this->labels_.Size()) {
+      delete index;
       continue;
     }
     this->indexes_[it->second].reset(index);
+    if (config.latency_target_us() > 0) {
+      ApplyOperatingPoint(path, it->second, config.latency_target_us());
+    }
   }
   return true;
 }
-IndexWrapper::IndexWrapper(): indexes_(proto::Constants::IndexType_ARRAYSIZE) {
+void IndexWrapper::ApplyOperatingPoint(const std::string &path, proto::Constants::IndexType index_type, uint32_t latency_target_us) {
+  std::string tune_file = absl::StrCat(path, "/", GetTuneFileName(index_type));
+  boost::system::error_code ec;
+  if (!boost::filesystem::is_regular_file(tune_file, ec)) {
+    return;
+  }
+  proto::TuneResult tune_result;
+  if (!ConfigLoader::LoadPb(tune_file, &tune_result) || tune_result.points().empty()) {
+    return;
+  }
+  // 没有满足目标的点时取最快的
+  const proto::OperatingPoint* chosen = nullptr;
+  const proto::OperatingPoint* fastest = nullptr;
+  for (const auto& point : tune_result.points()) {
+    if (point.latency_us() <= latency_target_us && (chosen == nullptr || point.recall() > chosen->recall())) {
+      chosen = &point;
+    }
+    if (fastest == nullptr || point.latency_us() < fastest->latency_us()) {
+      fastest = &point;
+    }
+  }
+  if (chosen == nullptr) {
+    chosen = fastest;
+  }
+  try {
+    faiss::ParameterSpace().set_index_parameters(indexes_[index_type].get(), chosen->key().c_str());
+  } catch (std::exception& e) {
+    LOG(WARNING) << "set " << chosen->key() << " error: " << e.what();
+    return;
+  }
+  LOG(INFO) << proto::Constants::IndexType_Name(index_type) << " use operating point " << chosen->ShortDebugString()
+    << " for latency target " << latency_target_us << "us";
+}
+IndexWrapper::IndexWrapper(): indexes_(proto::Constants::IndexType_ARRAYSIZE), deleted_in_index_(proto::Constants::IndexType_ARRAYSIZE, 0) {
 
 }
 bool IndexWrapper::Status(std::vector<std::tuple<proto::Constants::IndexType, uint64_t, uint64_t>> *status) {
@@ -133,3 +465,190 @@ bool IndexWrapper::Status(std::vector<std::tuple<proto::Constants::IndexType, ui
   }
   return true;
 }
+bool IndexWrapper::InitUpdate(const std::string &path, const proto::ModelConfig &config) {
+  for (const auto& index : indexes_) {
+    if (index != nullptr) {
+      dim_ = index->d;
+      break;
+    }
+  }
+  if (dim_ == 0) {
+    LOG(WARNING) << path << " has no index to update";
+    return false;
+  }
+  updatable_ = true;
+  compact_threshold_ = config.compact_threshold();
+  base_size_ = labels_.Size();
+  deleted_.Resize(base_size_);
+  label_ids_.reserve(base_size_);
+  for (size_t id = 0; id < base_size_; ++id) {
+    label_ids_[std::string(labels_.Get(id))] = id;
+  }
+  return delta_log_.Open(absl::StrCat(path, "/", kDeltaLogName), [this](const proto::UpdateRequest& request) {
+    uint32_t upserted{0};
+    Apply(request, &upserted);
+  });
+}
+
+SearchStatus IndexWrapper::Update(const proto::UpdateRequest &request, uint32_t *upserted, uint32_t *deleted) {
+  // updatable_和dim_只在Init时设置; 写日志时不阻塞检索
+  std::lock_guard update_lock(update_mutex_);
+  if (!updatable_) {
+    return SearchStatus::UPDATE_DISABLED;
+  }
+  for (const auto& item : request.upserts()) {
+    if (item.vec_size() != dim_) {
+      return SearchStatus::DIM_ERROR;
+    }
+  }
+  if (!delta_log_.Append(request)) {
+    return SearchStatus::IO_ERROR;
+  }
+  std::unique_lock lock(mutex_);
+  *upserted = 0;
+  *deleted = Apply(request, upserted);
+  return *upserted == request.upserts_size() ? SearchStatus::OK : SearchStatus::FAISS_ERROR;
+}
+
+uint32_t IndexWrapper::Apply(const proto::UpdateRequest &request, uint32_t *upserted) {
+  uint32_t deleted{0};
+  for (const auto& label : request.deletes()) {
+    deleted += Remove(label);
+  }
+  for (const auto& item : request.upserts()) {
+    if (item.vec_size() != dim_) {
+      continue;
+    }
+    Remove(item.label());
+    *upserted += Add(item);
+  }
+  pending_ops_ += request.deletes_size() + request.upserts_size();
+  return deleted;
+}
+
+bool IndexWrapper::Remove(const std::string &label) {
+  auto it = label_ids_.find(label);
+  if (it == label_ids_.end()) {
+    return false;
+  }
+  deleted_.Set(it->second);
+  for (size_t i = 0; i < indexes_.size(); ++i) {
+    if (indexes_[i] != nullptr) {
+      ++deleted_in_index_[i];
+    }
+  }
+  label_ids_.erase(it);
+  return true;
+}
+
+bool IndexWrapper::Add(const proto::UpdateItem& item) {
+  const float* vec = item.vec().data();
+  faiss::idx_t id = labels_.Size();
+  for (size_t i = 0; i < indexes_.size(); ++i) {
+    auto& index = indexes_[i];
+    if (index == nullptr) {
+      continue;
+    }
+    // IVF索引保存id, 物理删除后ntotal小于id; 其他索引的id是插入顺序, 不做物理删除
+    try {
+      if (IsIvf(index.get())) {
+        index->add_with_ids(1, vec, &id);
+      } else if (index->ntotal == id) {
+        index->add(1, vec);
+      } else {
+        throw std::runtime_error(absl::StrCat("ntotal ", index->ntotal, " mismatch id ", id));
+      }
+    } catch (std::exception& e) {
+      // 与其他索引的id不再一致, 下线该索引
+      LOG(ERROR) << "add to " << proto::Constants::IndexType_Name(static_cast<proto::Constants::IndexType>(i))
+        << " error, disable it: " << e.what();
+      index.reset();
+    }
+  }
+  labels_.Append(item.label());
+  attributes_.Add(id, item.attrs());
+  deleted_.Resize(id + 1);
+  appended_vecs_.insert(appended_vecs_.end(), vec, vec + dim_);
+  label_ids_[item.label()] = id;
+  return true;
+}
+
+void IndexWrapper::Compact() {
+  // 持有update_mutex_时没有其他写者, 之后只在替换索引时独占mutex_
+  std::lock_guard update_lock(update_mutex_);
+  if (!updatable_ || compact_threshold_ == 0 || pending_ops_ < compact_threshold_) {
+    return;
+  }
+  Timer timer;
+  std::vector<faiss::idx_t> deleted_ids;
+  // 日志只保留仍有效的追加向量和被删除的基础label
+  proto::UpdateRequest snapshot;
+  std::vector<std::unique_ptr<faiss::Index>> compacted(indexes_.size());
+  {
+    std::shared_lock lock(mutex_);
+    for (size_t id = 0; id < deleted_.Size(); ++id) {
+      if (deleted_.Test(id)) {
+        deleted_ids.push_back(id);
+      }
+    }
+    auto appended_attrs = attributes_.Get(base_size_, deleted_.Size());
+    for (size_t id = 0; id < deleted_.Size(); ++id) {
+      if (id < base_size_ && deleted_.Test(id)) {
+        snapshot.add_deletes(std::string(labels_.Get(id)));
+      } else if (id >= base_size_ && !deleted_.Test(id)) {
+        auto* item = snapshot.add_upserts();
+        item->set_label(std::string(labels_.Get(id)));
+        const float* vec = appended_vecs_.data() + (id - base_size_) * dim_;
+        item->mutable_vec()->Add(vec, vec + dim_);
+        for (auto& attr : appended_attrs[id - base_size_]) {
+          *item->add_attrs() = std::move(attr);
+        }
+      }
+    }
+    // 副本上删除, 检索继续使用原索引; 压缩时内存峰值多一份IVF索引
+    for (size_t i = 0; i < indexes_.size(); ++i) {
+      auto& index = indexes_[i];
+      if (index == nullptr || deleted_in_index_[i] == 0 || !IsIvf(index.get())) {
+        continue;
+      }
+      try {
+        compacted[i].reset(faiss::clone_index(index.get()));
+      } catch (std::exception& e) {
+        LOG(WARNING) << "clone index error: " << e.what();
+      }
+    }
+  }
+
+  faiss::IDSelectorBatch selector(deleted_ids.size(), deleted_ids.data());
+  for (auto& index : compacted) {
+    if (index == nullptr) {
+      continue;
+    }
+    try {
+      index->remove_ids(selector);
+    } catch (std::exception& e) {
+      LOG(WARNING) << "remove ids error: " << e.what();
+      index.reset();
+    }
+  }
+  bool rewritten = delta_log_.Rewrite(snapshot);
+
+  uint64_t pending_ops = pending_ops_;
+  {
+    std::unique_lock lock(mutex_);
+    for (size_t i = 0; i < compacted.size(); ++i) {
+      if (compacted[i] != nullptr) {
+        indexes_[i] = std::move(compacted[i]);
+        deleted_in_index_[i] = 0;
+      }
+    }
+    if (rewritten) {
+      pending_ops_ = 0;
+    }
+  }
+  if (!rewritten) {
+    return;
+  }
+  LOG(INFO) << "compact " << pending_ops << " updates, deleted: " << deleted_ids.size() << ", upserts: "
+    << snapshot.upserts_size() << ", cost: " << timer.MsCost() << "ms";
+}
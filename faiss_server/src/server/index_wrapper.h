@@ -1,28 +1,97 @@
 #pragma once
 
 #include <string>
+#include <mutex>
 #include <vector>
+#include <shared_mutex>
+#include <unordered_map>
 #include <faiss/Index.h>
 
 #include "server/search_param.h"
+#include "server/delta_log.h"
+#include "common/constants.h"
+#include "common/label_store.h"
+#include "common/attribute_index.h"
+#include "common/bitmap.h"
+#include "common/vector_file.h"
 #include "index_constants.pb.h"
+#include "server_config.pb.h"
+#include "service.pb.h"
 
 class IndexWrapper {
  public:
   IndexWrapper();
 
-  bool Init(const std::string& path);
+  // config.mmap为true时IVF类索引的倒排表直接映射索引文件, 不读入堆内存
+  bool Init(const std::string& path, const proto::ModelConfig& config);
 
   SearchStatus Search(const SearchParam& param, SearchResult* result);
 
+  // 先写delta log再更新所有索引, 新向量分配新id, 旧id标记删除
+  SearchStatus Update(const proto::UpdateRequest& request, uint32_t* upserted, uint32_t* deleted);
+
+  // 累计更新数达到阈值时从IVF索引中物理删除向量, 并把日志压缩为当前有效数据
+  // 在索引副本上删除, 写完日志后替换, 期间检索不受阻塞
+  void Compact();
+
   bool Status(std::vector<std::tuple<proto::Constants::IndexType, uint64_t, uint64_t>>* status);
 
  private:
-  bool LoadIds(const std::string& path);
+  bool LoadFaiss(const std::string& path, const proto::ModelConfig& config);
+
+  // 从调参结果中选取耗时不超过目标且recall最高的参数设置到索引上
+  void ApplyOperatingPoint(const std::string& path, proto::Constants::IndexType index_type, uint32_t latency_target_us);
+
+  bool InitUpdate(const std::string& path, const proto::ModelConfig& config);
+
+  // 返回删除的数量
+  uint32_t Apply(const proto::UpdateRequest& request, uint32_t* upserted);
+
+  bool Remove(const std::string& label);
 
-  bool LoadFaiss(const std::string& path);
+  bool Add(const proto::UpdateItem& item);
+
+  // 过滤后的bitmap作为IDSelector传给faiss, 剩余很少时在Flat索引上暴力计算
+  SearchStatus SearchFiltered(const faiss::Index* index, const SearchParam& param, SearchResult* result);
+
+  void BruteForce(const Bitmap& bitmap, const SearchParam& param, float* scores, faiss::idx_t* ids);
+
+  // 原始向量依次取vectors.vec, 增量追加的向量, DEFAULT(Flat)索引
+  bool CanRefine() const;
+  // float16时解码到buffer, 找不到时返回nullptr
+  const float* RawVector(faiss::idx_t id, float* buffer) const;
+  // 每行fetch_size个候选按精确距离重排, 无效和已删除的候选移到行尾
+  void Refine(const faiss::Index* index, const SearchParam& param, uint32_t fetch_size, float* scores, faiss::idx_t* ids);
+
+  // 某一行去掉已删除的id后不足need个, 且该行没有取尽索引中的候选
+  bool NeedMoreCandidates(const std::vector<faiss::idx_t>& ids, uint32_t query_size, uint32_t fetch_size, uint32_t need) const;
+
+  // 每行fetch_size个结果去掉已删除的id后截断为topk
+  void FillResult(const SearchParam& param, uint32_t fetch_size, std::vector<float>&& scores,
+                  const std::vector<faiss::idx_t>& ids, SearchResult* result);
 
  private:
-  std::vector<std::string> labels_;
+  // 检索共享, 修改内存中的索引和状态时独占
+  std::shared_mutex mutex_;
+  // 更新和压缩之间互斥, 写日志和压缩索引时只持有此锁
+  std::mutex update_mutex_;
+  LabelStore labels_;
+  AttributeIndex attributes_;
+  VectorFile vectors_;
   std::vector<std::unique_ptr<faiss::Index>> indexes_;
+  uint32_t brute_force_size_{kDefaultBruteForceSize};
+
+  bool updatable_{false};
+  uint32_t dim_{0};
+  uint32_t compact_threshold_{0};
+  uint64_t pending_ops_{0};
+  size_t base_size_{0};
+  DeltaLog delta_log_;
+  std::unordered_map<std::string, int64_t> label_ids_;
+  // 被删除或覆盖的id, id不复用
+  Bitmap deleted_;
+  // 每个索引中仍存在的已删除向量数, 检索时多取并过滤
+  std::vector<uint64_t> deleted_in_index_;
+  // 追加向量的原始数据, 压缩日志时写回
+  std::vector<float> appended_vecs_;
 };
@@ -0,0 +1,118 @@
+#include "server/search_batcher.h"
+
+#include <map>
+#include <tuple>
+#include <algorithm>
+
+#include "index_constants.pb.h"
+
+SearchBatcher::SearchBatcher(const proto::SearchBatchConfig &config, SearchFunc search_func)
+  : window_(config.window_us()), max_batch_size_(config.max_batch_size()), search_func_(std::move(search_func)) {
+  size_t group_size = proto::Constants::ModelName_ARRAYSIZE * proto::Constants::IndexType_ARRAYSIZE;
+  for (size_t i = 0; i < group_size; ++i) {
+    groups_.push_back(std::make_unique<Group>());
+  }
+}
+
+bool SearchBatcher::Accept(const SearchParam &param) const {
+  if (!proto::Constants::ModelName_IsValid(param.model_name) || !proto::Constants::IndexType_IsValid(param.index_type)) {
+    return false;
+  }
+  // 过滤条件各不相同, 不合并
+  return param.filter == nullptr && window_.count() > 0 && param.query_size > 0 && param.query_size <= max_batch_size_ && param.topk > 0;
+}
+
+SearchStatus SearchBatcher::Search(const SearchParam &param, SearchResult *result) {
+  auto& group = *groups_[param.model_name * proto::Constants::IndexType_ARRAYSIZE + param.index_type];
+  Task task{&param, result};
+
+  std::unique_lock lock(group.mutex);
+  bool leader = group.tasks.empty();
+  group.tasks.push_back(&task);
+  group.query_size += param.query_size;
+  if (!leader) {
+    if (group.query_size >= max_batch_size_) {
+      group.cond.notify_all();
+    }
+    group.cond.wait(lock, [&task]() { return task.done; });
+    return task.status;
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + window_;
+  group.cond.wait_until(lock, deadline, [&group, this]() { return group.query_size >= max_batch_size_; });
+  std::vector<Task*> tasks;
+  tasks.swap(group.tasks);
+  group.query_size = 0;
+  lock.unlock();
+
+  Run(tasks);
+
+  lock.lock();
+  for (auto* item : tasks) {
+    item->done = true;
+  }
+  group.cond.notify_all();
+  return task.status;
+}
+
+void SearchBatcher::Run(const std::vector<Task*> &tasks) {
+  // 维度或检索参数不同的请求不能拼接, 分开检索, 维度与索引不符时由检索返回DIM_ERROR
+  std::map<std::tuple<uint32_t, uint32_t, uint32_t, uint32_t>, std::vector<Task*>> sub_tasks;
+  for (auto* task : tasks) {
+    const auto& param = *task->param;
+    if (param.vec_size % param.query_size != 0) {
+      task->status = SearchStatus::DIM_ERROR;
+      continue;
+    }
+    sub_tasks[{param.vec_size / param.query_size, param.nprobe, param.max_codes, param.refine_factor}].push_back(task);
+  }
+  for (const auto& entry : sub_tasks) {
+    RunMerged(entry.second);
+  }
+}
+
+void SearchBatcher::RunMerged(const std::vector<Task*> &tasks) {
+  if (tasks.size() == 1) {
+    tasks[0]->status = search_func_(*tasks[0]->param, tasks[0]->result);
+    return;
+  }
+
+  SearchParam merged = *tasks[0]->param;
+  merged.query_size = 0;
+  merged.topk = 0;
+  std::vector<float> matrix;
+  for (auto* task : tasks) {
+    const auto& param = *task->param;
+    merged.query_size += param.query_size;
+    merged.topk = std::max(merged.topk, param.topk);
+    matrix.insert(matrix.end(), param.vec, param.vec + param.vec_size);
+  }
+  merged.vec = matrix.data();
+  merged.vec_size = matrix.size();
+
+  SearchResult result{};
+  auto status = search_func_(merged, &result);
+
+  // faiss结果按距离排序, 取前topk列与单独检索一致
+  uint32_t row = 0;
+  for (auto* task : tasks) {
+    const auto& param = *task->param;
+    task->status = status;
+    if (status == SearchStatus::OK) {
+      auto* task_result = task->result;
+      task_result->batch_size = param.query_size;
+      task_result->size_per_batch = param.topk;
+      task_result->version = result.version;
+      task_result->labels.reserve(param.query_size * param.topk);
+      task_result->scores.reserve(param.query_size * param.topk);
+      for (uint32_t i = 0; i < param.query_size; ++i) {
+        uint32_t begin = (row + i) * merged.topk;
+        for (uint32_t j = 0; j < param.topk; ++j) {
+          task_result->labels.push_back(std::move(result.labels[begin + j]));
+          task_result->scores.push_back(result.scores[begin + j]);
+        }
+      }
+    }
+    row += param.query_size;
+  }
+}
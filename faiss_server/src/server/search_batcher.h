@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include <boost/noncopyable.hpp>
+#include "server_config.pb.h"
+
+#include "server/search_param.h"
+
+// 合并并发的小查询: 同一模型和索引类型在时间窗口内到达的查询拼成一个矩阵调用一次search, 再按请求拆分结果
+// 第一个到达的请求作为leader等待窗口结束并执行检索, 其余请求等待结果; leader取走请求后新到的请求开始下一批
+class SearchBatcher : public boost::noncopyable {
+ public:
+  using SearchFunc = std::function<SearchStatus(const SearchParam&, SearchResult*)>;
+
+  SearchBatcher(const proto::SearchBatchConfig& config, SearchFunc search_func);
+
+  // query过大或配置关闭时不合并
+  bool Accept(const SearchParam& param) const;
+
+  SearchStatus Search(const SearchParam& param, SearchResult* result);
+
+ private:
+  struct Task {
+    const SearchParam* param;
+    SearchResult* result;
+    SearchStatus status{SearchStatus::OK};
+    bool done{false};
+  };
+
+  struct Group {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<Task*> tasks;
+    uint32_t query_size{0};
+  };
+
+  void Run(const std::vector<Task*>& tasks);
+
+  void RunMerged(const std::vector<Task*>& tasks);
+
+ private:
+  const std::chrono::microseconds window_;
+  const uint32_t max_batch_size_;
+  SearchFunc search_func_;
+  // 按<模型, 索引类型>分组
+  std::vector<std::unique_ptr<Group>> groups_;
+};
@@ -7,6 +7,11 @@ std::string ToString(SearchStatus status) {
     case SearchStatus::INDEX_NOT_FOUND: return "index not found";
     case SearchStatus::DIM_ERROR: return "dim error";
     case SearchStatus::FAISS_ERROR: return "faiss error";
+    case SearchStatus::UPDATE_DISABLED: return "update disabled";
+    case SearchStatus::IO_ERROR: return "io error";
+    case SearchStatus::FILTER_NOT_SUPPORTED: return "filter not supported";
+    case SearchStatus::REFINE_NOT_SUPPORTED: return "refine not supported";
+    case SearchStatus::REFINE_FACTOR_ERROR: return "refine factor error";
     default: return "";
   }
 }
@@ -5,6 +5,9 @@
 #include <string>
 
 #include "index_constants.pb.h"
+#include "service.pb.h"
+
+constexpr uint32_t kMaxRefineFactor = 16;
 
 struct SearchParam {
   proto::Constants::ModelName model_name;
@@ -13,6 +16,13 @@ struct SearchParam {
   uint32_t topk;
   uint32_t vec_size;
   const float* vec;
+  // 仅对IVF类索引生效, 0表示使用索引当前参数
+  uint32_t nprobe;
+  uint32_t max_codes;
+  // 大于1时多取候选并用原始向量精排, 最大为kMaxRefineFactor
+  uint32_t refine_factor;
+  // 属性过滤, 为空时不过滤
+  const proto::Filter* filter;
 };
 struct SearchResult {
   uint32_t batch_size;
@@ -28,6 +38,11 @@ enum class SearchStatus {
   INDEX_NOT_FOUND,
   DIM_ERROR,
   FAISS_ERROR,
+  UPDATE_DISABLED,
+  IO_ERROR,
+  FILTER_NOT_SUPPORTED,
+  REFINE_NOT_SUPPORTED,
+  REFINE_FACTOR_ERROR,
 };
 
 std::string ToString(SearchStatus status);
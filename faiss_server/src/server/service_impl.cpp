@@ -7,21 +7,44 @@
 #include "server/search_param.h"
 #include "common/timer.h"
 
+namespace {
+
+// 模型不可更新和参数超限属于调用方的问题, 其他错误按服务内部错误返回
+grpc::Status ToGrpcStatus(SearchStatus status) {
+  switch (status) {
+    case SearchStatus::OK:
+      return grpc::Status::OK;
+    case SearchStatus::UPDATE_DISABLED:
+      return {grpc::FAILED_PRECONDITION, ToString(status)};
+    case SearchStatus::REFINE_FACTOR_ERROR:
+      return {grpc::INVALID_ARGUMENT, ToString(status)};
+    default:
+      return {grpc::INTERNAL, ToString(status)};
+  }
+}
+
+}  // namespace
+
 grpc::Status ServiceImpl::Retrieval(::grpc::ServerContext *context,
                                     const ::proto::RetrievalRequest *request,
                                     ::proto::RetrievalResponse *response) {
   SearchParam param{};
   param.model_name = request->model_name();
+  param.index_type = request->index_type();
   param.topk = request->topk();
   param.query_size = request->query_size();
   param.vec = request->query_vec().data();
   param.vec_size = request->query_vec_size();
+  param.nprobe = request->search_params().nprobe();
+  param.max_codes = request->search_params().max_codes();
+  param.refine_factor = request->search_params().refine_factor();
+  param.filter = request->filter().conditions().empty() ? nullptr : &request->filter();
 
   Timer timer;
   SearchResult result{};
   auto status = this->index_manager_->Search(param, &result);
   if (status != SearchStatus::OK) {
-    return {grpc::INTERNAL, ToString(status)};
+    return ToGrpcStatus(status);
   }
   auto recall_cost = timer.UsCost();
 
@@ -40,7 +63,8 @@ grpc::Status ServiceImpl::Retrieval(::grpc::ServerContext *context,
 
   std::string model_name = proto::Constants::ModelName_Name(request->model_name());
 
-  LOG(INFO) << "model: " << model_name << " query_size: " << request->query_size() << "; topk: " << request->topk()
+  LOG(INFO) << "model: " << model_name << " index: " << proto::Constants::IndexType_Name(request->index_type())
+    << " query_size: " << request->query_size() << "; topk: " << request->topk()
     << "; total cost " << res_cost << "us; recall cost " << recall_cost << "us";
 
   return grpc::Status::OK;
@@ -73,6 +97,20 @@ grpc::Status ServiceImpl::Status(::grpc::ServerContext *context,
   return grpc::Status::OK;
 }
 
+grpc::Status ServiceImpl::Update(::grpc::ServerContext *context,
+                                 const ::proto::UpdateRequest *request,
+                                 ::proto::UpdateResponse *response) {
+  Timer timer;
+  auto status = this->index_manager_->Update(*request, response);
+  std::string model_name = proto::Constants::ModelName_Name(request->model_name());
+  LOG(INFO) << "update model: " << model_name << " upserts: " << request->upserts_size() << "; deletes: "
+    << request->deletes_size() << "; status: " << ToString(status) << "; cost " << timer.UsCost() << "us";
+  if (status != SearchStatus::OK) {
+    return ToGrpcStatus(status);
+  }
+  return grpc::Status::OK;
+}
+
 ServiceImpl::ServiceImpl(IndexManager *index_manager) : index_manager_{index_manager} {
 
 }
@@ -16,6 +16,9 @@ class ServiceImpl : public proto::IndexService::Service {
   grpc::Status Status(::grpc::ServerContext *context,
                       const ::proto::StatusRequest *request,
                       ::proto::StatusResponse *response) override;
+  grpc::Status Update(::grpc::ServerContext *context,
+                      const ::proto::UpdateRequest *request,
+                      ::proto::UpdateResponse *response) override;
  private:
   IndexManager* index_manager_{nullptr};
 };
@@ -6,7 +6,7 @@
 namespace torch::serving {
 
 std::shared_ptr<IServable> BatchFactory::New() {
-  return std::make_shared<BatchServable>(servable_factory_->New(), *scheduler_->AddQueue());
+  return std::make_shared<BatchServable>(servable_factory_->New(), scheduler_);
 }
 BatchFactory::BatchFactory(const std::shared_ptr<ServableFactory>& servable_factory, const std::shared_ptr<SharedBatchScheduler> &scheduler)
     : servable_factory_(servable_factory), scheduler_(scheduler) {
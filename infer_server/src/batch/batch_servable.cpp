@@ -1,4 +1,7 @@
 #include "batch_servable.h"
+
+#include <future>
+
 #include "utils/item_utils.h"
 #include "model/predict_context.h"
 #include "batch/shared_batch_scheduler.h"
@@ -9,40 +12,49 @@ bool BatchServable::Init(const std::string &path) {
   return servable_ != nullptr && servable_queue_ != nullptr && servable_->Init(path);
 }
 PredictStatus BatchServable::Predict(const std::shared_ptr<PredictContext> &predict_context) {
+  std::promise<PredictStatus> promise;
+  auto fu = promise.get_future();
+  PredictAsync(predict_context, [&promise](const PredictStatus& status) {
+    promise.set_value(status);
+  });
+  return fu.get();
+}
+void BatchServable::PredictAsync(const std::shared_ptr<PredictContext> &predict_context, PredictCallback done) {
   if (servable_ == nullptr) {
-    return {PredictStatus::NULLPTR};
+    done({PredictStatus::NULLPTR});
+    return;
   }
   if (servable_queue_ == nullptr) {
-    return servable_->Predict(predict_context);
+    servable_->PredictAsync(predict_context, std::move(done));
+    return;
   }
 
   auto check_status = servable_->Check(predict_context);
   if (!check_status.Ok()) {
-    return check_status;
+    done(check_status);
+    return;
   }
 
   auto task = std::make_shared<BatchTask>();
   task->servable = servable_;
   task->context = predict_context;
   task->size = CountItem(*predict_context->request_);
-  auto fu = task->promise.get_future();
-  servable_queue_->AddTask(task);
-  try {
-    return fu.get();
-  } catch (...) {
-    return {PredictStatus::PREDICT_ERROR};
-  }
+  task->done = std::move(done);
+  scheduler_->Schedule(servable_queue_, task);
 }
 
 const std::string &BatchServable::GetLabel() {
   return servable_->GetLabel();
 }
-BatchServable::BatchServable(const std::shared_ptr<IServable> &servable, const std::shared_ptr<ServableQueue>& servable_queue)
-  : servable_(servable), servable_queue_(servable_queue) {
+BatchServable::BatchServable(const std::shared_ptr<IServable> &servable, const std::shared_ptr<SharedBatchScheduler>& scheduler)
+  : servable_(servable), scheduler_(scheduler), servable_queue_(scheduler != nullptr ? scheduler->AddQueue() : nullptr) {
 
 }
 BatchServable::~BatchServable() {
-  servable_queue_->Stop();
+  // 队列由就绪列表持有, 关闭的批次处理完后释放
+  if (scheduler_ != nullptr) {
+    scheduler_->Flush(servable_queue_);
+  }
 }
 const inference::ModelSpec &BatchServable::GetSpec() {
   return servable_->GetSpec();
@@ -50,6 +62,11 @@ const inference::ModelSpec &BatchServable::GetSpec() {
 PredictStatus BatchServable::PredictWithoutCheck(const std::shared_ptr<PredictContext> &predict_context) {
   return {PredictStatus::OK};
 }
+void BatchServable::Unload() {
+  if (servable_ != nullptr) {
+    servable_->Unload();
+  }
+}
 
 
 }
@@ -9,17 +9,20 @@ class ServableQueue;
 
 class BatchServable : public IServable {
  public:
-  BatchServable(const std::shared_ptr<IServable>& servable, const std::shared_ptr<ServableQueue>& servable_queue);
+  BatchServable(const std::shared_ptr<IServable>& servable, const std::shared_ptr<SharedBatchScheduler>& scheduler);
   bool Init(const std::string &path) override;
   PredictStatus Predict(const std::shared_ptr<PredictContext> &predict_context) override;
+  void PredictAsync(const std::shared_ptr<PredictContext> &predict_context, PredictCallback done) override;
   const std::string &GetLabel() override;
   const inference::ModelSpec &GetSpec() override;
   PredictStatus PredictWithoutCheck(const std::shared_ptr<PredictContext> &predict_context) override;
+  void Unload() override;
 
   ~BatchServable() override;
 
  private:
   std::shared_ptr<IServable> servable_;
+  std::shared_ptr<SharedBatchScheduler> scheduler_;
   std::shared_ptr<ServableQueue> servable_queue_;
 };
 
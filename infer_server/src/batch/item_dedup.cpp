@@ -0,0 +1,309 @@
+#include "item_dedup.h"
+
+#include <cstring>
+#include <tuple>
+
+#include <absl/hash/hash.h>
+#include <absl/types/span.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_join.h>
+#include <absl/strings/string_view.h>
+#include <absl/strings/strip.h>
+
+#include "kserve_predict_v2.pb.h"
+#include "utils/tensor_utils.h"
+
+namespace torch::serving {
+
+namespace {
+
+bool SameOutputs(const std::vector<ItemDeduper::OutputLayout>& left, const std::vector<ItemDeduper::OutputLayout>& right) {
+  if (left.size() != right.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < left.size(); ++i) {
+    if (left[i].name != right[i].name || left[i].datatype != right[i].datatype || left[i].item_shape != right[i].item_shape) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// 输出的连续内存
+absl::string_view OutputBytes(const inference::ModelInferResponse& response, int index) {
+  absl::string_view bytes;
+  DispatchDataType(response.outputs(index).datatype(), [&](auto type) {
+    using T = decltype(type);
+    auto data = OutputData<T>(response, index);
+    bytes = absl::string_view(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(T));
+  });
+  return bytes;
+}
+
+}
+
+ItemDeduper::ItemDeduper(size_t cache_size) : cache_size_(cache_size) {
+  index_.reserve(cache_size_);
+}
+
+void ItemDeduper::Compact(inference::ModelInferRequest* request, Plan* plan) {
+  const int input_num = request->inputs_size();
+  const size_t item_size = input_num > 0 && request->inputs(0).shape_size() > 0 ? request->inputs(0).shape(0) : 0;
+  plan->item_size = item_size;
+  plan->source.assign(item_size, 0);
+  plan->keys.assign(item_size, 0);
+  plan->cached.clear();
+  plan->inputs.clear();
+  plan->layout = nullptr;
+  plan->infer_size = item_size;
+  plan->duplicate = 0;
+  if (item_size == 0 || request->raw_input_contents_size() != input_num) {
+    for (size_t i = 0; i < item_size; ++i) {
+      plan->source[i] = i;
+    }
+    return;
+  }
+
+  // 单个item的输入形状参与哈希, 变长输入在不同批次中补齐的长度不同
+  std::vector<size_t> row_bytes(input_num);
+  size_t seed = absl::HashOf(input_num);
+  // 输入形状的描述, 作为缓存中输入编码的前缀
+  std::string signature;
+  for (int i = 0; i < input_num; ++i) {
+    auto& input = request->inputs(i);
+    row_bytes[i] = request->raw_input_contents(i).size() / item_size;
+    seed = absl::HashOf(seed, absl::string_view(input.name()), static_cast<int>(input.datatype()),
+                        absl::MakeConstSpan(input.shape().data() + 1, input.shape_size() - 1));
+    absl::StrAppend(&signature, input.name(), ":", input.datatype(), ":", absl::StrJoin(input.shape().begin() + 1, input.shape().end(), ","), ";");
+  }
+  auto row = [&](int input, size_t item) {
+    return absl::string_view(request->raw_input_contents(input).data() + item * row_bytes[input], row_bytes[input]);
+  };
+  auto same_input = [&](const std::string& input, size_t item) {
+    absl::string_view rest = input;
+    if (!absl::ConsumePrefix(&rest, signature)) {
+      return false;
+    }
+    for (int i = 0; i < input_num; ++i) {
+      if (!absl::ConsumePrefix(&rest, row(i, item))) {
+        return false;
+      }
+    }
+    return rest.empty();
+  };
+  for (size_t item = 0; item < item_size; ++item) {
+    size_t hash = seed;
+    for (int i = 0; i < input_num; ++i) {
+      hash = absl::HashOf(hash, row(i, item));
+    }
+    // 0表示不缓存
+    plan->keys[item] = hash == 0 ? 1 : hash;
+  }
+
+  // 哈希 -> <结果来源, 首次出现的item>
+  std::unordered_map<uint64_t, std::pair<int64_t, size_t>> seen;
+  seen.reserve(item_size);
+  std::vector<size_t> keep;
+  keep.reserve(item_size);
+  std::unique_lock lock(mutex_, std::defer_lock);
+  if (cache_size_ > 0) {
+    lock.lock();
+    plan->layout = layout_;
+  }
+  for (size_t item = 0; item < item_size; ++item) {
+    auto key = plan->keys[item];
+    auto it = seen.find(key);
+    if (it != seen.end()) {
+      bool equal = true;
+      for (int i = 0; i < input_num && equal; ++i) {
+        equal = row(i, item) == row(i, it->second.second);
+      }
+      if (equal) {
+        plan->source[item] = it->second.first;
+        ++plan->duplicate;
+        continue;
+      }
+      // 哈希冲突, 单独推理且不写入缓存
+      plan->keys[item] = 0;
+      plan->source[item] = keep.size();
+      keep.push_back(item);
+      continue;
+    }
+    if (cache_size_ > 0) {
+      auto cache_it = index_.find(key);
+      // 只在输入完全一致时复用, 哈希冲突的item重新推理并替换缓存
+      if (cache_it != index_.end() && same_input(cache_it->second->input, item)) {
+        lru_.splice(lru_.begin(), lru_, cache_it->second);
+        plan->cached.push_back(cache_it->second->data);
+        plan->source[item] = -static_cast<int64_t>(plan->cached.size());
+        seen.emplace(key, std::make_pair(plan->source[item], item));
+        continue;
+      }
+    }
+    plan->source[item] = keep.size();
+    seen.emplace(key, std::make_pair(plan->source[item], item));
+    keep.push_back(item);
+  }
+  if (lock.owns_lock()) {
+    lock.unlock();
+  }
+
+  plan->infer_size = keep.size();
+  if (cache_size_ > 0) {
+    // 压缩前保存输入编码, 推理后随结果写入缓存
+    plan->inputs.resize(keep.size());
+    for (size_t j = 0; j < keep.size(); ++j) {
+      if (plan->keys[keep[j]] == 0) {
+        continue;
+      }
+      auto& input = plan->inputs[j];
+      input = signature;
+      for (int i = 0; i < input_num; ++i) {
+        auto data = row(i, keep[j]);
+        input.append(data.data(), data.size());
+      }
+    }
+  }
+  if (keep.size() == item_size) {
+    return;
+  }
+  // keep递增且keep[i] >= i, 前移不会覆盖未读取的行
+  for (int i = 0; i < input_num; ++i) {
+    auto* buffer = request->mutable_raw_input_contents(i);
+    for (size_t j = 0; j < keep.size(); ++j) {
+      if (keep[j] != j) {
+        std::memcpy(buffer->data() + j * row_bytes[i], buffer->data() + keep[j] * row_bytes[i], row_bytes[i]);
+      }
+    }
+    buffer->resize(keep.size() * row_bytes[i]);
+    request->mutable_inputs(i)->set_shape(0, keep.size());
+  }
+}
+
+PredictStatus ItemDeduper::Expand(const Plan& plan, const inference::ModelInferResponse& response,
+                                  inference::ModelInferResponse* expanded) {
+  auto layout = plan.layout;
+  std::vector<const char*> infer_data;
+  if (plan.infer_size > 0) {
+    auto infer_layout = std::make_shared<Layout>();
+    infer_layout->model_version = response.model_version();
+    for (int i = 0; i < response.outputs_size(); ++i) {
+      auto& output = response.outputs(i);
+      // 与SplitResponse一致, 没有形状的输出不按item返回
+      if (output.shape_size() == 0) {
+        continue;
+      }
+      if (DataTypeSize(output.datatype()) == 0) {
+        return {PredictStatus::RESULT_TYPE_ERROR, absl::StrCat(output.name(), " can not be deduplicated")};
+      }
+      auto data = OutputBytes(response, i);
+      auto& item_layout = infer_layout->outputs.emplace_back();
+      item_layout.name = output.name();
+      item_layout.datatype = output.datatype();
+      item_layout.item_shape.assign(output.shape().begin() + 1, output.shape().end());
+      item_layout.item_bytes = ShapeSize(item_layout.item_shape.begin(), item_layout.item_shape.end()) * DataTypeSize(output.datatype());
+      if (output.shape(0) < static_cast<int64_t>(plan.infer_size) || data.size() < plan.infer_size * item_layout.item_bytes) {
+        return {PredictStatus::RESULT_SIZE_ERROR, absl::StrCat(output.name(), " has less items than the batch")};
+      }
+      infer_data.push_back(data.data());
+    }
+    if (layout != nullptr && !SameOutputs(layout->outputs, infer_layout->outputs)) {
+      // 模型输出变化, 缓存的结果不再可用, 清空后之后的批次不再命中
+      std::lock_guard lock(mutex_);
+      if (layout_ == layout) {
+        Clear();
+      }
+      return {PredictStatus::RESULT_TYPE_ERROR, "output layout differs from cached items"};
+    }
+    layout = std::move(infer_layout);
+  }
+  if (layout == nullptr) {
+    return {PredictStatus::OK};
+  }
+
+  expanded->set_model_version(layout->model_version);
+  std::vector<size_t> offsets;
+  size_t item_bytes = 0;
+  for (size_t k = 0; k < layout->outputs.size(); ++k) {
+    auto& item_layout = layout->outputs[k];
+    auto* output = expanded->add_outputs();
+    output->set_name(item_layout.name);
+    output->set_datatype(static_cast<inference::DataType>(item_layout.datatype));
+    output->add_shape(plan.item_size);
+    output->mutable_shape()->Add(item_layout.item_shape.begin(), item_layout.item_shape.end());
+    auto* buffer = expanded->add_raw_output_contents();
+    buffer->resize(plan.item_size * item_layout.item_bytes);
+    for (size_t item = 0; item < plan.item_size; ++item) {
+      auto source = plan.source[item];
+      const char* src = source >= 0 ? infer_data[k] + source * item_layout.item_bytes
+          : plan.cached[-1 - source]->data() + item_bytes;
+      std::memcpy(buffer->data() + item * item_layout.item_bytes, src, item_layout.item_bytes);
+    }
+    offsets.push_back(item_bytes);
+    item_bytes += item_layout.item_bytes;
+  }
+
+  if (cache_size_ == 0 || plan.infer_size == 0) {
+    return {PredictStatus::OK};
+  }
+  std::vector<std::tuple<uint64_t, std::string, std::shared_ptr<const std::string>>> items;
+  std::vector<bool> inserted(plan.infer_size, false);
+  for (size_t item = 0; item < plan.item_size; ++item) {
+    auto source = plan.source[item];
+    if (source < 0 || inserted[source] || plan.keys[item] == 0) {
+      continue;
+    }
+    inserted[source] = true;
+    auto data = std::make_shared<std::string>(item_bytes, '\0');
+    for (size_t k = 0; k < layout->outputs.size(); ++k) {
+      auto size = layout->outputs[k].item_bytes;
+      std::memcpy(data->data() + offsets[k], infer_data[k] + source * size, size);
+    }
+    items.emplace_back(plan.keys[item], plan.inputs[source], std::move(data));
+  }
+  std::unique_lock lock(mutex_);
+  if (layout_ != layout && (layout_ == nullptr || !SameOutputs(layout_->outputs, layout->outputs))) {
+    Clear();
+  }
+  layout_ = layout;
+  for (auto& [key, input, data] : items) {
+    Insert(key, std::move(input), std::move(data));
+  }
+  return {PredictStatus::OK};
+}
+
+void ItemDeduper::Insert(uint64_t key, std::string input, std::shared_ptr<const std::string> data) {
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    it->second->input = std::move(input);
+    it->second->data = std::move(data);
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return;
+  }
+  if (lru_.size() >= cache_size_) {
+    index_.erase(lru_.back().key);
+    lru_.pop_back();
+  }
+  lru_.push_front({key, std::move(input), std::move(data)});
+  index_[key] = lru_.begin();
+}
+
+void ItemDeduper::Clear() {
+  lru_.clear();
+  index_.clear();
+  layout_ = nullptr;
+}
+
+void PadRequest(size_t batch_size, inference::ModelInferRequest* request) {
+  for (int i = 0; i < request->inputs_size() && i < request->raw_input_contents_size(); ++i) {
+    auto* input = request->mutable_inputs(i);
+    if (input->shape_size() == 0 || input->shape(0) >= static_cast<int64_t>(batch_size) || input->shape(0) == 0) {
+      continue;
+    }
+    auto* buffer = request->mutable_raw_input_contents(i);
+    buffer->resize(buffer->size() / input->shape(0) * batch_size, '\0');
+    input->set_shape(0, batch_size);
+  }
+}
+
+}
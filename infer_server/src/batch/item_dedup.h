@@ -0,0 +1,86 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "model/predict_status.h"
+
+namespace inference {
+class ModelInferRequest;
+class ModelInferResponse;
+}
+
+namespace torch::serving {
+
+// 合并后的请求按item去重: 只推理不重复且未命中缓存的行, 推理后按原顺序展开结果
+// 同一候选item常出现在多个并发请求中, 去重后推理的item数下降
+class ItemDeduper {
+ public:
+  // cache_size为跨批次缓存的item数, 0表示只在批次内去重
+  explicit ItemDeduper(size_t cache_size);
+
+  // 每个输出中单个item的描述, 缓存的item按输出顺序拼接
+  struct OutputLayout {
+    std::string name;
+    int datatype;
+    std::vector<int64_t> item_shape;
+    size_t item_bytes;
+  };
+  struct Layout {
+    int64_t model_version{0};
+    std::vector<OutputLayout> outputs;
+  };
+
+  struct Plan {
+    // 合并请求的item数
+    size_t item_size{0};
+    // 每个item的结果来源: >=0为推理批次中的行, <0为cached中的第(-1-source)个
+    std::vector<int64_t> source;
+    // 每个item的哈希, 批次内哈希冲突的item不写入缓存, 记为0
+    std::vector<uint64_t> keys;
+    std::vector<std::shared_ptr<const std::string>> cached;
+    // 推理批次中每行的输入编码, 写入缓存后命中时比较; 不使用缓存时为空
+    std::vector<std::string> inputs;
+    std::shared_ptr<const Layout> layout;
+    // 需要推理的item数
+    size_t infer_size{0};
+    size_t duplicate{0};
+  };
+
+  // request为未补齐的合并请求(raw_input_contents); 原地压缩为需要推理的行
+  void Compact(inference::ModelInferRequest* request, Plan* plan);
+
+  // 按item展开推理结果, 写入expanded并更新缓存; 全部命中缓存时response为空
+  PredictStatus Expand(const Plan& plan, const inference::ModelInferResponse& response,
+                       inference::ModelInferResponse* expanded);
+
+ private:
+  struct Entry {
+    uint64_t key;
+    // 输入的形状描述和各输入的行, 哈希相同时比较, 不一致时不复用
+    std::string input;
+    std::shared_ptr<const std::string> data;
+  };
+
+  void Insert(uint64_t key, std::string input, std::shared_ptr<const std::string> data);
+  // 需持有mutex_
+  void Clear();
+
+ private:
+  const size_t cache_size_;
+  std::mutex mutex_;
+  // 头部为最近使用
+  std::list<Entry> lru_;
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+  // 缓存中item的结果格式, 格式变化时清空缓存
+  std::shared_ptr<const Layout> layout_;
+};
+
+// 将合并请求每个输入的第一维补齐到batch_size, 补齐部分为0
+void PadRequest(size_t batch_size, inference::ModelInferRequest* request);
+
+}
@@ -3,6 +3,9 @@
 #include <absl/time/time.h>
 #include <absl/time/clock.h>
 #include <absl/types/span.h>
+#include <absl/strings/str_cat.h>
+#include <glog/logging.h>
+#include <prometheus/counter.h>
 
 #include "batch_config.pb.h"
 #include "model_spec.pb.h"
@@ -11,176 +14,77 @@
 #include "model/predict_context.h"
 #include "servables/servable.h"
 #include "servables/torch_servable.h"
+#include "service/metrics.h"
+#include "utils/tensor_utils.h"
 
 namespace torch::serving {
 
-void MergeRequest(const std::vector<const inference::ModelInferRequest*>& request_list, const inference::ModelSpec& spec, inference::ModelInferRequest* request) {
-  if (request_list.empty()) {
-    return;
+int ServableQueue::AddTask(const BatchTaskPtr &task, BatchTaskGroupPtr* timer_group, absl::Time* close_time) {
+  std::unique_lock lock(mutex_);
+  int closed = 0;
+  // 加入后超过最大批次时先关闭当前批次, 批次大小不超过max_batch_size
+  if (!group_list_.empty() && !group_list_.back()->closed_ && group_list_.back()->item_size_ + task->size > size_windows_) {
+    group_list_.back()->closed_ = true;
+    ++closed;
   }
-  auto& first = request_list[0];
-  request->set_id(first->id());
-  request->set_model_name(first->model_name());
-  std::unordered_map<std::string, std::vector<const inference::ModelInferRequest::InferInputTensor*>> tensor_map;
-  for (const auto& sub_request : request_list) {
-    for (const auto& input : sub_request->inputs()) {
-      tensor_map[input.name()].push_back(&input);
-    }
+  if (task->size > size_windows_) {
+    // 只有单个请求超过最大批次时单独执行, 不补齐, 在批次计数的none中统计
+    LOG_EVERY_N(WARNING, 1000) << "task with " << task->size << " items exceeds max_batch_size " << size_windows_;
   }
-  for (const auto& feature_spec : spec.feature_specs()) {
-    auto* merge_proto = request->add_inputs();
-    auto& proto_list = tensor_map[feature_spec.name()];
-    size_t shape_size = 0;
-    size_t item_size = 0;
-
-    for (const auto& proto : proto_list) {
-      size_t current = 1;
-      for (const auto& dim : proto->shape()) {
-        current *= dim;
-      }
-      shape_size += current;
-      item_size += proto->shape(0);
-    }
-    auto* content = merge_proto->mutable_contents();
-    switch (feature_spec.dtype()) {
-      case inference::DT_FLOAT: {
-        content->mutable_fp32_contents()->Reserve(shape_size);
-        break;
-      }
-      case inference::DT_DOUBLE: {
-        content->mutable_fp64_contents()->Reserve(shape_size);
-        break;
-      }
-      case inference::DT_INT32: {
-        content->mutable_int_contents()->Reserve(shape_size);
-        break;
-      }
-      case inference::DT_UINT32: {
-        content->mutable_uint_contents()->Reserve(shape_size);
-        break;
-      }
-      case inference::DT_INT64: {
-        content->mutable_int64_contents()->Reserve(shape_size);
-        break;
-      }
-      case inference::DT_UINT64: {
-        content->mutable_uint64_contents()->Reserve(shape_size);
-        break;
-      }
-      default: {
-        break;
-      }
-    }
-    for (const auto& proto : proto_list) {
-      auto& sub_content = proto->contents();
-      switch (feature_spec.dtype()) {
-        case inference::DT_FLOAT: {
-          content->mutable_fp32_contents()->Add(sub_content.fp32_contents().begin(), sub_content.fp32_contents().end());
-          break;
-        }
-        case inference::DT_DOUBLE: {
-          content->mutable_fp64_contents()->Add(sub_content.fp64_contents().begin(), sub_content.fp64_contents().end());
-          break;
-        }
-        case inference::DT_INT32: {
-          content->mutable_int_contents()->Add(sub_content.int_contents().begin(), sub_content.int_contents().end());
-          break;
-        }
-        case inference::DT_UINT32: {
-          content->mutable_uint_contents()->Add(sub_content.uint_contents().begin(), sub_content.uint_contents().end());
-          break;
-        }
-        case inference::DT_INT64: {
-          content->mutable_int64_contents()->Add(sub_content.int64_contents().begin(), sub_content.int64_contents().end());
-          break;
-        }
-        case inference::DT_UINT64: {
-          content->mutable_uint64_contents()->Add(sub_content.uint64_contents().begin(), sub_content.uint64_contents().end());
-          break;
-        }
-        default: {
-          break;
-        }
-      }
-    }
-    merge_proto->set_datatype(feature_spec.dtype());
-    merge_proto->add_shape(item_size);
-    merge_proto->mutable_shape()->Add(feature_spec.shape().begin(), feature_spec.shape().end());
+  bool new_timer = false;
+  if (group_list_.empty() || group_list_.back()->closed_) {
+    group_list_.push_back(std::make_shared<BatchTaskGroup>());
+    group_list_.back()->task_list_.reserve(std::min(queue_size_, size_windows_));
+    group_list_.back()->close_time_ = group_list_.back()->begin_ + time_windows_;
+    new_timer = true;
   }
+  auto& group = group_list_.back();
+  group->task_list_.push_back(task);
+  group->item_size_ += task->size;
+  // 截止时间临近的请求提前关闭批次
+  auto deadline = task->context->deadline_ - deadline_margin_;
+  if (deadline < group->close_time_) {
+    group->close_time_ = deadline;
+    new_timer = true;
+  }
+  if (IsGroupFull(group) || group->close_time_ <= absl::Now()) {
+    group->closed_ = true;
+    return closed + 1;
+  }
+  if (new_timer) {
+    *timer_group = group;
+    *close_time = group->close_time_;
+  }
+  return closed;
 }
-
-void SplitResponse(const inference::ModelInferResponse& response, const std::vector<inference::ModelInferResponse*>& response_list, const std::vector<size_t>& item_size_list) {
-  for (const auto& merge_proto : response.outputs()) {
-    if (merge_proto.shape_size() == 0) {
-      continue;
-    }
-
-    size_t shape_per_item = 1;
-    for (int i=1;i<merge_proto.shape_size();++i) {
-      shape_per_item *= merge_proto.shape(i);
-    }
-    size_t data_index = 0;
-    for (size_t i=0; i<response_list.size(); ++i) {
-      auto& sub_response = response_list[i];
-      const auto& item_size = item_size_list[i];
-      auto* proto = sub_response->add_outputs();
-      proto->set_name(merge_proto.name());
-      size_t item_data_size = item_size * shape_per_item;
-      auto& merge_content = merge_proto.contents();
-      auto* sub_content = proto->mutable_contents();
-      switch (merge_proto.datatype()) {
-        case inference::DT_FLOAT: {
-          absl::Span<const float> data(merge_content.fp32_contents().data() + data_index, item_data_size);
-          sub_content->mutable_fp32_contents()->Add(data.begin(), data.end());
-          break;
-        }
-        case inference::DT_DOUBLE: {
-          absl::Span<const double> data(merge_content.fp64_contents().data() + data_index, item_data_size);
-          sub_content->mutable_fp64_contents()->Add(data.begin(), data.end());
-          break;
-        }
-        case inference::DT_INT32: {
-          absl::Span<const int32_t> data(merge_content.int_contents().data() + data_index, item_data_size);
-          sub_content->mutable_int_contents()->Add(data.begin(), data.end());
-          break;
-        }
-        case inference::DT_UINT32: {
-          absl::Span<const uint32_t> data(merge_content.uint_contents().data() + data_index, item_data_size);
-          sub_content->mutable_uint_contents()->Add(data.begin(), data.end());
-          break;
-        }
-        case inference::DT_INT64: {
-          absl::Span<const int64_t> data(merge_content.int64_contents().data() + data_index, item_data_size);
-          sub_content->mutable_int64_contents()->Add(data.begin(), data.end());
-          break;
-        }
-        case inference::DT_UINT64: {
-          absl::Span<const uint64_t> data(merge_content.uint64_contents().data() + data_index, item_data_size);
-          sub_content->mutable_uint64_contents()->Add(data.begin(), data.end());
-          break;
-        }
-        default: {
-          break;
-        }
-      }
-      data_index += item_data_size;
-    }
+bool ServableQueue::CloseGroup(const BatchTaskGroupPtr &group) {
+  std::unique_lock lock(mutex_);
+  if (group == nullptr || group->closed_) {
+    return false;
   }
+  group->closed_ = true;
+  return true;
 }
-
-void ServableQueue::AddTask(const BatchTaskPtr &task) {
+bool ServableQueue::CloseOpenGroup() {
   std::unique_lock lock(mutex_);
-  if (group_list_.empty()) {
-    group_list_.push_back(std::make_shared<BatchTaskGroup>());
-    group_list_.back()->task_list_.reserve(queue_size_);
+  if (group_list_.empty() || group_list_.back()->closed_) {
+    return false;
   }
-  if (IsGroupClose(group_list_.back())) {
-    group_list_.push_back(std::make_shared<BatchTaskGroup>());
-    group_list_.back()->task_list_.reserve(queue_size_);
+  group_list_.back()->closed_ = true;
+  return true;
+}
+void ServableQueue::FailAll(const PredictStatus &status) {
+  std::list<BatchTaskGroupPtr> group_list;
+  {
+    std::unique_lock lock(mutex_);
+    group_list.swap(group_list_);
+  }
+  // 回调可能很慢, 不持有锁
+  for (const auto& group : group_list) {
+    for (const auto& task : group->task_list_) {
+      task->done(status);
+    }
   }
-  auto& group = group_list_.back();
-  group->task_list_.push_back(task);
-  group->item_size_ += task->size;
 }
 BatchTaskGroupPtr ServableQueue::GetTaskGroup() {
   std::unique_lock lock(mutex_);
@@ -188,97 +92,253 @@ BatchTaskGroupPtr ServableQueue::GetTaskGroup() {
     return nullptr;
   }
   auto group = group_list_.front();
-  if (IsGroupClose(group)) {
+  if (group->closed_) {
     group_list_.pop_front();
     return group;
   }
 
   return nullptr;
 }
-bool ServableQueue::IsGroupClose(const BatchTaskGroupPtr &group) const {
+bool ServableQueue::IsGroupFull(const BatchTaskGroupPtr &group) const {
   if (group->task_list_.size() >= queue_size_) {
     return true;
   }
-  if (group->item_size_ > size_windows_) {
-    return true;
+  return group->item_size_ >= size_windows_;
+}
+ServableQueue::ServableQueue(absl::Duration time_windows, absl::Duration deadline_margin, uint32_t size_windows, uint32_t queue_size, size_t arena_size,
+                             std::unique_ptr<ItemDeduper> deduper)
+  : time_windows_(time_windows), deadline_margin_(deadline_margin), size_windows_(size_windows), queue_size_(queue_size), arena_(arena_size),
+    deduper_(std::move(deduper)) {
+
+}
+ServableQueue::~ServableQueue() {
+  FailAll({PredictStatus::UNAVAILABLE, "batch queue stopped"});
+}
+
+void SharedBatchScheduler::Schedule(const ServableQueuePtr &queue, const BatchTaskPtr &task) {
+  BatchTaskGroupPtr timer_group;
+  absl::Time close_time;
+  int ready = queue->AddTask(task, &timer_group, &close_time);
+  if (timer_group != nullptr) {
+    // 注册批次关闭时间, 旧的定时器触发时批次已关闭, 直接忽略
+    std::unique_lock lock(mutex_);
+    bool earliest = timer_list_.empty() || close_time < timer_list_.top().deadline;
+    timer_list_.push({close_time, queue, timer_group});
+    if (earliest) {
+      timer_cv_.notify_one();
+    }
   }
-  if (group->item_size_ == 0) {
-    return false;
+  // 每个关闭的批次由一个批处理线程取出
+  for (int i = 0; i < ready; ++i) {
+    Notify(queue);
   }
+}
 
-  return absl::ToInt64Milliseconds(absl::Now() - group->begin_) >= time_windows_;
+void SharedBatchScheduler::Flush(const ServableQueuePtr &queue) {
+  if (queue != nullptr && queue->CloseOpenGroup()) {
+    Notify(queue);
+  }
 }
-ServableQueue::ServableQueue(uint32_t time_windows, uint32_t size_windows, uint32_t queue_size)
-  : time_windows_(time_windows), size_windows_(size_windows), queue_size_(queue_size) {
 
+void SharedBatchScheduler::Notify(const ServableQueuePtr &queue) {
+  {
+    std::unique_lock lock(mutex_);
+    ready_list_.push_back(queue);
+  }
+  ready_cv_.notify_one();
+}
+
+void SharedBatchScheduler::TimerWork() {
+  std::unique_lock lock(mutex_);
+  while (running_) {
+    if (timer_list_.empty()) {
+      timer_cv_.wait(lock);
+      continue;
+    }
+    auto deadline = timer_list_.top().deadline;
+    auto now = absl::Now();
+    if (now < deadline) {
+      timer_cv_.wait_for(lock, absl::ToChronoMicroseconds(deadline - now));
+      continue;
+    }
+    auto timer = timer_list_.top();
+    timer_list_.pop();
+    lock.unlock();
+    auto queue = timer.queue.lock();
+    if (queue != nullptr && queue->CloseGroup(timer.group.lock())) {
+      Notify(queue);
+    }
+    lock.lock();
+  }
 }
 
 void SharedBatchScheduler::Work() {
-  BatchTaskGroupPtr group_ptr;
+  ServableQueuePtr queue;
   {
     std::unique_lock lock(mutex_);
-    size_t size = queue_.size();
-    for (int i=0;i<size;++i) {
-      if (queue_.empty()) {
-        break;
-      }
-      auto& node = *current_;
-      auto before = current_;
-      ++current_;
-      if (current_ == queue_.end()) {
-        current_ = queue_.begin();
-      }
-      if (node->IsStop()) {
-        queue_.erase(before);
-        continue;
-      }
-      group_ptr = node->GetTaskGroup();
-      if (group_ptr != nullptr) {
-        break;
-      }
+    ready_cv_.wait(lock, [this]() {
+      return !running_ || !ready_list_.empty();
+    });
+    if (ready_list_.empty()) {
+      return;
     }
+    queue = std::move(ready_list_.front());
+    ready_list_.pop_front();
   }
+  auto group_ptr = queue->GetTaskGroup();
   if (group_ptr == nullptr) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(1));
     return;
   }
-  auto servable = group_ptr->task_list_.front()->servable;
+  Process(group_ptr, queue.get());
+}
+
+void SharedBatchScheduler::Process(const BatchTaskGroupPtr &group_ptr, ServableQueue* queue) {
+  // 已超过截止时间的请求直接返回, 不参与合并
+  auto now = absl::Now();
+  std::vector<BatchTaskPtr> task_list;
+  task_list.reserve(group_ptr->task_list_.size());
+  for (const auto& item : group_ptr->task_list_) {
+    if (item->context->deadline_ <= now) {
+      item->done({PredictStatus::DEADLINE_EXCEEDED, "deadline exceeded in batch queue"});
+      continue;
+    }
+    task_list.push_back(item);
+  }
+  if (task_list.empty()) {
+    return;
+  }
+  auto servable = task_list.front()->servable;
   auto& spec = servable->GetSpec();
 
   std::vector<const inference::ModelInferRequest*> request_list;
   std::vector<inference::ModelInferResponse*> response_list;
   std::vector<size_t> item_size_list;
 
-  inference::ModelInferRequest request;
-  inference::ModelInferResponse response;
-  for (const auto& item : group_ptr->task_list_) {
+  auto* arena = queue->Arena();
+  auto* deduper = queue->Deduper();
+  auto block = arena->Acquire();
+  auto& request = block->request;
+  auto& response = block->response;
+  size_t item_size = 0;
+  for (const auto& item : task_list) {
     request_list.push_back(item->context->request_);
+    response_list.push_back(item->context->response_);
     item_size_list.push_back(item->size);
+    item_size += item->size;
   }
-  MergeRequest(request_list, spec, &request);
+  size_t batch_size = 0;
+  PredictStatus status;
+  ItemDeduper::Plan plan;
   auto merge_context = std::make_shared<PredictContext>(&request, &response);
-  auto status = servable->Predict(merge_context);
-  SplitResponse(response, response_list, item_size_list);
+  // 合并/推理/拆分中的异常不能漏掉回调, 整组请求失败
+  try {
+    if (deduper == nullptr) {
+      batch_size = GetBatchSize(item_size);
+      status = MergeRequest(request_list, spec, batch_size, pad_variable_length_, &request);
+    } else {
+      // 去重后按需要推理的item数补齐
+      status = MergeRequest(request_list, spec, 0, pad_variable_length_, &request);
+      if (status.Ok()) {
+        deduper->Compact(&request, &plan);
+        if (plan.infer_size > 0) {
+          batch_size = GetBatchSize(plan.infer_size);
+          PadRequest(batch_size, &request);
+        }
+        if (duplicate_counter_ != nullptr) {
+          duplicate_counter_->Increment(plan.duplicate);
+          cached_counter_->Increment(plan.item_size - plan.duplicate - plan.infer_size);
+        }
+      }
+    }
+    if (status.Ok() && deduper == nullptr) {
+      status = servable->Predict(merge_context);
+      // 推理失败时输出不完整, 不拆分到各请求
+      if (status.Ok()) {
+        SplitResponse(response, request_list, response_list, item_size_list);
+      }
+    } else if (status.Ok()) {
+      // 全部命中缓存时不推理
+      if (plan.infer_size > 0) {
+        status = servable->Predict(merge_context);
+      }
+      auto& expanded = block->expanded;
+      if (status.Ok()) {
+        status = deduper->Expand(plan, response, &expanded);
+      }
+      if (status.Ok()) {
+        expanded.set_model_name(request.model_name());
+        SplitResponse(expanded, request_list, response_list, item_size_list);
+      }
+    }
+  } catch (const std::exception& e) {
+    LOG(WARNING) << "batch predict error: " << e.what();
+    status = {PredictStatus::INTERNAL, absl::StrCat("batch predict error: ", e.what())};
+  } catch (...) {
+    LOG(WARNING) << "batch predict unknown error";
+    status = {PredictStatus::INTERNAL, "batch predict unknown error"};
+  }
 
   auto& merge_state = merge_context->time_state_;
-  for (const auto& item : group_ptr->task_list_) {
+  for (const auto& item : task_list) {
     auto& state = item->context->time_state_;
     state.before_pack = merge_state.before_pack;
     state.before_predict = merge_state.before_predict;
     state.before_unpack = merge_state.before_unpack;
     state.after_unpack = merge_state.after_unpack;
+    item->context->batch_size_ = batch_size;
 
-    item->promise.set_value(status);
+    item->done(status);
   }
+  arena->Release(std::move(block));
 }
 
-SharedBatchScheduler::SharedBatchScheduler(const BatchConfig& config) {
+size_t SharedBatchScheduler::GetBatchSize(size_t item_size) {
+  auto it = std::lower_bound(allowed_batch_sizes_.begin(), allowed_batch_sizes_.end(), item_size);
+  auto index = std::distance(allowed_batch_sizes_.begin(), it);
+  if (bucket_counters_[index] != nullptr) {
+    bucket_counters_[index]->Increment();
+  }
+  if (it == allowed_batch_sizes_.end()) {
+    // 超过最大允许的批次, 不补齐
+    return item_size;
+  }
+  if (padding_counter_ != nullptr) {
+    padding_counter_->Increment(*it - item_size);
+  }
+  return *it;
+}
+
+SharedBatchScheduler::SharedBatchScheduler(const BatchConfig& config, const std::shared_ptr<Metrics>& metrics) {
   uint32_t num = config.num_batch_threads() <= 0 ? std::thread::hardware_concurrency() : config.num_batch_threads();
   size_windows_ = config.max_batch_size() <= 0 ? 1 : config.max_batch_size();
-  time_windows_ = config.batch_timeout_micros() <= 0 ? 1: config.batch_timeout_micros();
+  time_windows_ = absl::Microseconds(config.batch_timeout_micros() <= 0 ? 1: config.batch_timeout_micros());
+  deadline_margin_ = absl::Microseconds(config.batch_deadline_margin_micros());
+  pad_variable_length_ = config.pad_variable_length_inputs();
+
+  allowed_batch_sizes_.assign(config.allowed_batch_sizes().begin(), config.allowed_batch_sizes().end());
+  if (!allowed_batch_sizes_.empty()
+      && (!std::is_sorted(allowed_batch_sizes_.begin(), allowed_batch_sizes_.end(), std::less_equal<>())
+          || allowed_batch_sizes_.back() != size_windows_)) {
+    LOG(WARNING) << "allowed_batch_sizes must be increasing and end with max_batch_size, ignore it";
+    allowed_batch_sizes_.clear();
+  }
+  // 最后一个对应超过最大批次的情况
+  bucket_counters_.resize(allowed_batch_sizes_.size() + 1, nullptr);
+  if (metrics != nullptr) {
+    for (size_t i = 0; i < allowed_batch_sizes_.size(); ++i) {
+      bucket_counters_[i] = metrics->GetBatchCounter(std::to_string(allowed_batch_sizes_[i]));
+    }
+    bucket_counters_.back() = metrics->GetBatchCounter("none");
+    padding_counter_ = metrics->GetBatchPaddingCounter();
+    if (config.dedup_items()) {
+      duplicate_counter_ = metrics->GetBatchDedupCounter("duplicate");
+      cached_counter_ = metrics->GetBatchDedupCounter("cached");
+    }
+  }
   queue_size_ = config.max_enqueued_batches() <= 0 ? UINT32_MAX : config.max_enqueued_batches();
+  dedup_items_ = config.dedup_items();
+  item_cache_size_ = config.item_cache_size();
 
-  current_ = queue_.begin();
   workers_.reserve(num);
   for (int i=0;i<num;++i) {
     workers_.emplace_back([this](){
@@ -287,17 +347,34 @@ SharedBatchScheduler::SharedBatchScheduler(const BatchConfig& config) {
       }
     });
   }
+  timer_ = std::thread([this]() {
+    TimerWork();
+  });
 }
 SharedBatchScheduler::~SharedBatchScheduler() {
-  running_ = false;
+  {
+    std::unique_lock lock(mutex_);
+    running_ = false;
+  }
+  ready_cv_.notify_all();
+  timer_cv_.notify_all();
   for (auto& item : workers_) {
     item.join();
   }
+  timer_.join();
+  // 工作线程已退出, 就绪但未处理的批次和未关闭的批次都直接结束
+  std::deque<ServableQueuePtr> ready_list;
+  {
+    std::unique_lock lock(mutex_);
+    ready_list.swap(ready_list_);
+    timer_list_ = {};
+  }
+  for (const auto& queue : ready_list) {
+    queue->FailAll({PredictStatus::UNAVAILABLE, "batch scheduler stopped"});
+  }
 }
-ServableQueueNode SharedBatchScheduler::AddQueue() {
-  std::unique_lock lock(mutex_);
-  queue_.push_front(std::make_shared<ServableQueue>(time_windows_, size_windows_, queue_size_));
-  current_ = queue_.begin();
-  return queue_.begin();
+ServableQueuePtr SharedBatchScheduler::AddQueue() {
+  return std::make_shared<ServableQueue>(time_windows_, deadline_margin_, size_windows_, queue_size_, workers_.size(),
+                                         dedup_items_ ? std::make_unique<ItemDeduper>(item_cache_size_) : nullptr);
 }
 }
@@ -1,25 +1,43 @@
 #pragma once
 
 #include <list>
+#include <deque>
+#include <queue>
 #include <mutex>
 #include <thread>
 #include <vector>
 #include <atomic>
-#include <future>
+#include <functional>
+#include <condition_variable>
 
 #include <absl/time/time.h>
 #include <absl/time/clock.h>
 
 #include "model/predict_status.h"
+#include "batch/tensor_arena.h"
+#include "batch/item_dedup.h"
+#include "utils/request_merge.h"
+
+namespace prometheus {
+class Counter;
+}
+
+namespace inference {
+class ModelInferRequest;
+class ModelInferResponse;
+class ModelSpec;
+}
 
 namespace torch::serving {
 class IServable;
 class BatchConfig;
 class PredictContext;
+class Metrics;
 
 struct BatchTask {
   std::shared_ptr<PredictContext> context;
-  std::promise<PredictStatus> promise;
+  // 批处理线程完成预测后调用
+  std::function<void(const PredictStatus&)> done;
   uint64_t size;
   std::shared_ptr<IServable> servable;
 };
@@ -27,7 +45,10 @@ using BatchTaskPtr = std::shared_ptr<BatchTask>;
 
 struct BatchTaskGroup {
   absl::Time begin_{absl::Now()};
+  // 批次的关闭时间, 取超时时间和成员截止时间中较早的
+  absl::Time close_time_{absl::InfiniteFuture()};
   uint64_t item_size_{0};
+  bool closed_{false};
   std::vector<BatchTaskPtr> task_list_;
 };
 
@@ -35,55 +56,106 @@ using BatchTaskGroupPtr = std::shared_ptr<BatchTaskGroup>;
 
 class ServableQueue {
  public:
-  ServableQueue(uint32_t time_windows, uint32_t size_windows, uint32_t queue_size);
+  ServableQueue(absl::Duration time_windows, absl::Duration deadline_margin, uint32_t size_windows, uint32_t queue_size, size_t arena_size,
+                std::unique_ptr<ItemDeduper> deduper = nullptr);
+  // 未被处理的请求以UNAVAILABLE结束, 避免调用方一直等待
+  ~ServableQueue();
+
+  // 入队; 批次关闭时间提前(新开批次或更早的截止时间)时通过timer_group/close_time返回, 用于注册定时器
+  // 加入后超过max_batch_size时先关闭当前批次再新开批次
+  // 返回值: 被关闭的批次数
+  int AddTask(const BatchTaskPtr& task, BatchTaskGroupPtr* timer_group, absl::Time* close_time);
+
+  // 超时关闭批次, 批次已被关闭时返回false
+  bool CloseGroup(const BatchTaskGroupPtr& group);
 
-  void AddTask(const BatchTaskPtr& task);
+  // 关闭末尾未满的批次, 没有未关闭的批次时返回false
+  bool CloseOpenGroup();
 
+  // 取出所有批次, 以status结束其中的请求
+  void FailAll(const PredictStatus& status);
+
+  // 取出头部已关闭的批次
   BatchTaskGroupPtr GetTaskGroup();
 
-  void Stop() {
-    is_stop_ = true;
+  // 合并请求使用的内存池, 每个模型版本独立
+  TensorArena* Arena() {
+    return &arena_;
   }
 
-  bool IsStop() {
-    return is_stop_ && group_list_.empty();
+  // 未开启dedup_items时为nullptr, 跨批次的item缓存每个模型版本独立
+  ItemDeduper* Deduper() {
+    return deduper_.get();
   }
 
  private:
-  bool IsGroupClose(const BatchTaskGroupPtr& group) const;
+  bool IsGroupFull(const BatchTaskGroupPtr& group) const;
  private:
   // 末尾入，头部出
   std::list<BatchTaskGroupPtr> group_list_;
   std::mutex mutex_;
-  const uint32_t time_windows_;
+  const absl::Duration time_windows_;
+  const absl::Duration deadline_margin_;
   const uint32_t size_windows_;
   const uint32_t queue_size_;
-  std::atomic_bool is_stop_{false};
+  TensorArena arena_;
+  std::unique_ptr<ItemDeduper> deduper_;
 };
 
 using ServableQueuePtr = std::shared_ptr<ServableQueue>;
 
-using ModelBatchQueue = std::list<ServableQueuePtr>;
-using ServableQueueNode = ModelBatchQueue::iterator;
-
 class SharedBatchScheduler {
  public:
-  explicit SharedBatchScheduler(const BatchConfig& config);
+  explicit SharedBatchScheduler(const BatchConfig& config, const std::shared_ptr<Metrics>& metrics = nullptr);
   ~SharedBatchScheduler();
-  ServableQueueNode AddQueue();
+  ServableQueuePtr AddQueue();
+
+  void Schedule(const ServableQueuePtr& queue, const BatchTaskPtr& task);
+
+  // 模型版本卸载时立即关闭未满的批次, 已入队的请求仍正常推理
+  void Flush(const ServableQueuePtr& queue);
 
  private:
+  struct BatchTimer {
+    absl::Time deadline;
+    std::weak_ptr<ServableQueue> queue;
+    std::weak_ptr<BatchTaskGroup> group;
+    bool operator>(const BatchTimer& other) const {
+      return deadline > other.deadline;
+    }
+  };
+
   void Work();
+  void Process(const BatchTaskGroupPtr& group_ptr, ServableQueue* queue);
+  void TimerWork();
+  void Notify(const ServableQueuePtr& queue);
+  // 选择不小于item_size的最小允许批次大小, 并记录命中的分桶
+  size_t GetBatchSize(size_t item_size);
 
  private:
-  ModelBatchQueue queue_;
-  ServableQueueNode current_;
+  // 每个元素对应一个已关闭的批次
+  std::deque<ServableQueuePtr> ready_list_;
+  // 请求截止时间会提前关闭批次, 按关闭时间排序
+  std::priority_queue<BatchTimer, std::vector<BatchTimer>, std::greater<>> timer_list_;
   std::mutex mutex_;
+  std::condition_variable ready_cv_;
+  std::condition_variable timer_cv_;
   std::vector<std::thread> workers_;
+  std::thread timer_;
   std::atomic_bool running_{true};
-  uint32_t time_windows_{0};
+  absl::Duration time_windows_;
+  absl::Duration deadline_margin_;
   uint32_t size_windows_{0};
   uint32_t queue_size_{0};
+  bool pad_variable_length_{false};
+  std::vector<uint32_t> allowed_batch_sizes_;
+  std::vector<prometheus::Counter*> bucket_counters_;
+  prometheus::Counter* padding_counter_{nullptr};
+  bool dedup_items_{false};
+  uint32_t item_cache_size_{0};
+  // 去重减少的item数, 分为批次内重复和命中缓存
+  prometheus::Counter* duplicate_counter_{nullptr};
+  prometheus::Counter* cached_counter_{nullptr};
 };
 
 }
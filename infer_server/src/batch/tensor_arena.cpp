@@ -0,0 +1,32 @@
+#include "tensor_arena.h"
+
+namespace torch::serving {
+
+TensorArena::TensorArena(size_t capacity) : capacity_(capacity) {
+  free_list_.reserve(capacity_);
+}
+TensorArena::BlockPtr TensorArena::Acquire() {
+  {
+    std::unique_lock lock(mutex_);
+    if (!free_list_.empty()) {
+      auto block = std::move(free_list_.back());
+      free_list_.pop_back();
+      return block;
+    }
+  }
+  return std::make_unique<Block>();
+}
+void TensorArena::Release(BlockPtr block) {
+  if (block == nullptr) {
+    return;
+  }
+  block->request.Clear();
+  block->response.Clear();
+  block->expanded.Clear();
+  std::unique_lock lock(mutex_);
+  if (free_list_.size() < capacity_) {
+    free_list_.push_back(std::move(block));
+  }
+}
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <vector>
+
+#include "kserve_predict_v2.pb.h"
+
+namespace torch::serving {
+
+// 批次合并用的请求/结果对象池
+// Clear后protobuf保留raw_input_contents等字段已分配的内存, 复用对象即复用按特征划分的连续内存
+class TensorArena {
+ public:
+  struct Block {
+    inference::ModelInferRequest request;
+    inference::ModelInferResponse response;
+    // 去重后按item展开的结果
+    inference::ModelInferResponse expanded;
+  };
+  using BlockPtr = std::unique_ptr<Block>;
+
+  explicit TensorArena(size_t capacity);
+
+  BlockPtr Acquire();
+
+  void Release(BlockPtr block);
+
+ private:
+  std::mutex mutex_;
+  std::vector<BlockPtr> free_list_;
+  const size_t capacity_;
+};
+
+}
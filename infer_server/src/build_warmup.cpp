@@ -6,18 +6,11 @@
 #include "mock.pb.h"
 #include "kserve_predict_v2.pb.h"
 #include "utils/pbtext.h"
+#include "utils/mock_request.h"
 
 DEFINE_string(input, "../example/request_2.json", "");
 DEFINE_string(output, "warmup.bin", "");
-
-void Trans(const torch::serving::MockRequest& mock_request, inference::ModelInferRequest* request) {
-  auto* tensor_proto = request->add_inputs();
-  tensor_proto->set_name("img");
-  tensor_proto->set_datatype(inference::DT_FLOAT);
-  tensor_proto->mutable_shape()->Add(mock_request.shape().begin(), mock_request.shape().end());
-  tensor_proto->mutable_contents()->mutable_fp32_contents()->Add(mock_request.data().begin(), mock_request.data().end());
-}
-
+DEFINE_string(input_name, "img", "");
 
 int main(int argc, char** argv) {
   google::ParseCommandLineFlags(&argc, &argv, true);
@@ -25,7 +18,7 @@ int main(int argc, char** argv) {
   torch::serving::ReadPbJson(FLAGS_input, &mock_request);
 
   inference::ModelInferRequest request;
-  Trans(mock_request, &request);
+  torch::serving::MockToRequest(mock_request, FLAGS_input_name, &request);
 
   torch::serving::WritePbBin(FLAGS_output, request);
   LOG(INFO) << FLAGS_input << " -> " << FLAGS_output;
@@ -4,6 +4,7 @@ namespace torch::serving {
 
 const char* TORCH_MODEL_FILE = "model.pt";
 const char* ONNX_MODEL_FILE = "model.onnx";
+const char* ONNX_OPTIMIZED_MODEL_FILE = "model.optimized.onnx";
 const char* FEATURE_SPEC_FILE = "feature.txt";
 const char* CHECK_FILE = "_SUCCESS";
 const char* MD5_FILE = "md5.txt";
@@ -0,0 +1,70 @@
+#include "model_loader.h"
+
+#include <algorithm>
+
+namespace torch::serving {
+
+MemoryBudget::MemoryBudget(uint64_t budget) : budget_(budget) {
+
+}
+bool MemoryBudget::Reserve(uint64_t bytes) {
+  auto used = used_.load(std::memory_order_relaxed);
+  do {
+    if (budget_ > 0 && used + bytes > budget_) {
+      return false;
+    }
+  } while (!used_.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+  return true;
+}
+void MemoryBudget::Release(uint64_t bytes) {
+  used_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+uint64_t MemoryBudget::Used() const {
+  return used_.load(std::memory_order_relaxed);
+}
+uint64_t MemoryBudget::Budget() const {
+  return budget_;
+}
+
+ModelLoader::ModelLoader(uint32_t thread_num) {
+  thread_num = std::max<uint32_t>(thread_num, 1);
+  workers_.reserve(thread_num);
+  for (uint32_t i = 0; i < thread_num; ++i) {
+    workers_.emplace_back([this]() { Run(); });
+  }
+}
+ModelLoader::~ModelLoader() {
+  {
+    std::lock_guard lock(mutex_);
+    running_ = false;
+  }
+  cond_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+void ModelLoader::Schedule(std::function<void()> task) {
+  {
+    std::lock_guard lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  cond_.notify_one();
+}
+void ModelLoader::Run() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock lock(mutex_);
+      cond_.wait(lock, [this]() { return !running_ || !tasks_.empty(); });
+      // 退出前执行完已提交的任务
+      if (tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+#include <boost/noncopyable.hpp>
+
+namespace torch::serving {
+
+// 全局内存预算, 加载前预留, 卸载后归还
+// 预算不足时直接拒绝, 不阻塞加载线程, 由下一轮扫描重试
+class MemoryBudget : public boost::noncopyable {
+ public:
+  // budget为0表示不限制
+  explicit MemoryBudget(uint64_t budget);
+
+  bool Reserve(uint64_t bytes);
+  void Release(uint64_t bytes);
+
+  uint64_t Used() const;
+  uint64_t Budget() const;
+
+ private:
+  const uint64_t budget_;
+  std::atomic<uint64_t> used_{0};
+};
+
+// 模型加载线程池, 不同模型/版本并发加载
+class ModelLoader : public boost::noncopyable {
+ public:
+  explicit ModelLoader(uint32_t thread_num);
+  ~ModelLoader();
+
+  void Schedule(std::function<void()> task);
+
+ private:
+  void Run();
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<std::function<void()>> tasks_;
+  std::vector<std::thread> workers_;
+  bool running_{true};
+};
+
+}
@@ -1,5 +1,6 @@
 #include "model_manager.h"
 #include <mutex>
+#include <condition_variable>
 #include <boost/filesystem.hpp>
 #include <boost/system/error_code.hpp>
 #include <absl/strings/numbers.h>
@@ -14,6 +15,11 @@
 #include "servables/onnx_factory.h"
 #include "model/model_define.h"
 #include "model/servable_model.h"
+#include "model/model_loader.h"
+#include "servables/cache_factory.h"
+#include "servables/async_factory.h"
+#include "servables/ensemble_servable.h"
+#include "service/metrics.h"
 #include "batch/batch_factory.h"
 #include "batch/shared_batch_scheduler.h"
 
@@ -71,11 +77,19 @@ void ModelVersionCheck(const boost::filesystem::path& model_path, const std::uno
     }
   }
 }
+
+struct ModelUpdate {
+  std::shared_ptr<torch::serving::ModelLoadPolicy> model;
+  torch::serving::ModelState state;
+  std::vector<torch::serving::ModelVersion> loaded;
+  size_t pending{0};
+};
 }
 
 namespace torch::serving {
 void ModelManager::Work() {
   boost::system::error_code ec;
+  std::vector<std::unique_ptr<ModelUpdate>> update_list;
   for (const auto& entry : model_paths_) {
     auto& model_name = entry.first;
     boost::filesystem::path model_dir(entry.second);
@@ -106,41 +120,143 @@ void ModelManager::Work() {
       LOG(INFO) << model_name << " no need to update";
       continue;
     }
-    torch_model->UpdateModel(&model_status);
+    auto update = std::make_unique<ModelUpdate>();
+    update->model = torch_model;
+    update->state = std::move(model_status);
+    update_list.push_back(std::move(update));
+  }
+
+  // 不同模型/版本并发加载, 每个模型的新版本全部加载结束后立即切换并卸载老版本
+  std::mutex mutex;
+  std::condition_variable cond;
+  size_t remain = 0;
+  for (auto& update : update_list) {
+    update->model->Plan(&update->state);
+    update->pending = update->state.to_add_list.size();
+    remain += update->pending;
+    if (update->pending == 0) {
+      update->model->Retain(&update->state);
+    }
   }
+  for (auto& update : update_list) {
+    auto* data = update.get();
+    const auto versions = data->state.to_add_list;
+    for (const auto& version : versions) {
+      loader_->Schedule([&, data, version]() {
+        bool ok = data->model->Load(version);
+        bool done = false;
+        {
+          std::lock_guard lock(mutex);
+          if (ok) {
+            data->loaded.push_back(version);
+          }
+          done = --data->pending == 0;
+        }
+        if (done) {
+          data->state.to_add_list.swap(data->loaded);
+          data->model->Retain(&data->state);
+          LOG(INFO) << data->model->GetName() << " update finish, add " << data->state.to_add_list.size()
+                    << " versions, remove " << data->state.to_rm_list.size() << " versions";
+        }
+        std::lock_guard lock(mutex);
+        --remain;
+        cond.notify_all();
+      });
+    }
+  }
+  std::unique_lock lock(mutex);
+  cond.wait(lock, [&]() { return remain == 0; });
 }
-bool ModelManager::Init(const ModelManagerConfig &model_manager_config) {
+bool ModelManager::Init(const ModelManagerConfig &model_manager_config, const std::shared_ptr<Metrics>& metrics) {
   if (running_) {
     return false;
   }
   if (model_manager_config.has_batch_config() && model_manager_config.batch_config().enable()) {
-    scheduler_ = std::make_shared<SharedBatchScheduler>(model_manager_config.batch_config());
+    scheduler_ = std::make_shared<SharedBatchScheduler>(model_manager_config.batch_config(), metrics);
+  }
+  loader_ = std::make_shared<ModelLoader>(model_manager_config.load_threads());
+  if (model_manager_config.memory_budget_mb() > 0) {
+    budget_ = std::make_shared<MemoryBudget>(model_manager_config.memory_budget_mb() << 20);
+  }
+  if (model_manager_config.ensemble_threads() > 0) {
+    ensemble_executor_ = std::make_shared<ModelLoader>(model_manager_config.ensemble_threads());
+  }
+  if (model_manager_config.predict_threads() > 0) {
+    predict_executor_ = std::make_shared<ModelLoader>(model_manager_config.predict_threads());
   }
   for (const auto& config : model_manager_config.mode_configs()) {
-    if (config.path().empty() || config.name().empty() || config.platform() == Define_Platform_UNKNOWN) {
-      continue;
-    }
     auto& model_name = config.name();
     auto& model_path = config.path();
+    if (config.platform() == Define_Platform_ENSEMBLE && !model_name.empty()) {
+      // 步骤只能引用普通模型, 请求时查找, model_data_此时已经不再修改
+      EnsembleServable::Executor executor;
+      if (ensemble_executor_ != nullptr) {
+        executor = [pool = ensemble_executor_](std::function<void()> task) {
+          pool->Schedule(std::move(task));
+        };
+      }
+      auto ensemble = std::make_shared<EnsembleServable>(config.ensemble_config(), [this](const std::string& name, ModelVersion version) {
+        auto it = model_data_.find(name);
+        return it == model_data_.end() ? nullptr : it->second->GetServableByVersion(version);
+      }, executor);
+      if (!ensemble->Init(model_name)) {
+        LOG(WARNING) << "skip invalid ensemble " << model_name;
+        continue;
+      }
+      ensembles_[model_name] = ensemble;
+      continue;
+    }
+    if (model_path.empty() || model_name.empty() || config.platform() == Define_Platform_UNKNOWN) {
+      continue;
+    }
 
     std::shared_ptr<ServableFactory> servable_factory;
     switch (config.platform()) {
       case Define_Platform_TORCH:{
-        servable_factory = std::make_shared<TorchFactory>();
+        auto torch_config = config.torch_config();
+        if (torch_config.warmup_batch_sizes().empty() && config.use_batch() && scheduler_ != nullptr) {
+          auto& allowed_batch_sizes = model_manager_config.batch_config().allowed_batch_sizes();
+          torch_config.mutable_warmup_batch_sizes()->Add(allowed_batch_sizes.begin(), allowed_batch_sizes.end());
+        }
+        servable_factory = std::make_shared<TorchFactory>(torch_config);
         break;
       }
       case Define_Platform_ONNX: {
-        servable_factory = std::make_shared<OnnxFactory>();
+        servable_factory = std::make_shared<OnnxFactory>(config.onnx_config(), model_manager_config.onnx_env_config());
         break;
       }
       default: continue;
     }
     if (config.use_batch() && scheduler_ != nullptr) {
       servable_factory = std::make_shared<BatchFactory>(servable_factory, scheduler_);
+    } else if (predict_executor_ != nullptr) {
+      // 批处理模型已由批处理线程推理
+      servable_factory = std::make_shared<AsyncFactory>(servable_factory, [pool = predict_executor_](std::function<void()> task) {
+        pool->Schedule(std::move(task));
+      });
+    }
+    if (config.cache_config().enable()) {
+      // 命中缓存的请求不进入批处理队列
+      CacheCounters counters;
+      if (metrics != nullptr) {
+        counters.hit = metrics->GetCacheCounter(model_name, "hit");
+        counters.miss = metrics->GetCacheCounter(model_name, "miss");
+        counters.evict = metrics->GetCacheCounter(model_name, "evict");
+      }
+      servable_factory = std::make_shared<CacheFactory>(servable_factory, config.cache_config(), counters);
     }
 
     model_paths_[model_name] = model_path;
-    auto servable_model = std::make_unique<ServableModel>(servable_factory, model_name, model_path);
+    auto servable_model = std::make_unique<ServableModel>(servable_factory, model_name, model_path, budget_, config.memory_mb() << 20);
+    if (metrics != nullptr) {
+      servable_model->SetVersionCallback([metrics](const std::string& name, ModelVersion version, bool loaded) {
+        if (loaded) {
+          metrics->AddStageHistograms(name, version);
+        } else {
+          metrics->RemoveStageHistograms(name, version);
+        }
+      });
+    }
     switch (config.policy().policy_choice_case()) {
       case ServableVersionPolicy::kLatest: {
         model_data_[model_name] = std::make_shared<LatestPolicyTorchModel>(std::move(servable_model), config.policy().latest().num_versions());
@@ -171,10 +287,19 @@ bool ModelManager::Init(const ModelManagerConfig &model_manager_config) {
     }
   }
   running_ = true;
-  Work();
-  worker_ = std::thread([&](){
+  const bool async_startup = model_manager_config.async_startup();
+  if (!async_startup) {
+    Work();
+    ready_ = true;
+  }
+  worker_ = std::thread([this, async_startup, interval = model_manager_config.interval()](){
+    if (async_startup) {
+      Work();
+      ready_ = true;
+      LOG(INFO) << "all models loaded";
+    }
     while (running_) {
-      std::this_thread::sleep_for(std::chrono::seconds(model_manager_config.interval()));
+      std::this_thread::sleep_for(std::chrono::seconds(interval));
       Work();
     }
   });
@@ -187,7 +312,7 @@ void ModelManager::Stop() {
 std::shared_ptr<IServable> ModelManager::GetServableByLabel(const std::string &name, const std::string &label) {
   auto it = model_data_.find(name);
   if (it == model_data_.end() || it->second == nullptr) {
-    return nullptr;
+    return GetEnsemble(name);
   }
   auto& model = it->second;
   return model->GetServableByLabel(label);
@@ -195,7 +320,7 @@ std::shared_ptr<IServable> ModelManager::GetServableByLabel(const std::string &n
 std::shared_ptr<IServable> ModelManager::GetServableByVersion(const std::string &name, ModelVersion version) {
   auto it = model_data_.find(name);
   if (it == model_data_.end() || it->second == nullptr) {
-    return nullptr;
+    return GetEnsemble(name);
   }
   auto& model = it->second;
   return model->GetServableByVersion(version);
@@ -208,6 +333,16 @@ void ModelManager::GetModelList(std::vector<std::string> *model_list) {
   for (const auto& entry : model_paths_) {
     model_list->push_back(entry.first);
   }
+  for (const auto& entry : ensembles_) {
+    model_list->push_back(entry.first);
+  }
+}
+std::shared_ptr<IServable> ModelManager::GetEnsemble(const std::string &name) {
+  auto it = ensembles_.find(name);
+  if (it == ensembles_.end()) {
+    return nullptr;
+  }
+  return it->second;
 }
 std::shared_ptr<ModelLoadPolicy> ModelManager::GetModel(const std::string &name) {
   auto it = model_data_.find(name);
@@ -217,7 +352,7 @@ std::shared_ptr<ModelLoadPolicy> ModelManager::GetModel(const std::string &name)
   return it->second;
 }
 bool ModelManager::Ready() const {
-  return running_;
+  return ready_;
 }
 
 }
@@ -8,6 +8,7 @@
 #include <thread>
 #include <shared_mutex>
 #include <vector>
+#include <atomic>
 #include <utility>
 
 #include <boost/noncopyable.hpp>
@@ -18,10 +19,13 @@ class IServable;
 class ModelLoadPolicy;
 class ModelManagerConfig;
 class SharedBatchScheduler;
+class Metrics;
+class ModelLoader;
+class MemoryBudget;
 
 class ModelManager : public boost::noncopyable {
  public:
-  bool Init(const ModelManagerConfig& model_manager_config);
+  bool Init(const ModelManagerConfig& model_manager_config, const std::shared_ptr<Metrics>& metrics = nullptr);
 
   std::shared_ptr<IServable> GetServableByLabel(const std::string& name, const std::string& label);
   std::shared_ptr<IServable> GetServableByVersion(const std::string& name, ModelVersion version = 0);
@@ -31,18 +35,28 @@ class ModelManager : public boost::noncopyable {
 
   void Stop();
 
+  // 首轮加载结束; 单个模型是否就绪以能否取到servable为准
   bool Ready() const;
 
  private:
 
   void Work();
+  // ensemble没有版本和标签
+  std::shared_ptr<IServable> GetEnsemble(const std::string& name);
 
  private:
   std::unordered_map<std::string, std::string> model_paths_;  // <name, path>, 只读
   std::unordered_map<std::string, std::shared_ptr<ModelLoadPolicy>> model_data_;  // <name, model>, 外层只读，内侧读写
   std::thread worker_;
   bool running_{false};
+  std::atomic<bool> ready_{false};
   std::shared_ptr<SharedBatchScheduler> scheduler_{};
+  std::shared_ptr<ModelLoader> loader_{};
+  std::shared_ptr<MemoryBudget> budget_{};
+  // <name, ensemble>, 只读; ensemble没有模型目录, 不参与版本扫描
+  std::unordered_map<std::string, std::shared_ptr<IServable>> ensembles_;
+  std::shared_ptr<ModelLoader> ensemble_executor_{};
+  std::shared_ptr<ModelLoader> predict_executor_{};
 };
 
 }
@@ -12,13 +12,13 @@ bool PredictContext::Check() {
 }
 
 
-std::string TimeState::ToString() {
+std::string TimeState::ToString() const {
   if (before_queue == 0 || before_check == 0 || after_check == 0 || before_pack == 0 || before_predict == 0 || before_unpack == 0 || after_unpack == 0) {
     return "miss time state";
   }
   return absl::StrFormat("all:%dus; queue:%dus; check:%dus; pack:%dus; predict:%dus; unpack:%dus",
                          after_unpack - before_queue,
-                         before_queue - before_pack - (after_check - before_check),
+                         before_pack - after_check,
                          after_check - before_check,
                          before_predict - before_pack,
                          before_unpack - before_predict,
@@ -3,6 +3,8 @@
 #include <string>
 #include <memory>
 
+#include <absl/time/time.h>
+
 namespace inference {
 class ModelInferRequest;
 class ModelInferResponse;
@@ -18,7 +20,7 @@ struct TimeState {
   int64_t before_predict{0};
   int64_t before_unpack{0};
   int64_t after_unpack{0};
-  std::string ToString();
+  std::string ToString() const;
 };
 
 class PredictContext {
@@ -29,6 +31,10 @@ class PredictContext {
   const inference::ModelInferRequest* request_;
   inference::ModelInferResponse* response_;
   TimeState time_state_;
+  // 请求截止时间, 来自grpc的ServerContext
+  absl::Time deadline_{absl::InfiniteFuture()};
+  // 批处理时合并后的批次大小, 未经过批处理为0
+  size_t batch_size_{0};
 };
 
 using PredictContextPtr = std::shared_ptr<PredictContext>;
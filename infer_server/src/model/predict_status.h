@@ -20,17 +20,26 @@ class PredictStatus {
     FEATURE_SIZE_ERROR,
     MISS_SERVABLE,
     RESULT_SIZE_ERROR,
+    DEADLINE_EXCEEDED,
+    // 调度器或模型版本已停止, 请求未被处理
+    UNAVAILABLE,
+    // 推理或合并拆分时抛出异常
+    INTERNAL,
   };
 
   PredictStatus() = default;
   PredictStatus(Status status): status_(status) { }
   PredictStatus(Status status, std::string msg): status_(status), msg_(std::move(msg)) { }
 
-  bool Ok() {
+  bool Ok() const {
     return status_ == Status::OK;
   }
 
-  const std::string& Message() {
+  Status Code() const {
+    return status_;
+  }
+
+  const std::string& Message() const {
     return msg_;
   }
 
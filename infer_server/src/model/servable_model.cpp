@@ -1,139 +1,216 @@
 #include "servable_model.h"
-#include <queue>
 #include <glog/logging.h>
 #include <boost/filesystem.hpp>
 #include <algorithm>
 
 #include "servables/servable.h"
+#include "model/model_loader.h"
 
 namespace torch::serving {
 
-ServableModel::ServableModel(const std::shared_ptr<ServableFactory>& factory, const std::string &model_name, const std::string &model_path)
-  :factory_(factory), model_name_(model_name), model_path_(model_path) {
+ServableModel::ServableModel(const std::shared_ptr<ServableFactory>& factory, const std::string &model_name, const std::string &model_path,
+                             const std::shared_ptr<MemoryBudget>& budget, uint64_t memory_bytes)
+  :model_name_(model_name), model_path_(model_path), factory_(factory), budget_(budget), memory_bytes_(memory_bytes),
+   snapshot_(std::make_unique<ServableSnapshot>()) {
 
 }
-
-std::shared_ptr<IServable> ServableModel::GetServableByLabel(const std::string &label) {
-  std::shared_lock lock(shared_mutex_);
-  auto it = label_to_version_.find(label);
-  if (it == label_to_version_.end() || it->second.empty()) {
-    return nullptr;
-  }
-  auto& versions = it->second;
-  if (versions.empty()) {
-    return nullptr;
+ServableModel::~ServableModel() {
+  if (budget_ == nullptr) {
+    return;
   }
-  auto sub_it = servable_verions_.find(versions.begin().operator*());
-  if (sub_it == servable_verions_.end()) {
-    return nullptr;
+  for (const auto& entry : reserved_bytes_) {
+    budget_->Release(entry.second);
   }
-  return sub_it->second;
 }
-std::shared_ptr<IServable> ServableModel::GetServableByVersion(ModelVersion model_version) {
-  {
-    std::shared_lock lock(shared_mutex_);
-    if (servable_verions_.empty()) {
+
+std::shared_ptr<IServable> ServableModel::GetServableByLabel(const std::string &label) {
+  return snapshot_.Read([&](const ServableSnapshot& snapshot) -> std::shared_ptr<IServable> {
+    auto it = snapshot.labels.find(label);
+    if (it == snapshot.labels.end()) {
       return nullptr;
     }
-  }
-  if (model_version == 0) {
-    // 使用最新版本
-    std::shared_lock lock(shared_mutex_);
-    auto it = servable_verions_.begin();
     return it->second;
-  } else {
-    std::shared_lock lock(shared_mutex_);
-    auto it = servable_verions_.find(model_version);
-    if (it == servable_verions_.end()) {
+  });
+}
+std::shared_ptr<IServable> ServableModel::GetServableByVersion(ModelVersion model_version) {
+  return snapshot_.Read([&](const ServableSnapshot& snapshot) -> std::shared_ptr<IServable> {
+    if (snapshot.versions.empty()) {
       return nullptr;
     }
-    return it->second;
+    if (model_version == 0) {
+      // 使用最新版本
+      return snapshot.versions.front().second;
+    }
+    // 同时加载的版本很少, 顺序查找
+    for (const auto& [version, servable] : snapshot.versions) {
+      if (version == model_version) {
+        return servable;
+      }
+    }
+    return nullptr;
+  });
+}
+void ServableModel::Publish() {
+  auto snapshot = std::make_unique<ServableSnapshot>();
+  snapshot->versions.assign(servable_verions_.begin(), servable_verions_.end());
+  for (const auto& [label, versions] : label_to_version_) {
+    if (versions.empty()) {
+      continue;
+    }
+    auto it = servable_verions_.find(*versions.begin());
+    if (it != servable_verions_.end()) {
+      snapshot->labels.emplace(label, it->second);
+    }
   }
-  return nullptr;
+  snapshot_.Update(std::move(snapshot));
 }
 bool ServableModel::AddServable(ModelVersion model_version) {
   auto version_path = boost::filesystem::path(model_path_) / std::to_string(model_version);
+  uint64_t bytes = 0;
+  if (budget_ != nullptr) {
+    bytes = EstimateMemory(version_path.string());
+    if (!budget_->Reserve(bytes)) {
+      LOG(WARNING) << model_name_ << " version " << model_version << " need " << bytes
+                   << " bytes, used " << budget_->Used() << " of " << budget_->Budget() << ", skip";
+      return false;
+    }
+  }
   auto servable = factory_->New();
-  if (!servable->Init(version_path.string())) {
+  if (servable == nullptr || !servable->Init(version_path.string())) {
+    if (budget_ != nullptr) {
+      budget_->Release(bytes);
+    }
     return false;
   }
+  if (version_callback_ != nullptr) {
+    version_callback_(model_name_, model_version, true);
+  }
   {
-    std::unique_lock lock(shared_mutex_);
+    std::lock_guard lock(mutex_);
     servable_verions_[model_version] = servable;
     label_to_version_[servable->GetLabel()].insert(model_version);
+    reserved_bytes_[model_version] += bytes;
+    Publish();
   }
   return true;
 }
 void ServableModel::RmServable(ModelVersion model_version) {
-  std::unique_lock lock(shared_mutex_);
-  auto it = servable_verions_.find(model_version);
-  if (it == servable_verions_.end()) {
-    return;
+  // 在锁外析构, 避免阻塞查询; 仍在处理的请求持有引用时延后到请求结束
+  std::shared_ptr<IServable> servable;
+  uint64_t bytes = 0;
+  {
+    std::lock_guard lock(mutex_);
+    auto it = servable_verions_.find(model_version);
+    if (it == servable_verions_.end()) {
+      return;
+    }
+    servable = std::move(it->second);
+    if (servable != nullptr) {
+      label_to_version_[servable->GetLabel()].erase(model_version);
+    }
+    servable_verions_.erase(it);
+    auto reserved_it = reserved_bytes_.find(model_version);
+    if (reserved_it != reserved_bytes_.end()) {
+      bytes = reserved_it->second;
+      reserved_bytes_.erase(reserved_it);
+    }
+    Publish();
   }
-  auto& servable = it->second;
   if (servable != nullptr) {
-    label_to_version_[servable->GetLabel()].erase(model_version);
+    servable->Unload();
+  }
+  if (budget_ != nullptr) {
+    budget_->Release(bytes);
   }
-  servable_verions_.erase(it);
+  if (version_callback_ != nullptr) {
+    version_callback_(model_name_, model_version, false);
+  }
+}
+void ServableModel::SetVersionCallback(std::function<void(const std::string&, ModelVersion, bool)> callback) {
+  version_callback_ = std::move(callback);
+}
+uint64_t ServableModel::EstimateMemory(const std::string& version_path) const {
+  if (memory_bytes_ > 0) {
+    return memory_bytes_;
+  }
+  boost::system::error_code ec;
+  uint64_t bytes = 0;
+  for (const auto& entry : boost::filesystem::directory_iterator(version_path, ec)) {
+    if (boost::filesystem::is_regular_file(entry.path(), ec)) {
+      bytes += boost::filesystem::file_size(entry.path(), ec);
+    }
+  }
+  return bytes;
 }
 void ServableModel::GetAllVersion(std::unordered_set<ModelVersion> *versions) {
   if (versions == nullptr) {
     return;
   }
-  std::shared_lock lock(shared_mutex_);
-  for (const auto& entry : servable_verions_) {
-    versions->insert(entry.first);
-  }
+  snapshot_.Read([&](const ServableSnapshot& snapshot) {
+    for (const auto& entry : snapshot.versions) {
+      versions->insert(entry.first);
+    }
+    return true;
+  });
 }
 
 const std::string& ServableModel::GetName() {
   return model_name_;
 }
 
-void LatestPolicyTorchModel::UpdateModel(ModelState *model_state) {
-  if (model_state == nullptr || num_ <= 0) {
+void LatestPolicyTorchModel::Plan(ModelState *model_state) {
+  if (model_state == nullptr) {
+    return;
+  }
+  if (num_ <= 0) {
+    model_state->to_add_list.clear();
     return;
   }
+  // 只加载与现有版本合并后仍在最大num_个之内的新版本
   std::unordered_set<ModelVersion> remain_set;
   wrapper_->GetAllVersion(&remain_set);
   for (const auto& item : model_state->to_rm_list) {
     remain_set.erase(item);
   }
-  std::priority_queue<ModelVersion, std::vector<ModelVersion>, std::greater<>> remain_que(remain_set.begin(), remain_set.end());
-  std::sort(model_state->to_add_list.begin(), model_state->to_add_list.end(), std::greater<>());
-
-  std::unordered_set<ModelVersion> add_version;
-  std::unordered_set<ModelVersion> rm_version;
+  std::vector<ModelVersion> candidates(remain_set.begin(), remain_set.end());
+  candidates.insert(candidates.end(), model_state->to_add_list.begin(), model_state->to_add_list.end());
+  std::sort(candidates.begin(), candidates.end(), std::greater<>());
+  if (candidates.size() > num_) {
+    candidates.resize(num_);
+  }
+  std::unordered_set<ModelVersion> keep_set(candidates.begin(), candidates.end());
+  std::vector<ModelVersion> add_version;
   for (const auto& version : model_state->to_add_list) {
-    if (remain_que.size() < num_) {
-      // 直接加载
-      if (!wrapper_->AddServable(version)) {
-        continue;
-      }
-      remain_que.push(version);
-      add_version.insert(version);
-    } else {
-      // 可能要淘汰版本
-      ModelVersion last_version = remain_que.top();
-      if (last_version > version) {
-        // 不需要加载
-        continue;
-      }
-      if (!wrapper_->AddServable(version)) {
-        continue;
-      }
-      // 更新添加版本
-      add_version.insert(version);
-      remain_que.push(version);
-      // 清理老版本
-      wrapper_->RmServable(last_version);
-      rm_version.insert(last_version);
-      add_version.erase(last_version);
-      remain_que.pop();
+    if (keep_set.find(version) != keep_set.end()) {
+      add_version.push_back(version);
     }
   }
-  model_state->to_add_list.clear();
-  model_state->to_add_list.insert(model_state->to_add_list.end(), add_version.begin(), add_version.end());
+  model_state->to_add_list.swap(add_version);
+}
+void LatestPolicyTorchModel::Retain(ModelState *model_state) {
+  if (model_state == nullptr || num_ <= 0) {
+    return;
+  }
+  std::unordered_set<ModelVersion> remain_set;
+  wrapper_->GetAllVersion(&remain_set);
+  for (const auto& item : model_state->to_rm_list) {
+    remain_set.erase(item);
+  }
+  std::vector<ModelVersion> remain_list(remain_set.begin(), remain_set.end());
+  if (remain_list.size() <= num_) {
+    return;
+  }
+  // 新版本已经可用, 清理超出数量的老版本
+  std::sort(remain_list.begin(), remain_list.end(), std::greater<>());
+  std::unordered_set<ModelVersion> rm_version(remain_list.begin() + num_, remain_list.end());
+  for (const auto& version : rm_version) {
+    wrapper_->RmServable(version);
+    LOG(INFO) << wrapper_->GetName() << " remove old version " << version;
+  }
+  auto it = std::remove_if(model_state->to_add_list.begin(), model_state->to_add_list.end(), [&](ModelVersion version) {
+    return rm_version.find(version) != rm_version.end();
+  });
+  model_state->to_add_list.erase(it, model_state->to_add_list.end());
   model_state->to_rm_list.insert(model_state->to_rm_list.end(), rm_version.begin(), rm_version.end());
 }
 
@@ -155,57 +232,66 @@ std::shared_ptr<IServable> ModelLoadPolicy::GetServableByVersion(ModelVersion mo
 void ModelLoadPolicy::GetAllVersion(std::unordered_set<ModelVersion> *versions) {
   wrapper_->GetAllVersion(versions);
 }
+bool ModelLoadPolicy::Load(ModelVersion model_version) {
+  if (!wrapper_->AddServable(model_version)) {
+    LOG(WARNING) << wrapper_->GetName() << " load version " << model_version << " failed";
+    return false;
+  }
+  LOG(INFO) << wrapper_->GetName() << " add new version " << model_version;
+  return true;
+}
+void ModelLoadPolicy::UpdateModel(ModelState *model_state) {
+  if (model_state == nullptr) {
+    return;
+  }
+  Plan(model_state);
+  std::vector<ModelVersion> loaded;
+  loaded.reserve(model_state->to_add_list.size());
+  for (const auto& version : model_state->to_add_list) {
+    if (Load(version)) {
+      loaded.push_back(version);
+    }
+  }
+  model_state->to_add_list.swap(loaded);
+  Retain(model_state);
+}
+bool ModelLoadPolicy::Ready() {
+  return wrapper_->GetServableByVersion() != nullptr;
+}
+const std::string& ModelLoadPolicy::GetName() {
+  return wrapper_->GetName();
+}
 
 LatestPolicyTorchModel::LatestPolicyTorchModel(std::unique_ptr<ServableModel> torch_model, uint32_t num)
   : ModelLoadPolicy(std::move(torch_model)), num_(num) {
 
 }
-void AllPolicyTorchModel::UpdateModel(ModelState *model_state) {
+void AllPolicyTorchModel::Plan(ModelState *model_state) {
+
+}
+void AllPolicyTorchModel::Retain(ModelState *model_state) {
   if (model_state == nullptr) {
     return;
   }
-
-  {
-    std::vector<ModelVersion> update_version;
-    update_version.reserve(model_state->to_add_list.size());
-    for (const auto& version : model_state->to_add_list) {
-      if (!wrapper_->AddServable(version)) {
-        continue;
-      }
-      update_version.push_back(version);
-      LOG(INFO) << wrapper_->GetName() << " add new version " << version;
-    }
-    model_state->to_add_list.swap(update_version);
-  }
-  {
-    for (const auto& version : model_state->to_rm_list) {
-      wrapper_->RmServable(version);
-    }
+  for (const auto& version : model_state->to_rm_list) {
+    wrapper_->RmServable(version);
   }
 }
-void SpecificPolicyTorchModel::UpdateModel(ModelState *model_state) {
+void SpecificPolicyTorchModel::Plan(ModelState *model_state) {
   if (model_state == nullptr) {
     return;
   }
-  {
-    std::vector<ModelVersion> update_versions;
-    update_versions.reserve(model_state->to_add_list.size());
-    for (const auto& version: model_state->to_add_list) {
-      if (specific_version_.find(version) == specific_version_.end()) {
-        continue;
-      }
-      if (!wrapper_->AddServable(version)) {
-        continue;
-      }
-      LOG(INFO) << wrapper_->GetName() << " add new version " << version;
-      update_versions.push_back(version);
-    }
-    model_state->to_add_list.swap(update_versions);
+  auto it = std::remove_if(model_state->to_add_list.begin(), model_state->to_add_list.end(), [&](ModelVersion version) {
+    return specific_version_.find(version) == specific_version_.end();
+  });
+  model_state->to_add_list.erase(it, model_state->to_add_list.end());
+}
+void SpecificPolicyTorchModel::Retain(ModelState *model_state) {
+  if (model_state == nullptr) {
+    return;
   }
-  {
-    for (const auto& version : model_state->to_rm_list) {
-      wrapper_->RmServable(version);
-    }
+  for (const auto& version : model_state->to_rm_list) {
+    wrapper_->RmServable(version);
   }
 }
 SpecificPolicyTorchModel::SpecificPolicyTorchModel(std::unique_ptr<ServableModel> torch_model, const std::unordered_set<ModelVersion> &versions)
@@ -1,28 +1,41 @@
 #pragma once
 
-#include <shared_mutex>
+#include <mutex>
 #include <memory>
 #include <map>
 #include <set>
 #include <vector>
+#include <functional>
 #include <unordered_set>
 #include <unordered_map>
 #include "model_define.h"
+#include "utils/rcu.h"
 
 namespace torch::serving {
 
 class IServable;
 class ServableFactory;
+class MemoryBudget;
 
 struct ModelState {
   std::vector<ModelVersion> to_add_list;
   std::vector<ModelVersion> to_rm_list;
 };
 
+// 查询用的不可变快照, 每次增删版本后整体替换
+struct ServableSnapshot {
+  // 版本从大到小
+  std::vector<std::pair<ModelVersion, std::shared_ptr<IServable>>> versions;
+  // 标签 -> 该标签下的最新版本
+  std::unordered_map<std::string, std::shared_ptr<IServable>> labels;
+};
+
 class ServableModel {
  public:
-  ServableModel(const std::shared_ptr<ServableFactory>& factory, const std::string& model_name, const std::string& model_path);
-  virtual ~ServableModel() = default;
+  // memory_bytes为单个版本的预估内存, 0时按版本目录下的文件大小估算; budget为空时不限制
+  ServableModel(const std::shared_ptr<ServableFactory>& factory, const std::string& model_name, const std::string& model_path,
+                const std::shared_ptr<MemoryBudget>& budget = nullptr, uint64_t memory_bytes = 0);
+  virtual ~ServableModel();
   std::shared_ptr<IServable> GetServableByLabel(const std::string& label);
 
   std::shared_ptr<IServable> GetServableByVersion(ModelVersion model_version = 0);
@@ -31,23 +44,50 @@ class ServableModel {
 
   const std::string& GetName();
 
+  // 预算不足或加载失败时返回false; 加载成功后新版本立即对查询可见
   bool AddServable(ModelVersion model_version);
   void RmServable(ModelVersion model_version);
+  // 版本加载成功(对查询可见前, loaded为true)和卸载后(loaded为false)调用, 用于创建和清理该版本的监控等
+  void SetVersionCallback(std::function<void(const std::string&, ModelVersion, bool loaded)> callback);
+
+ private:
+  uint64_t EstimateMemory(const std::string& version_path) const;
+  // 由servable_verions_生成新快照并发布, 需持有mutex_
+  void Publish();
 
  protected:
   const std::string model_name_;
   const std::string model_path_;
-  std::shared_mutex shared_mutex_{};
+  // 只用于写者之间互斥, 查询只读取snapshot_
+  std::mutex mutex_{};
   std::map<ModelVersion, std::shared_ptr<IServable>, std::greater<>> servable_verions_{};
   std::unordered_map<std::string, std::set<ModelVersion, std::greater<>>> label_to_version_;
   const std::shared_ptr<ServableFactory> factory_;
+  const std::shared_ptr<MemoryBudget> budget_;
+  const uint64_t memory_bytes_;
+  std::unordered_map<ModelVersion, uint64_t> reserved_bytes_;
+  RcuCell<ServableSnapshot> snapshot_;
+  std::function<void(const std::string&, ModelVersion, bool)> version_callback_;
 };
 
+// 版本更新分三步: Plan决定要加载的版本, Load可在多个线程并发执行,
+// 全部加载结束后Retain卸载被替换/被删除的版本, 保证切换过程中始终有版本可用
 class ModelLoadPolicy {
  public:
   explicit ModelLoadPolicy(std::unique_ptr<ServableModel> torch_model);
   virtual ~ModelLoadPolicy() = default;
-  virtual void UpdateModel(ModelState *model_state) = 0;
+  // 只做决策, 过滤to_add_list
+  virtual void Plan(ModelState *model_state) = 0;
+  // to_add_list为实际加载成功的版本, 被卸载的版本追加到to_rm_list
+  virtual void Retain(ModelState *model_state) = 0;
+
+  bool Load(ModelVersion model_version);
+  // 在调用线程依次执行Plan, Load, Retain
+  void UpdateModel(ModelState *model_state);
+
+  // 至少有一个版本可用
+  bool Ready();
+  const std::string& GetName();
 
   std::shared_ptr<IServable> GetServableByLabel(const std::string& label);
   std::shared_ptr<IServable> GetServableByVersion(ModelVersion model_version = 0);
@@ -61,7 +101,8 @@ class ModelLoadPolicy {
 class LatestPolicyTorchModel : public ModelLoadPolicy {
  public:
   LatestPolicyTorchModel(std::unique_ptr<ServableModel> torch_model, uint32_t num);
-  void UpdateModel(ModelState *model_state) override;
+  void Plan(ModelState *model_state) override;
+  void Retain(ModelState *model_state) override;
  private:
   const uint32_t num_;
 };
@@ -70,13 +111,15 @@ class LatestPolicyTorchModel : public ModelLoadPolicy {
 class AllPolicyTorchModel : public ModelLoadPolicy {
  public:
   using ModelLoadPolicy::ModelLoadPolicy;
-  void UpdateModel(ModelState *model_state) override;
+  void Plan(ModelState *model_state) override;
+  void Retain(ModelState *model_state) override;
 };
 // 保留指定版本
 class SpecificPolicyTorchModel : public ModelLoadPolicy {
  public:
   SpecificPolicyTorchModel(std::unique_ptr<ServableModel> torch_model, const std::unordered_set<ModelVersion>& versions);
-  void UpdateModel(ModelState *model_state) override;
+  void Plan(ModelState *model_state) override;
+  void Retain(ModelState *model_state) override;
 
  private:
   const std::unordered_set<ModelVersion> specific_version_;
@@ -0,0 +1,346 @@
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+#include <grpcpp/grpcpp.h>
+#include <absl/time/clock.h>
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_split.h>
+#include <absl/strings/str_format.h>
+#include <prometheus/registry.h>
+
+#include "server_config.pb.h"
+#include "kserve_predict_v2.pb.h"
+#include "kserve_predict_v2.grpc.pb.h"
+#include "model/model_manager.h"
+#include "model/predict_context.h"
+#include "servables/servable.h"
+#include "service/metrics.h"
+#include "utils/mock_request.h"
+#include "utils/pbtext.h"
+
+DEFINE_string(mode, "grpc", "grpc: 通过ModelInfer压测服务; local: 进程内直接调用servable, 排除grpc开销");
+DEFINE_string(server, "127.0.0.1:8080", "grpc模式的服务地址");
+DEFINE_string(config, "config/server.txt", "local模式的服务配置");
+DEFINE_string(model, "MODEL_1", "");
+DEFINE_uint64(model_version, 0, "0为最新版本");
+DEFINE_string(input, "../example/request_2.json", "请求文件, .bin为序列化的ModelInferRequest, 其余为json格式的MockRequest");
+DEFINE_string(input_name, "img", "json请求的输入名");
+DEFINE_string(concurrency, "1,4,16", "固定并发数, 逗号分隔依次压测");
+DEFINE_string(qps, "", "固定QPS, 逗号分隔依次压测; 非空时忽略concurrency");
+DEFINE_int32(qps_threads, 4, "固定QPS时的发送线程数; local模式且servable同步执行时决定最大并发");
+DEFINE_int32(warmup, 2, "每轮预热秒数, 不计入结果");
+DEFINE_int32(duration, 10, "每轮压测秒数");
+DEFINE_string(max_batch_size, "", "local模式扫描的批处理参数, 逗号分隔, 为空时使用配置中的值");
+DEFINE_string(batch_timeout_micros, "", "");
+DEFINE_string(num_batch_threads, "", "");
+DEFINE_string(output, "", "结果追加写入的文件, 每轮一行json; 为空时输出到标准输出");
+
+namespace {
+
+using torch::serving::PredictStatus;
+
+std::vector<int64_t> ParseList(const std::string& value) {
+  std::vector<int64_t> result;
+  for (auto item : absl::StrSplit(value, ',', absl::SkipWhitespace())) {
+    int64_t number;
+    if (!absl::SimpleAtoi(item, &number)) {
+      LOG(WARNING) << "skip invalid number " << item;
+      continue;
+    }
+    result.push_back(number);
+  }
+  return result;
+}
+
+// 发送单个请求, 完成时回调是否成功; 回调可能在调用线程内执行
+class Target {
+ public:
+  virtual ~Target() = default;
+  virtual void Send(const inference::ModelInferRequest& request, std::function<void(bool)> done) = 0;
+};
+
+class GrpcTarget : public Target {
+ public:
+  explicit GrpcTarget(const std::string& server)
+    : stub_(inference::GRPCInferenceService::NewStub(grpc::CreateChannel(server, grpc::InsecureChannelCredentials()))) {
+
+  }
+  void Send(const inference::ModelInferRequest& request, std::function<void(bool)> done) override {
+    auto call = std::make_shared<Call>();
+    stub_->async()->ModelInfer(&call->context, &request, &call->response, [call, done = std::move(done)](grpc::Status status) {
+      if (!status.ok()) {
+        LOG_EVERY_N(WARNING, 1000) << "predict error: " << status.error_message();
+      }
+      done(status.ok());
+    });
+  }
+
+ private:
+  struct Call {
+    grpc::ClientContext context;
+    inference::ModelInferResponse response;
+  };
+  std::unique_ptr<inference::GRPCInferenceService::Stub> stub_;
+};
+
+class LocalTarget : public Target {
+ public:
+  explicit LocalTarget(const std::shared_ptr<torch::serving::ModelManager>& model_manager) : model_manager_(model_manager) {
+
+  }
+  void Send(const inference::ModelInferRequest& request, std::function<void(bool)> done) override {
+    auto servable = model_manager_->GetServableByVersion(request.model_name(), request.model_version());
+    if (servable == nullptr) {
+      done(false);
+      return;
+    }
+    auto response = std::make_shared<inference::ModelInferResponse>();
+    auto context = std::make_shared<torch::serving::PredictContext>(&request, response.get());
+    servable->PredictAsync(context, [servable, response, context, done = std::move(done)](const PredictStatus& status) {
+      if (!status.Ok()) {
+        LOG_EVERY_N(WARNING, 1000) << "predict error: " << status.Message();
+      }
+      done(status.Ok());
+    });
+  }
+
+ private:
+  std::shared_ptr<torch::serving::ModelManager> model_manager_;
+};
+
+struct RunResult {
+  std::vector<int64_t> latencies;  // us
+  uint64_t errors{0};
+};
+
+// 闭环: concurrency个线程各自发送, 上一个请求完成后再发下一个
+RunResult RunConcurrency(Target* target, const inference::ModelInferRequest& request, int64_t concurrency) {
+  const auto measure_begin = absl::Now() + absl::Seconds(FLAGS_warmup);
+  const auto end = measure_begin + absl::Seconds(FLAGS_duration);
+  std::vector<RunResult> thread_results(concurrency);
+  std::vector<std::thread> threads;
+  for (int64_t i = 0; i < concurrency; ++i) {
+    threads.emplace_back([&, i]() {
+      auto& result = thread_results[i];
+      while (true) {
+        auto begin = absl::Now();
+        if (begin >= end) {
+          break;
+        }
+        std::promise<bool> promise;
+        auto future = promise.get_future();
+        target->Send(request, [&promise](bool ok) { promise.set_value(ok); });
+        bool ok = future.get();
+        if (begin < measure_begin) {
+          continue;
+        }
+        if (ok) {
+          result.latencies.push_back(absl::ToInt64Microseconds(absl::Now() - begin));
+        } else {
+          ++result.errors;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  RunResult result;
+  for (auto& item : thread_results) {
+    result.latencies.insert(result.latencies.end(), item.latencies.begin(), item.latencies.end());
+    result.errors += item.errors;
+  }
+  return result;
+}
+
+// 开环: 按固定间隔发送, 延迟从计划发送时间算起, 服务变慢时不会降低压力
+RunResult RunQps(Target* target, const inference::ModelInferRequest& request, int64_t qps) {
+  const int threads_num = std::max(FLAGS_qps_threads, 1);
+  const auto start = absl::Now();
+  const auto measure_begin = start + absl::Seconds(FLAGS_warmup);
+  const auto end = measure_begin + absl::Seconds(FLAGS_duration);
+  const auto interval = absl::Seconds(1) / static_cast<double>(qps);
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  int64_t pending = 0;
+  RunResult result;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < threads_num; ++i) {
+    threads.emplace_back([&, i]() {
+      for (int64_t k = i; ; k += threads_num) {
+        auto schedule = start + interval * k;
+        if (schedule >= end) {
+          break;
+        }
+        auto now = absl::Now();
+        if (schedule > now) {
+          absl::SleepFor(schedule - now);
+        }
+        {
+          std::lock_guard lock(mutex);
+          ++pending;
+        }
+        target->Send(request, [&, schedule](bool ok) {
+          auto latency = absl::ToInt64Microseconds(absl::Now() - schedule);
+          std::lock_guard lock(mutex);
+          if (schedule >= measure_begin) {
+            if (ok) {
+              result.latencies.push_back(latency);
+            } else {
+              ++result.errors;
+            }
+          }
+          --pending;
+          cond.notify_all();
+        });
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::unique_lock lock(mutex);
+  cond.wait(lock, [&]() { return pending == 0; });
+  return result;
+}
+
+int64_t Percentile(const std::vector<int64_t>& sorted, double percent) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  auto index = static_cast<size_t>(percent * (sorted.size() - 1));
+  return sorted[index];
+}
+
+void Report(const std::string& setting, RunResult result) {
+  auto& latencies = result.latencies;
+  std::sort(latencies.begin(), latencies.end());
+  double sum = 0;
+  for (const auto& item : latencies) {
+    sum += item;
+  }
+  auto line = absl::StrFormat(
+      R"({"mode":"%s","model":"%s",%s,"requests":%d,"errors":%d,"qps":%.1f,"mean_us":%.1f,"p50_us":%d,"p90_us":%d,"p99_us":%d,"p999_us":%d,"max_us":%d})",
+      FLAGS_mode, FLAGS_model, setting, latencies.size(), result.errors,
+      latencies.size() / static_cast<double>(FLAGS_duration),
+      latencies.empty() ? 0 : sum / latencies.size(),
+      Percentile(latencies, 0.5), Percentile(latencies, 0.9), Percentile(latencies, 0.99), Percentile(latencies, 0.999),
+      latencies.empty() ? 0 : latencies.back());
+  if (FLAGS_output.empty()) {
+    std::cout << line << std::endl;
+  } else {
+    std::ofstream output(FLAGS_output, std::ios::app);
+    output << line << std::endl;
+  }
+}
+
+// 对当前target依次执行所有压力配置
+void RunAll(Target* target, const inference::ModelInferRequest& request, const std::string& batch_setting) {
+  auto qps_list = ParseList(FLAGS_qps);
+  if (!qps_list.empty()) {
+    for (auto qps : qps_list) {
+      if (qps <= 0) {
+        continue;
+      }
+      auto result = RunQps(target, request, qps);
+      Report(absl::StrFormat(R"("target_qps":%d,%s)", qps, batch_setting), std::move(result));
+    }
+    return;
+  }
+  for (auto concurrency : ParseList(FLAGS_concurrency)) {
+    if (concurrency <= 0) {
+      continue;
+    }
+    auto result = RunConcurrency(target, request, concurrency);
+    Report(absl::StrFormat(R"("concurrency":%d,%s)", concurrency, batch_setting), std::move(result));
+  }
+}
+
+// 扫描的取值为空时保留配置中的值
+std::vector<int64_t> SweepValues(const std::string& flag, uint32_t current) {
+  auto values = ParseList(flag);
+  if (values.empty()) {
+    values.push_back(current);
+  }
+  return values;
+}
+
+int RunLocal(const inference::ModelInferRequest& request) {
+  torch::serving::ServerConfig server_config;
+  if (!torch::serving::ReadPbText(FLAGS_config, &server_config)) {
+    LOG(WARNING) << "parse " << FLAGS_config << " error";
+    return -1;
+  }
+  auto& batch_config = server_config.model_manager_config().batch_config();
+  for (auto max_batch_size : SweepValues(FLAGS_max_batch_size, batch_config.max_batch_size())) {
+    for (auto timeout : SweepValues(FLAGS_batch_timeout_micros, batch_config.batch_timeout_micros())) {
+      for (auto threads : SweepValues(FLAGS_num_batch_threads, batch_config.num_batch_threads())) {
+        auto config = server_config.model_manager_config();
+        auto* sweep_config = config.mutable_batch_config();
+        sweep_config->set_max_batch_size(max_batch_size);
+        sweep_config->set_batch_timeout_micros(timeout);
+        sweep_config->set_num_batch_threads(threads);
+        // 允许的批次大小需要以max_batch_size结尾
+        auto* allowed = sweep_config->mutable_allowed_batch_sizes();
+        allowed->erase(std::remove_if(allowed->begin(), allowed->end(), [&](uint32_t size) {
+          return size >= max_batch_size;
+        }), allowed->end());
+        if (!allowed->empty()) {
+          allowed->Add(max_batch_size);
+        }
+
+        auto metrics = std::make_shared<torch::serving::Metrics>(std::make_shared<prometheus::Registry>());
+        auto model_manager = std::make_shared<torch::serving::ModelManager>();
+        config.set_async_startup(false);
+        if (!model_manager->Init(config, metrics)) {
+          LOG(WARNING) << "model manager init error";
+          return -1;
+        }
+        LocalTarget target(model_manager);
+        auto batch_setting = absl::StrFormat(R"("batch":%s,"max_batch_size":%d,"batch_timeout_micros":%d,"num_batch_threads":%d)",
+                                             sweep_config->enable() ? "true" : "false", max_batch_size, timeout, threads);
+        RunAll(&target, request, batch_setting);
+        model_manager->Stop();
+      }
+    }
+  }
+  return 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  inference::ModelInferRequest request;
+  if (!torch::serving::ReadRequest(FLAGS_input, FLAGS_input_name, &request)) {
+    LOG(WARNING) << "read " << FLAGS_input << " error";
+    return -1;
+  }
+  request.set_model_name(FLAGS_model);
+  if (FLAGS_model_version > 0) {
+    request.set_model_version(FLAGS_model_version);
+  }
+
+  if (FLAGS_mode == "local") {
+    return RunLocal(request);
+  }
+  if (FLAGS_mode != "grpc") {
+    LOG(WARNING) << "unknown mode " << FLAGS_mode;
+    return -1;
+  }
+  // 批处理参数在服务端配置, grpc模式不扫描
+  GrpcTarget target(FLAGS_server);
+  RunAll(&target, request, R"("batch":"server")");
+  return 0;
+}
@@ -0,0 +1,13 @@
+#include "async_factory.h"
+
+namespace torch::serving {
+
+AsyncFactory::AsyncFactory(const std::shared_ptr<ServableFactory>& servable_factory, AsyncServable::Executor executor)
+  : servable_factory_(servable_factory), executor_(std::move(executor)) {
+
+}
+std::shared_ptr<IServable> AsyncFactory::New() {
+  return std::make_shared<AsyncServable>(servable_factory_->New(), executor_);
+}
+
+}
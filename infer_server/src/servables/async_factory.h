@@ -0,0 +1,18 @@
+#pragma once
+
+#include "servables/servable.h"
+#include "servables/async_servable.h"
+
+namespace torch::serving {
+
+class AsyncFactory : public ServableFactory {
+ public:
+  AsyncFactory(const std::shared_ptr<ServableFactory>& servable_factory, AsyncServable::Executor executor);
+  std::shared_ptr<IServable> New() override;
+
+ private:
+  std::shared_ptr<ServableFactory> servable_factory_;
+  AsyncServable::Executor executor_;
+};
+
+}
@@ -0,0 +1,34 @@
+#include "async_servable.h"
+
+namespace torch::serving {
+
+AsyncServable::AsyncServable(const std::shared_ptr<IServable>& servable, Executor executor)
+  : servable_(servable), executor_(std::move(executor)) {
+
+}
+bool AsyncServable::Init(const std::string &path) {
+  return servable_ != nullptr && servable_->Init(path);
+}
+PredictStatus AsyncServable::Predict(const std::shared_ptr<PredictContext> &predict_context) {
+  return servable_->Predict(predict_context);
+}
+void AsyncServable::PredictAsync(const std::shared_ptr<PredictContext> &predict_context, PredictCallback done) {
+  // 任务持有servable, 排队期间版本卸载也不会释放
+  executor_([servable = servable_, predict_context, done = std::move(done)]() {
+    done(servable->Predict(predict_context));
+  });
+}
+PredictStatus AsyncServable::PredictWithoutCheck(const std::shared_ptr<PredictContext> &predict_context) {
+  return servable_->PredictWithoutCheck(predict_context);
+}
+const std::string &AsyncServable::GetLabel() {
+  return servable_->GetLabel();
+}
+const inference::ModelSpec &AsyncServable::GetSpec() {
+  return servable_->GetSpec();
+}
+void AsyncServable::Unload() {
+  servable_->Unload();
+}
+
+}
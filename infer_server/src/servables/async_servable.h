@@ -0,0 +1,26 @@
+#pragma once
+
+#include "servables/servable.h"
+
+namespace torch::serving {
+
+// 非批处理模型的推理交给线程池执行, 不占用grpc回调线程
+class AsyncServable : public IServable {
+ public:
+  using Executor = std::function<void(std::function<void()>)>;
+
+  AsyncServable(const std::shared_ptr<IServable>& servable, Executor executor);
+  bool Init(const std::string &path) override;
+  PredictStatus Predict(const std::shared_ptr<PredictContext> &predict_context) override;
+  void PredictAsync(const std::shared_ptr<PredictContext> &predict_context, PredictCallback done) override;
+  PredictStatus PredictWithoutCheck(const std::shared_ptr<PredictContext> &predict_context) override;
+  const std::string &GetLabel() override;
+  const inference::ModelSpec &GetSpec() override;
+  void Unload() override;
+
+ private:
+  std::shared_ptr<IServable> servable_;
+  const Executor executor_;
+};
+
+}
@@ -0,0 +1,13 @@
+#include "cache_factory.h"
+
+namespace torch::serving {
+
+CacheFactory::CacheFactory(const std::shared_ptr<ServableFactory>& servable_factory, const CacheConfig& config, const CacheCounters& counters)
+  : servable_factory_(servable_factory), config_(config), counters_(counters) {
+
+}
+std::shared_ptr<IServable> CacheFactory::New() {
+  return std::make_shared<CacheServable>(servable_factory_->New(), config_, counters_);
+}
+
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "servables/servable.h"
+#include "servables/cache_servable.h"
+#include "server_config.pb.h"
+
+namespace torch::serving {
+
+class CacheFactory : public ServableFactory {
+ public:
+  CacheFactory(const std::shared_ptr<ServableFactory>& servable_factory, const CacheConfig& config, const CacheCounters& counters);
+  std::shared_ptr<IServable> New() override;
+
+ private:
+  std::shared_ptr<ServableFactory> servable_factory_;
+  CacheConfig config_;
+  CacheCounters counters_;
+};
+
+}
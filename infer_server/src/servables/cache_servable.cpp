@@ -0,0 +1,86 @@
+#include "cache_servable.h"
+
+#include <prometheus/counter.h>
+
+#include "server_config.pb.h"
+#include "kserve_predict_v2.pb.h"
+#include "model/predict_context.h"
+#include "servables/response_cache.h"
+
+namespace torch::serving {
+
+namespace {
+void Increment(prometheus::Counter* counter, double value = 1) {
+  if (counter != nullptr && value > 0) {
+    counter->Increment(value);
+  }
+}
+}
+
+CacheServable::CacheServable(const std::shared_ptr<IServable>& servable, const CacheConfig& config, const CacheCounters& counters)
+  : servable_(servable), cache_(std::make_shared<ResponseCache>(config)), counters_(counters) {
+
+}
+bool CacheServable::Init(const std::string &path) {
+  return servable_ != nullptr && servable_->Init(path);
+}
+bool CacheServable::Lookup(const std::shared_ptr<PredictContext> &predict_context, const CacheKey& key) {
+  auto cached = cache_->Lookup(key);
+  if (cached == nullptr) {
+    Increment(counters_.miss);
+    return false;
+  }
+  Increment(counters_.hit);
+  auto* response = predict_context->response_;
+  response->CopyFrom(*cached);
+  response->set_id(predict_context->request_->id());
+  return true;
+}
+void CacheServable::Insert(const std::shared_ptr<ResponseCache>& cache, const CacheCounters& counters,
+                           const std::shared_ptr<PredictContext> &predict_context, const CacheKey& key, const PredictStatus& status) {
+  if (status.Ok()) {
+    Increment(counters.evict, cache->Insert(key, *predict_context->response_));
+  }
+}
+PredictStatus CacheServable::Predict(const std::shared_ptr<PredictContext> &predict_context) {
+  if (predict_context == nullptr || !predict_context->Check()) {
+    return {PredictStatus::NULLPTR};
+  }
+  auto key = ResponseCache::Key(*predict_context->request_);
+  if (Lookup(predict_context, key)) {
+    return {PredictStatus::OK};
+  }
+  auto status = servable_->Predict(predict_context);
+  Insert(cache_, counters_, predict_context, key, status);
+  return status;
+}
+void CacheServable::PredictAsync(const std::shared_ptr<PredictContext> &predict_context, PredictCallback done) {
+  if (predict_context == nullptr || !predict_context->Check()) {
+    done({PredictStatus::NULLPTR});
+    return;
+  }
+  auto key = ResponseCache::Key(*predict_context->request_);
+  if (Lookup(predict_context, key)) {
+    done({PredictStatus::OK});
+    return;
+  }
+  servable_->PredictAsync(predict_context, [cache = cache_, counters = counters_, predict_context, key, done = std::move(done)](const PredictStatus& status) {
+    Insert(cache, counters, predict_context, key, status);
+    done(status);
+  });
+}
+PredictStatus CacheServable::PredictWithoutCheck(const std::shared_ptr<PredictContext> &predict_context) {
+  return servable_->PredictWithoutCheck(predict_context);
+}
+const std::string &CacheServable::GetLabel() {
+  return servable_->GetLabel();
+}
+const inference::ModelSpec &CacheServable::GetSpec() {
+  return servable_->GetSpec();
+}
+void CacheServable::Unload() {
+  cache_->Close();
+  servable_->Unload();
+}
+
+}
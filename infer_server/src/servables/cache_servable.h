@@ -0,0 +1,45 @@
+#pragma once
+
+#include "servables/servable.h"
+
+namespace prometheus {
+class Counter;
+}
+
+namespace torch::serving {
+class ResponseCache;
+struct CacheKey;
+class CacheConfig;
+
+// 命中次数等统计, 为空时不统计
+struct CacheCounters {
+  prometheus::Counter* hit{nullptr};
+  prometheus::Counter* miss{nullptr};
+  prometheus::Counter* evict{nullptr};
+};
+
+// 在servable之前查询结果缓存, 命中时不再校验和推理
+class CacheServable : public IServable {
+ public:
+  CacheServable(const std::shared_ptr<IServable>& servable, const CacheConfig& config, const CacheCounters& counters);
+  bool Init(const std::string &path) override;
+  PredictStatus Predict(const std::shared_ptr<PredictContext> &predict_context) override;
+  void PredictAsync(const std::shared_ptr<PredictContext> &predict_context, PredictCallback done) override;
+  PredictStatus PredictWithoutCheck(const std::shared_ptr<PredictContext> &predict_context) override;
+  const std::string &GetLabel() override;
+  const inference::ModelSpec &GetSpec() override;
+  void Unload() override;
+
+ private:
+  bool Lookup(const std::shared_ptr<PredictContext> &predict_context, const CacheKey& key);
+  // 异步完成时servable可能已被卸载, 只使用传入的缓存
+  static void Insert(const std::shared_ptr<ResponseCache>& cache, const CacheCounters& counters,
+                     const std::shared_ptr<PredictContext> &predict_context, const CacheKey& key, const PredictStatus& status);
+
+ private:
+  std::shared_ptr<IServable> servable_;
+  std::shared_ptr<ResponseCache> cache_;
+  CacheCounters counters_;
+};
+
+}
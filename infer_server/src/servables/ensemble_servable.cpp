@@ -0,0 +1,376 @@
+#include "ensemble_servable.h"
+
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <string_view>
+#include <unordered_set>
+
+#include <absl/strings/str_cat.h>
+#include <glog/logging.h>
+
+#include "kserve_predict_v2.pb.h"
+#include "model/predict_context.h"
+#include "utils/tensor_utils.h"
+
+namespace torch::serving {
+
+namespace {
+
+// 张量的连续字节, 类型不支持时返回false
+bool ContentsBytes(inference::DataType dtype, const inference::InferTensorContents& contents, std::string* data) {
+  return DispatchDataType(dtype, [&](auto type) {
+    using T = decltype(type);
+    auto& values = GetContents<T>(contents);
+    data->assign(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+  });
+}
+
+}
+
+struct EnsembleServable::Tensor {
+  inference::DataType dtype{inference::DT_INVALID};
+  std::vector<int64_t> shape;
+  std::string data;
+  // 剩余的读取次数, 最后一次读取直接移交数据
+  std::atomic<int> readers{0};
+
+  void Take(std::string* output) {
+    if (readers.load(std::memory_order_acquire) == 1) {
+      output->swap(data);
+      readers.store(0, std::memory_order_relaxed);
+      return;
+    }
+    output->assign(data);
+    readers.fetch_sub(1, std::memory_order_acq_rel);
+  }
+};
+
+struct EnsembleServable::Run {
+  PredictContextPtr context;
+  PredictCallback done;
+  // 开始前创建所有张量, 之后每个张量只由生产它的步骤写入, 依赖它的步骤在写入后才开始
+  std::unordered_map<std::string, std::unique_ptr<Tensor>> tensors;
+  std::unique_ptr<std::atomic<int>[]> deps;
+  std::vector<inference::ModelInferRequest> requests;
+  std::vector<inference::ModelInferResponse> responses;
+  // 执行中的步骤数, 为0时结束
+  std::atomic<int> active{0};
+  std::atomic<bool> failed{false};
+  std::mutex mutex;
+  PredictStatus status;
+};
+
+EnsembleServable::EnsembleServable(const EnsembleConfig& config, Resolver resolver, Executor executor)
+  : config_(config), resolver_(std::move(resolver)), executor_(std::move(executor)) {
+
+}
+
+bool EnsembleServable::Init(const std::string &path) {
+  name_ = path;
+  if (resolver_ == nullptr || config_.steps().empty()) {
+    LOG(WARNING) << name_ << " has no steps";
+    return false;
+  }
+  // 张量名 -> 生产它的步骤
+  std::unordered_map<std::string, int> producers;
+  for (int i = 0; i < config_.steps_size(); ++i) {
+    auto& step = config_.steps(i);
+    if (step.model_name().empty()) {
+      LOG(WARNING) << name_ << " step " << i << " miss model_name";
+      return false;
+    }
+    for (const auto& [output, tensor] : step.output_map()) {
+      if (!producers.emplace(tensor, i).second) {
+        LOG(WARNING) << name_ << " tensor " << tensor << " is produced by more than one step";
+        return false;
+      }
+    }
+  }
+
+  steps_.assign(config_.steps_size(), {});
+  readers_.clear();
+  inputs_.clear();
+  input_set_.clear();
+  std::unordered_set<std::string> consumed;
+  for (int i = 0; i < config_.steps_size(); ++i) {
+    std::unordered_set<int> deps;
+    for (const auto& [input, tensor] : config_.steps(i).input_map()) {
+      ++readers_[tensor];
+      consumed.insert(tensor);
+      auto it = producers.find(tensor);
+      if (it == producers.end()) {
+        // 没有步骤生产的张量来自请求
+        if (readers_[tensor] == 1) {
+          inputs_.push_back(tensor);
+          input_set_.insert(tensor);
+        }
+        continue;
+      }
+      if (it->second == i) {
+        LOG(WARNING) << name_ << " step " << i << " consumes its own output " << tensor;
+        return false;
+      }
+      if (deps.insert(it->second).second) {
+        steps_[it->second].next.push_back(i);
+      }
+    }
+    steps_[i].deps = deps.size();
+  }
+
+  outputs_.assign(config_.outputs().begin(), config_.outputs().end());
+  if (outputs_.empty()) {
+    for (const auto& step : config_.steps()) {
+      for (const auto& [output, tensor] : step.output_map()) {
+        if (consumed.find(tensor) == consumed.end()) {
+          outputs_.push_back(tensor);
+        }
+      }
+    }
+  }
+  for (const auto& output : outputs_) {
+    if (producers.find(output) == producers.end()) {
+      LOG(WARNING) << name_ << " output " << output << " is not produced by any step";
+      return false;
+    }
+    ++readers_[output];
+  }
+
+  // 拓扑排序检查环
+  roots_.clear();
+  std::vector<int> deps(steps_.size());
+  std::vector<int> ready;
+  for (size_t i = 0; i < steps_.size(); ++i) {
+    deps[i] = steps_[i].deps;
+    if (deps[i] == 0) {
+      roots_.push_back(i);
+      ready.push_back(i);
+    }
+  }
+  size_t visited = 0;
+  while (!ready.empty()) {
+    int index = ready.back();
+    ready.pop_back();
+    ++visited;
+    for (auto next : steps_[index].next) {
+      if (--deps[next] == 0) {
+        ready.push_back(next);
+      }
+    }
+  }
+  if (visited != steps_.size()) {
+    LOG(WARNING) << name_ << " steps have a cycle";
+    return false;
+  }
+
+  spec_.Clear();
+  for (const auto& input : inputs_) {
+    spec_.add_feature_specs()->set_name(input);
+  }
+  LOG(INFO) << name_ << " ensemble: " << steps_.size() << " steps, " << inputs_.size() << " inputs, "
+            << outputs_.size() << " outputs";
+  return true;
+}
+
+PredictStatus EnsembleServable::Predict(const std::shared_ptr<PredictContext> &predict_context) {
+  return PredictWithoutCheck(predict_context);
+}
+
+PredictStatus EnsembleServable::PredictWithoutCheck(const std::shared_ptr<PredictContext> &predict_context) {
+  std::promise<PredictStatus> promise;
+  auto fu = promise.get_future();
+  PredictAsync(predict_context, [&promise](const PredictStatus& status) {
+    promise.set_value(status);
+  });
+  return fu.get();
+}
+
+void EnsembleServable::PredictAsync(const std::shared_ptr<PredictContext> &predict_context, PredictCallback done) {
+  if (predict_context == nullptr || !predict_context->Check()) {
+    done({PredictStatus::NULLPTR});
+    return;
+  }
+  auto run = std::make_shared<Run>();
+  run->context = predict_context;
+  run->done = std::move(done);
+  for (const auto& [name, readers] : readers_) {
+    auto tensor = std::make_unique<Tensor>();
+    tensor->readers.store(readers, std::memory_order_relaxed);
+    run->tensors.emplace(name, std::move(tensor));
+  }
+
+  // 请求的输入
+  auto& request = *predict_context->request_;
+  // ensemble不经过FeatureChecker, 按下标读取raw_input_contents前先校验个数
+  if (UseRawOutput(request) && request.raw_input_contents_size() != request.inputs_size()) {
+    run->done({PredictStatus::FEATURE_SIZE_ERROR, absl::StrCat("raw input:", request.raw_input_contents_size(), " and input:", request.inputs_size())});
+    return;
+  }
+  // 只计入ensemble的输入, 每个只能出现一次, 不能覆盖步骤生产的张量
+  std::unordered_set<std::string_view> found;
+  for (int i = 0; i < request.inputs_size(); ++i) {
+    auto& input = request.inputs(i);
+    auto it = run->tensors.find(input.name());
+    if (it == run->tensors.end()) {
+      continue;
+    }
+    if (input_set_.find(input.name()) == input_set_.end()) {
+      run->done({PredictStatus::FEATURE_SIZE_ERROR, absl::StrCat(input.name(), " is produced by a step")});
+      return;
+    }
+    if (!found.insert(input.name()).second) {
+      run->done({PredictStatus::FEATURE_SIZE_ERROR, absl::StrCat(input.name(), " duplicated")});
+      return;
+    }
+    auto& tensor = *it->second;
+    tensor.dtype = input.datatype();
+    tensor.shape.assign(input.shape().begin(), input.shape().end());
+    if (UseRawOutput(request)) {
+      tensor.data = request.raw_input_contents(i);
+    } else if (!ContentsBytes(input.datatype(), input.contents(), &tensor.data)) {
+      run->done({PredictStatus::FEATURE_TYPE_ERROR, absl::StrCat(input.name(), " has unsupported type")});
+      return;
+    }
+  }
+  if (found.size() != inputs_.size()) {
+    run->done({PredictStatus::MISS_FEATURE, absl::StrCat(name_, " needs ", inputs_.size(), " inputs")});
+    return;
+  }
+
+  run->deps = std::make_unique<std::atomic<int>[]>(steps_.size());
+  for (size_t i = 0; i < steps_.size(); ++i) {
+    run->deps[i].store(steps_[i].deps, std::memory_order_relaxed);
+  }
+  run->requests.resize(steps_.size());
+  run->responses.resize(steps_.size());
+  run->active.store(roots_.size());
+  Launch(run, roots_, true);
+}
+
+void EnsembleServable::Launch(const std::shared_ptr<Run>& run, const std::vector<int>& steps, bool run_inline) {
+  // 交给执行线程; 请求线程上最后一个步骤直接执行
+  for (size_t i = 0; i < steps.size(); ++i) {
+    int index = steps[i];
+    if (executor_ != nullptr && (!run_inline || i + 1 < steps.size())) {
+      executor_([this, run, index]() {
+        RunStep(run, index);
+      });
+    } else {
+      RunStep(run, index);
+    }
+  }
+}
+
+void EnsembleServable::RunStep(const std::shared_ptr<Run>& run, int index) {
+  auto& step = config_.steps(index);
+  auto servable = resolver_(step.model_name(), step.model_version());
+  if (servable == nullptr) {
+    StepDone(run, index, {PredictStatus::MISS_SERVABLE, absl::StrCat(step.model_name(), "'s servable not found")});
+    return;
+  }
+  auto& request = run->requests[index];
+  request.set_id(run->context->request_->id());
+  request.set_model_name(step.model_name());
+  for (const auto& [input_name, tensor_name] : step.input_map()) {
+    auto& tensor = *run->tensors.at(tensor_name);
+    auto* input = request.add_inputs();
+    input->set_name(input_name);
+    input->set_datatype(tensor.dtype);
+    input->mutable_shape()->Add(tensor.shape.begin(), tensor.shape.end());
+    tensor.Take(request.add_raw_input_contents());
+  }
+  auto context = std::make_shared<PredictContext>(&request, &run->responses[index]);
+  context->deadline_ = run->context->deadline_;
+  servable->PredictAsync(context, [this, run, index, servable](const PredictStatus& status) {
+    StepDone(run, index, status);
+  });
+}
+
+void EnsembleServable::StepDone(const std::shared_ptr<Run>& run, int index, const PredictStatus& status) {
+  auto& step = config_.steps(index);
+  PredictStatus step_status = status;
+  if (step_status.Ok()) {
+    auto& response = run->responses[index];
+    for (const auto& [output_name, tensor_name] : step.output_map()) {
+      int output_index = 0;
+      while (output_index < response.outputs_size() && response.outputs(output_index).name() != output_name) {
+        ++output_index;
+      }
+      if (output_index == response.outputs_size()) {
+        step_status = {PredictStatus::RESULT_SIZE_ERROR, absl::StrCat(step.model_name(), " has no output ", output_name)};
+        break;
+      }
+      auto& output = response.outputs(output_index);
+      auto& tensor = *run->tensors.at(tensor_name);
+      tensor.dtype = output.datatype();
+      tensor.shape.assign(output.shape().begin(), output.shape().end());
+      if (response.raw_output_contents_size() > 0) {
+        tensor.data.swap(*response.mutable_raw_output_contents(output_index));
+      } else if (!ContentsBytes(output.datatype(), output.contents(), &tensor.data)) {
+        step_status = {PredictStatus::RESULT_TYPE_ERROR, absl::StrCat(output_name, " has unsupported type")};
+        break;
+      }
+    }
+  }
+
+  std::vector<int> ready;
+  if (!step_status.Ok()) {
+    std::lock_guard lock(run->mutex);
+    if (!run->failed.exchange(true)) {
+      run->status = {step_status.Code(), absl::StrCat(step.model_name(), ": ", step_status.Message())};
+    }
+  } else if (!run->failed.load()) {
+    for (auto next : steps_[index].next) {
+      if (run->deps[next].fetch_sub(1) == 1) {
+        ready.push_back(next);
+      }
+    }
+  }
+  // 先计入后续步骤再结束当前步骤, 保证active不会提前归零
+  run->active.fetch_add(ready.size());
+  // 当前线程是上游模型的回调线程(如批处理线程), 后续步骤不在此执行
+  Launch(run, ready, false);
+  if (run->active.fetch_sub(1) == 1) {
+    Finish(run);
+  }
+}
+
+void EnsembleServable::Finish(const std::shared_ptr<Run>& run) {
+  if (run->failed.load()) {
+    std::lock_guard lock(run->mutex);
+    run->done(run->status);
+    return;
+  }
+  auto& request = *run->context->request_;
+  auto* response = run->context->response_;
+  response->set_id(request.id());
+  response->set_model_name(request.model_name());
+  const bool raw_output = UseRawOutput(request);
+  for (const auto& name : outputs_) {
+    auto& tensor = *run->tensors.at(name);
+    auto* output = response->add_outputs();
+    output->set_name(name);
+    output->set_datatype(tensor.dtype);
+    output->mutable_shape()->Add(tensor.shape.begin(), tensor.shape.end());
+    if (raw_output) {
+      // 所有步骤已结束, 直接移交
+      response->add_raw_output_contents()->swap(tensor.data);
+      continue;
+    }
+    DispatchDataType(tensor.dtype, [&](auto type) {
+      using T = decltype(type);
+      AddOutputData<T>(reinterpret_cast<const T*>(tensor.data.data()), tensor.data.size() / sizeof(T), false, response, output);
+    });
+  }
+  run->done({PredictStatus::OK});
+}
+
+const std::string &EnsembleServable::GetLabel() {
+  return label_;
+}
+
+const inference::ModelSpec &EnsembleServable::GetSpec() {
+  return spec_;
+}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "servables/servable.h"
+#include "model_spec.pb.h"
+#include "server_config.pb.h"
+
+namespace torch::serving {
+
+// 进程内按DAG执行多个模型, 每个步骤调用一个已加载模型的servable
+// 步骤间以原始字节传递张量, 不经过protobuf序列化; 只被一个步骤使用的张量直接移交
+// 步骤的servable在每次请求时解析, 跟随模型版本更新
+class EnsembleServable : public IServable {
+ public:
+  // 按模型名和版本查找servable, 找不到时返回nullptr
+  using Resolver = std::function<std::shared_ptr<IServable>(const std::string& name, ModelVersion version)>;
+  // 执行就绪的步骤, 步骤完成后的后续步骤全部交给执行线程, 不占用上游模型的回调线程
+  // 为空时就绪的步骤在当前线程依次执行
+  using Executor = std::function<void(std::function<void()>)>;
+
+  EnsembleServable(const EnsembleConfig& config, Resolver resolver, Executor executor = nullptr);
+
+  // 校验DAG, path为ensemble的名称, 只用于日志
+  bool Init(const std::string &path) override;
+  // 输入由各步骤的servable校验
+  PredictStatus Predict(const std::shared_ptr<PredictContext> &predict_context) override;
+  void PredictAsync(const std::shared_ptr<PredictContext> &predict_context, PredictCallback done) override;
+  PredictStatus PredictWithoutCheck(const std::shared_ptr<PredictContext> &predict_context) override;
+  const std::string &GetLabel() override;
+  // 只包含ensemble输入的名称
+  const inference::ModelSpec &GetSpec() override;
+
+ private:
+  struct Step {
+    // 依赖的步骤数
+    int deps{0};
+    std::vector<int> next;
+  };
+  struct Tensor;
+  struct Run;
+
+  // run_inline为true时最后一个步骤在当前线程执行, 只用于请求线程
+  void Launch(const std::shared_ptr<Run>& run, const std::vector<int>& steps, bool run_inline);
+  void RunStep(const std::shared_ptr<Run>& run, int index);
+  void StepDone(const std::shared_ptr<Run>& run, int index, const PredictStatus& status);
+  void Finish(const std::shared_ptr<Run>& run);
+
+ private:
+  const EnsembleConfig config_;
+  const Resolver resolver_;
+  const Executor executor_;
+  std::string name_;
+  std::vector<Step> steps_;
+  std::vector<int> roots_;
+  std::vector<std::string> inputs_;
+  std::unordered_set<std::string> input_set_;
+  std::vector<std::string> outputs_;
+  // 张量名 -> 读取次数, 包括作为ensemble输出
+  std::unordered_map<std::string, int> readers_;
+  std::string label_;
+  inference::ModelSpec spec_;
+};
+
+}
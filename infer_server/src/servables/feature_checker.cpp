@@ -1,114 +1,138 @@
 #include "feature_checker.h"
-#include <set>
+#include <algorithm>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_join.h>
+#include <absl/container/inlined_vector.h>
 #include "model_spec.pb.h"
 #include "kserve_predict_v2.pb.h"
+#include "utils/tensor_utils.h"
 
 namespace torch::serving {
 
-PredictStatus FeatureChecker::Check(const inference::ModelInferRequest& request, const inference::ModelSpec& model_spec) {
-  // 特征数量
-  std::set<std::string> input_name;
-  std::set<std::string> expect_name;
-  for (const auto& entry : request.inputs()) {
-    input_name.insert(entry.name());
-  }
+void FeatureChecker::Compile(const inference::ModelSpec& model_spec) {
+  features_.clear();
+  name_order_.clear();
+  features_.reserve(model_spec.feature_specs_size());
   for (const auto& entry : model_spec.feature_specs()) {
-    expect_name.insert(entry.name());
+    Feature feature;
+    feature.name = entry.name();
+    feature.dtype = entry.dtype();
+    feature.shape.assign(entry.shape().begin(), entry.shape().end());
+    feature.type_size = DataTypeSize(entry.dtype());
+    features_.push_back(std::move(feature));
   }
-  if (input_name.size() != expect_name.size()) {
-    return {PredictStatus::FEATURE_SIZE_ERROR, absl::StrCat("input:", input_name.size(), " and expect:", expect_name.size())};
+  name_order_.resize(features_.size());
+  for (size_t i = 0; i < features_.size(); ++i) {
+    name_order_[i] = i;
   }
-  // 特征名
-  std::set<std::string> miss_name;
-  std::set_difference(expect_name.begin(), expect_name.end(), input_name.begin(), input_name.end(), std::inserter(miss_name, miss_name.end()));
-  if (!miss_name.empty()) {
-    return {PredictStatus::MISS_FEATURE, absl::StrCat("miss ", absl::StrJoin(miss_name, ","))};
+  std::sort(name_order_.begin(), name_order_.end(), [this](int left, int right) {
+    return features_[left].name < features_[right].name;
+  });
+}
+
+int FeatureChecker::FindFeature(std::string_view name) const {
+  auto it = std::lower_bound(name_order_.begin(), name_order_.end(), name, [this](int index, std::string_view value) {
+    return features_[index].name < value;
+  });
+  if (it == name_order_.end() || features_[*it].name != name) {
+    return -1;
   }
-  std::unordered_map<std::string, const inference::ModelInferRequest::InferInputTensor*> input_map;
-  for (const auto& entry : request.inputs()) {
-    input_map.insert(std::make_pair(entry.name(), &entry));
+  return *it;
+}
+
+PredictStatus FeatureChecker::MissFeature(const inference::ModelInferRequest& request) const {
+  std::vector<std::string> miss_name;
+  for (const auto& feature : features_) {
+    auto it = std::find_if(request.inputs().begin(), request.inputs().end(), [&](const auto& entry) {
+      return entry.name() == feature.name;
+    });
+    if (it == request.inputs().end()) {
+      miss_name.push_back(feature.name);
+    }
   }
+  return {PredictStatus::MISS_FEATURE, absl::StrCat("miss ", absl::StrJoin(miss_name, ","))};
+}
 
+PredictStatus FeatureChecker::Check(const inference::ModelInferRequest& request) const {
+  // 特征数量
+  if (static_cast<size_t>(request.inputs_size()) != features_.size()) {
+    return {PredictStatus::FEATURE_SIZE_ERROR, absl::StrCat("input:", request.inputs_size(), " and expect:", features_.size())};
+  }
+  // raw_input_contents与inputs一一对应
+  if (request.raw_input_contents_size() > 0 && request.raw_input_contents_size() != request.inputs_size()) {
+    return {PredictStatus::FEATURE_SIZE_ERROR, absl::StrCat("raw input:", request.raw_input_contents_size(), " and input:", request.inputs_size())};
+  }
+
+  absl::InlinedVector<bool, 16> seen(features_.size(), false);
   int64_t item_size = -1;
-  for (const auto& feature : model_spec.feature_specs()) {
-    auto it = input_map.find(feature.name());
-    if (it == input_map.end()) {
-      continue;
+  for (int i = 0; i < request.inputs_size(); ++i) {
+    auto& tensor_proto = request.inputs(i);
+    // 特征名
+    int index = FindFeature(tensor_proto.name());
+    if (index < 0) {
+      return MissFeature(request);
+    }
+    if (seen[index]) {
+      return {PredictStatus::FEATURE_SIZE_ERROR, absl::StrCat(tensor_proto.name(), " duplicated")};
     }
-    auto& tensor_proto = it->second;
-    auto status = FeatureCheck(*it->second, feature);
+    seen[index] = true;
+    auto status = FeatureCheck(request, i, features_[index]);
     if (!status.Ok()) {
       return status;
     }
     if (item_size == -1) {
-      item_size = tensor_proto->shape(0);
-    } else if (item_size != tensor_proto->shape(0)) {
+      item_size = tensor_proto.shape(0);
+    } else if (item_size != tensor_proto.shape(0)) {
       return {PredictStatus::ITEM_ERROR, "item size not equal"};
     }
   }
   return {PredictStatus::OK};
 }
-PredictStatus FeatureChecker::FeatureCheck(const inference::ModelInferRequest_InferInputTensor& tensor_proto, const inference::FeatureSpec& feature) {
+
+PredictStatus FeatureChecker::FeatureCheck(const inference::ModelInferRequest& request, int index, const Feature& feature) const {
+  auto& tensor_proto = request.inputs(index);
   // 特征类型
-  if (tensor_proto.datatype() != feature.dtype()) {
+  if (tensor_proto.datatype() != feature.dtype) {
     return {PredictStatus::FEATURE_TYPE_ERROR,
-            absl::StrCat(feature.name(), " input:", inference::DataType_Name(tensor_proto.datatype()), " and expect:", inference::DataType_Name(feature.dtype()))};
+            absl::StrCat(feature.name, " input:", inference::DataType_Name(tensor_proto.datatype()), " and expect:", inference::DataType_Name(feature.dtype))};
   }
   // 特征维度
-  if (tensor_proto.shape_size() != feature.shape_size()+1) {
+  if (static_cast<size_t>(tensor_proto.shape_size()) != feature.shape.size() + 1) {
     return {PredictStatus::SHAPE_ERROR, absl::StrCat(
-        feature.name(), " input:", tensor_proto.shape_size(), " and expect:", feature.shape_size())};
+        feature.name, " input:", tensor_proto.shape_size(), " and expect:", feature.shape.size())};
   }
-  std::vector<int64_t> shape;
-  shape.reserve(feature.shape_size());
-  for (int i=1;i<tensor_proto.shape_size();++i) {
-    shape.push_back(tensor_proto.shape(i));
-  }
-  for (int i=0;i<shape.size();++i) {
-    if (shape[i] != feature.shape(i)) {
+  for (size_t i = 0; i < feature.shape.size(); ++i) {
+    if (feature.shape[i] >= 0 && tensor_proto.shape(i + 1) != feature.shape[i]) {
       return {PredictStatus::SHAPE_ERROR, absl::StrCat(
-          feature.name(), " input:", absl::StrJoin(shape, ","), " and expect:", absl::StrJoin(feature.shape(), ","))};
+          feature.name, " input:", absl::StrJoin(tensor_proto.shape().begin() + 1, tensor_proto.shape().end(), ","),
+          " and expect:", absl::StrJoin(feature.shape, ","))};
     }
   }
-  int64_t expect_size = 1;
-  for (const auto& dim : tensor_proto.shape()) {
-    expect_size *= dim;
+  // 变长维度由请求决定, 合并和拷贝时按形状计算偏移, 需排除负数和溢出
+  int64_t expect_size = 0;
+  if (!CheckedShapeSize(tensor_proto.shape().begin(), tensor_proto.shape().end(), &expect_size)) {
+    return {PredictStatus::SHAPE_ERROR, absl::StrCat(
+        feature.name, " invalid shape:", absl::StrJoin(tensor_proto.shape(), ","))};
   }
   int64_t input_size = 0;
-  switch (tensor_proto.datatype()) {
-    case inference::DT_FLOAT:{
-      input_size = tensor_proto.contents().fp32_contents_size();
-      break;
+  if (request.raw_input_contents_size() > 0) {
+    auto& raw = request.raw_input_contents(index);
+    // 同一请求不能混用raw和typed contents
+    if (tensor_proto.has_contents() && tensor_proto.contents().ByteSizeLong() > 0) {
+      return {PredictStatus::FEATURE_TYPE_ERROR, absl::StrCat(feature.name, " has both raw and typed contents")};
     }
-    case inference::DT_DOUBLE:{
-      input_size = tensor_proto.contents().fp64_contents_size();
-      break;
-    };
-    case inference::DT_INT32: {
-      input_size = tensor_proto.contents().int_contents_size();
-      break;
+    if (feature.type_size == 0 || raw.size() % feature.type_size != 0) {
+      return {PredictStatus::SHAPE_ERROR, absl::StrCat(feature.name, " raw size:", raw.size())};
     }
-    case inference::DT_UINT32: {
-      input_size = tensor_proto.contents().uint_contents_size();
-      break;
-    }
-    case inference::DT_INT64: {
-      input_size = tensor_proto.contents().int64_contents_size();
-      break;
-    }
-    case inference::DT_UINT64: {
-      input_size = tensor_proto.contents().uint64_contents_size();
-      break;
-    }
-    default:break;
+    input_size = raw.size() / feature.type_size;
+  } else {
+    DispatchDataType(tensor_proto.datatype(), [&](auto type) {
+      input_size = GetContents<decltype(type)>(tensor_proto.contents()).size();
+    });
   }
   if (input_size != expect_size) {
-    return {PredictStatus::SHAPE_ERROR, absl::StrCat(feature.name(), " input:", input_size, " and expect:", expect_size)};
+    return {PredictStatus::SHAPE_ERROR, absl::StrCat(feature.name, " input:", input_size, " and expect:", expect_size)};
   }
   return {PredictStatus::OK};
 }
 }
-
-
@@ -1,22 +1,46 @@
 #pragma once
 
+#include <string>
+#include <vector>
+#include <string_view>
+
 #include "model/predict_status.h"
+#include "data_type.pb.h"
 
 namespace inference {
 class ModelInferRequest;
-class ModelInferRequest_InferInputTensor;
 class ModelSpec;
-class FeatureSpec;
 }
 
 namespace torch::serving {
 
+// 请求校验器, 加载模型时根据ModelSpec编译一次, 每个请求只需线性遍历一次输入
 class FeatureChecker {
  public:
-  PredictStatus Check(const inference::ModelInferRequest& request, const inference::ModelSpec& model_spec);
-  PredictStatus FeatureCheck(const inference::ModelInferRequest_InferInputTensor& tensor_proto, const inference::FeatureSpec& feature);
-};
+  void Compile(const inference::ModelSpec& model_spec);
 
-}
+  PredictStatus Check(const inference::ModelInferRequest& request) const;
+
+ private:
+  struct Feature {
+    std::string name;
+    inference::DataType dtype;
+    // 不含item维, 小于0表示任意长度
+    std::vector<int64_t> shape;
+    size_t type_size;
+  };
+
+  PredictStatus FeatureCheck(const inference::ModelInferRequest& request, int index, const Feature& feature) const;
 
+  // 找不到时返回-1
+  int FindFeature(std::string_view name) const;
 
+  PredictStatus MissFeature(const inference::ModelInferRequest& request) const;
+
+ private:
+  std::vector<Feature> features_;
+  // 按特征名排序的下标, 二分查找
+  std::vector<int> name_order_;
+};
+
+}
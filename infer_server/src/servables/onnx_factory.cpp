@@ -3,7 +3,10 @@
 
 namespace torch::serving {
 
+OnnxFactory::OnnxFactory(const OnnxConfig& config, const OnnxEnvConfig& env_config) : config_(config), env_config_(env_config) {
+
+}
 std::shared_ptr<IServable> OnnxFactory::New() {
-  return std::make_shared<OnnxServable>();
+  return std::make_shared<OnnxServable>(config_, env_config_);
 }
 }
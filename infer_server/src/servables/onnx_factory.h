@@ -1,13 +1,18 @@
 #pragma once
 
 #include "servables/servable.h"
+#include "server_config.pb.h"
 
 namespace torch::serving {
 
 class OnnxFactory : public ServableFactory {
  public:
+  OnnxFactory(const OnnxConfig& config, const OnnxEnvConfig& env_config);
   std::shared_ptr<IServable> New() override;
 
+ private:
+  OnnxConfig config_;
+  OnnxEnvConfig env_config_;
 };
 
 
@@ -1,5 +1,8 @@
 #include "onnx_servable.h"
 #include <mutex>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
 
 #include <onnxruntime/core/session/onnxruntime_cxx_api.h>
 #include <absl/types/span.h>
@@ -12,6 +15,7 @@
 #include "kserve_predict_v2.pb.h"
 #include "model/predict_context.h"
 #include "utils/stop_watch.h"
+#include "utils/tensor_utils.h"
 
 namespace torch::serving {
 
@@ -20,6 +24,13 @@ struct OnnxServable::GlobalEnv {
   std::unique_ptr<Ort::SessionOptions> session_options;
 };
 
+struct OnnxServable::Binding {
+  explicit Binding(Ort::Session& session) : io_binding(session) { }
+  Ort::IoBinding io_binding;
+  // 预分配的输出, 输出形状不固定时由onnxruntime分配
+  std::vector<Ort::Value> outputs;
+};
+
 struct OnnxServable::Module {
   std::shared_ptr<Ort::Session> session_;
   inference::ModelSpec spec;
@@ -29,18 +40,62 @@ struct OnnxServable::Module {
   Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
   std::vector<Ort::AllocatedStringPtr> input_names;
   std::vector<Ort::AllocatedStringPtr> output_names;
+
+  // 加载时生成, 每次预测复用
+  std::vector<const char*> input_name_list;
+  std::vector<const char*> output_name_list;
+  // 按输入名排序的下标, 用于把请求的输入映射到session的输入
+  std::vector<int> input_order;
+  std::vector<ONNXTensorElementDataType> output_types;
+  // 模型声明的输出形状, 小于0的维度为动态维度
+  std::vector<std::vector<int64_t>> output_shapes;
+
+  std::mutex binding_mutex;
+  std::unordered_map<int64_t, std::vector<BindingPtr>> binding_pool;
 };
 
+namespace {
+
+// 缓存的批次大小个数及每个批次大小缓存的IoBinding个数
+constexpr size_t kMaxBindingBucket = 32;
+constexpr size_t kMaxBindingPerBucket = 8;
+
+inference::DataType ToDataType(ONNXTensorElementDataType type) {
+  switch (type) {
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT: return inference::DT_FLOAT;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE: return inference::DT_DOUBLE;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32: return inference::DT_INT32;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64: return inference::DT_INT64;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32: return inference::DT_UINT32;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64: return inference::DT_UINT64;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL: return inference::DT_BOOL;
+    default: return inference::DT_INVALID;
+  }
+}
+
+}
 
 std::shared_ptr<OnnxServable::GlobalEnv> OnnxServable::global_env_ = nullptr;
 
+OnnxServable::OnnxServable(const OnnxConfig& config, const OnnxEnvConfig& env_config) : config_(config), env_config_(env_config) {
+
+}
+
 bool OnnxServable::Init(const std::string &path) {
   StopWatch stop_watch;
   static std::once_flag flag;
-  std::call_once(flag, [](){
+  std::call_once(flag, [this](){
     auto env = std::make_shared<OnnxServable::GlobalEnv>();
     try {
-      env->env = std::make_unique<Ort::Env>(ORT_LOGGING_LEVEL_WARNING, "kserve");
+      if (env_config_.use_global_thread_pools()) {
+        Ort::ThreadingOptions threading_options;
+        threading_options.SetGlobalIntraOpNumThreads(env_config_.global_intra_op_num_threads());
+        threading_options.SetGlobalInterOpNumThreads(env_config_.global_inter_op_num_threads());
+        env->env = std::make_unique<Ort::Env>(threading_options, ORT_LOGGING_LEVEL_WARNING, "kserve");
+        LOG(INFO) << "onnx use global thread pools: " << env_config_.ShortDebugString();
+      } else {
+        env->env = std::make_unique<Ort::Env>(ORT_LOGGING_LEVEL_WARNING, "kserve");
+      }
       env->session_options = std::make_unique<Ort::SessionOptions>();
     } catch (const Ort::Exception& e) {
       LOG(WARNING) << "can't create onnx Env: " << e.what();
@@ -63,20 +118,39 @@ bool OnnxServable::Init(const std::string &path) {
   if (!ReadSpec(path, &model->spec)) {
     return false;
   }
-  LOG(INFO) ;
 
-  auto model_file = model_dir / ONNX_MODEL_FILE;
   try {
     auto options = global_env_->session_options->Clone();
+    auto model_file = BuildSessionOptions(path, &options);
     auto& env = *global_env_->env;
-    model->session_ = std::make_shared<Ort::Session>(env, model_file.string().c_str(), options);
-    model->input_names.reserve(model->session_->GetInputCount());
-    model->input_names.reserve(model->session_->GetOutputCount());
-    for (size_t i=0; i< model->session_->GetInputCount(); ++i) {
+    model->session_ = std::make_shared<Ort::Session>(env, model_file.c_str(), options);
+    if (config_.save_optimized_model() && model_file == (model_dir / ONNX_MODEL_FILE).string()) {
+      // 写完后再改名, 避免重启时读到不完整的文件
+      boost::system::error_code ec;
+      boost::filesystem::rename(model_dir / (std::string(ONNX_OPTIMIZED_MODEL_FILE) + ".tmp"), model_dir / ONNX_OPTIMIZED_MODEL_FILE, ec);
+      if (ec) {
+        LOG(WARNING) << "save optimized model error: " << ec.message();
+      }
+    }
+    const size_t input_count = model->session_->GetInputCount();
+    const size_t output_count = model->session_->GetOutputCount();
+    model->input_names.reserve(input_count);
+    model->output_names.reserve(output_count);
+    for (size_t i=0; i<input_count; ++i) {
       model->input_names.push_back(model->session_->GetInputNameAllocated(i, model->allocator));
+      model->input_name_list.push_back(model->input_names.back().get());
+      model->input_order.push_back(i);
     }
-    for (size_t i=0; i<model->session_->GetOutputCount(); ++i) {
+    std::sort(model->input_order.begin(), model->input_order.end(), [&](int left, int right) {
+      return std::strcmp(model->input_name_list[left], model->input_name_list[right]) < 0;
+    });
+    for (size_t i=0; i<output_count; ++i) {
       model->output_names.push_back(model->session_->GetOutputNameAllocated(i, model->allocator));
+      model->output_name_list.push_back(model->output_names.back().get());
+      auto type_info = model->session_->GetOutputTypeInfo(i);
+      auto type_shape = type_info.GetTensorTypeAndShapeInfo();
+      model->output_types.push_back(type_shape.GetElementType());
+      model->output_shapes.push_back(type_shape.GetShape());
     }
   } catch (const Ort::Exception& e) {
     LOG(WARNING) << "onnx create servable error: " << e.what();
@@ -95,43 +169,159 @@ bool OnnxServable::Init(const std::string &path) {
   return true;
 }
 PredictStatus OnnxServable::PredictWithoutCheck(const std::shared_ptr<PredictContext> &predict_contexts) {
-  std::vector<Ort::Value> inputs;
-  auto& session = a_module_->session_;
+  StopWatch stop_watch;
+  auto& time_state = predict_contexts->time_state_;
+  time_state.before_pack = stop_watch.Current();
+  auto& request = *predict_contexts->request_;
   std::vector<Ort::Value> input_tensors;
-  std::vector<const char*> input_names;
-  input_names.reserve(a_module_->input_names.size());
-  for (const auto& item : a_module_->input_names) {
-    input_names.push_back(item.get());
-  }
-  std::vector<const char*> output_names;
-  output_names.reserve(a_module_->output_names.size());
-  for (const auto& item : a_module_->output_names) {
-    output_names.push_back(item.get());
-  }
-
   {
-    auto status = BuildInputTensor(*predict_contexts->request_, &input_tensors);
+    auto status = BuildInputTensor(request, &input_tensors);
     if (!status.Ok()) {
       return status;
     }
   }
 
+  // 预分配的输出在拷贝到结果之前不能被其它请求复用
+  const int64_t batch_size = request.inputs_size() > 0 ? request.inputs(0).shape(0) : 0;
+  BindingPtr binding = config_.use_io_binding() ? AcquireBinding(batch_size) : nullptr;
+  time_state.before_predict = stop_watch.Current();
   std::vector<Ort::Value> result;
+  auto status = binding != nullptr ? RunWithBinding(binding.get(), input_tensors, &result) : Run(input_tensors, &result);
+  time_state.before_unpack = stop_watch.Current();
+  if (status.Ok()) {
+    status = ParseOutputTensor(result, UseRawOutput(request), predict_contexts->response_);
+  }
+  result.clear();
+  if (binding != nullptr) {
+    ReleaseBinding(batch_size, std::move(binding));
+  }
+  if (status.Ok()) {
+    auto* response = predict_contexts->response_;
+    response->set_id(request.id());
+    response->set_model_name(request.model_name());
+    response->set_model_version(a_module_->version);
+  }
+  time_state.after_unpack = stop_watch.Current();
+  return status;
+}
+PredictStatus OnnxServable::Run(std::vector<Ort::Value>& input_tensors, std::vector<Ort::Value>* output_tensors) {
+  auto& module = *a_module_;
   try {
-    result = session->Run(Ort::RunOptions{nullptr}, input_names.data(), input_tensors.data(), input_tensors.size(), output_names.data(), output_names.size());
+    *output_tensors = module.session_->Run(Ort::RunOptions{nullptr}, module.input_name_list.data(), input_tensors.data(), input_tensors.size(),
+                                           module.output_name_list.data(), module.output_name_list.size());
   } catch (const Ort::Exception& e) {
     LOG(WARNING) << e.what();
     return {PredictStatus::Status::PREDICT_ERROR, e.what()};
   }
-
-  {
-    auto status = ParseOutputTensor(result, predict_contexts->response_);
-    if (!status.Ok()) {
-      return status;
+  return {PredictStatus::OK};
+}
+PredictStatus OnnxServable::RunWithBinding(Binding* binding, std::vector<Ort::Value>& input_tensors, std::vector<Ort::Value>* output_tensors) {
+  auto& module = *a_module_;
+  try {
+    for (size_t i = 0; i < input_tensors.size(); ++i) {
+      binding->io_binding.BindInput(module.input_name_list[i], input_tensors[i]);
     }
+    module.session_->Run(Ort::RunOptions{nullptr}, binding->io_binding);
+    *output_tensors = binding->io_binding.GetOutputValues();
+  } catch (const Ort::Exception& e) {
+    LOG(WARNING) << e.what();
+    return {PredictStatus::Status::PREDICT_ERROR, e.what()};
   }
   return {PredictStatus::OK};
 }
+OnnxServable::BindingPtr OnnxServable::AcquireBinding(int64_t batch_size) {
+  auto& module = *a_module_;
+  {
+    std::unique_lock lock(module.binding_mutex);
+    auto it = module.binding_pool.find(batch_size);
+    if (it != module.binding_pool.end() && !it->second.empty()) {
+      auto binding = std::move(it->second.back());
+      it->second.pop_back();
+      return binding;
+    }
+  }
+  BindingPtr binding;
+  try {
+    binding = std::make_unique<Binding>(*module.session_);
+    binding->outputs.reserve(module.output_name_list.size());
+    for (size_t i = 0; i < module.output_name_list.size(); ++i) {
+      // 只有批次维度是动态的输出可以预分配
+      auto shape = module.output_shapes[i];
+      if (!shape.empty() && shape[0] < 0) {
+        shape[0] = batch_size;
+      }
+      bool fixed = std::all_of(shape.begin(), shape.end(), [](int64_t dim) { return dim >= 0; });
+      if (fixed) {
+        binding->outputs.push_back(Ort::Value::CreateTensor(module.allocator, shape.data(), shape.size(), module.output_types[i]));
+        binding->io_binding.BindOutput(module.output_name_list[i], binding->outputs.back());
+      } else {
+        binding->io_binding.BindOutput(module.output_name_list[i], module.memoryInfo);
+      }
+    }
+  } catch (const Ort::Exception& e) {
+    LOG(WARNING) << "create io binding error: " << e.what();
+    return nullptr;
+  }
+  return binding;
+}
+void OnnxServable::ReleaseBinding(int64_t batch_size, BindingPtr binding) {
+  auto& module = *a_module_;
+  binding->io_binding.ClearBoundInputs();
+  std::unique_lock lock(module.binding_mutex);
+  auto it = module.binding_pool.find(batch_size);
+  if (it == module.binding_pool.end()) {
+    if (module.binding_pool.size() >= kMaxBindingBucket) {
+      return;
+    }
+    it = module.binding_pool.emplace(batch_size, std::vector<BindingPtr>()).first;
+  }
+  if (it->second.size() < kMaxBindingPerBucket) {
+    it->second.push_back(std::move(binding));
+  }
+}
+std::string OnnxServable::BuildSessionOptions(const std::string& path, Ort::SessionOptions* options) {
+  boost::filesystem::path model_dir(path);
+  if (env_config_.use_global_thread_pools()) {
+    options->DisablePerSessionThreads();
+  } else {
+    if (config_.intra_op_num_threads() > 0) {
+      options->SetIntraOpNumThreads(config_.intra_op_num_threads());
+    }
+    if (config_.inter_op_num_threads() > 0) {
+      options->SetInterOpNumThreads(config_.inter_op_num_threads());
+    }
+  }
+  options->SetExecutionMode(config_.parallel_execution() ? ORT_PARALLEL : ORT_SEQUENTIAL);
+  if (config_.disable_mem_pattern()) {
+    options->DisableMemPattern();
+  }
+  if (config_.disable_cpu_mem_arena()) {
+    options->DisableCpuMemArena();
+  }
+
+  GraphOptimizationLevel level = ORT_ENABLE_ALL;
+  switch (config_.optimization_level()) {
+    case OnnxConfig::DISABLE_ALL: level = ORT_DISABLE_ALL; break;
+    case OnnxConfig::ENABLE_BASIC: level = ORT_ENABLE_BASIC; break;
+    case OnnxConfig::ENABLE_EXTENDED: level = ORT_ENABLE_EXTENDED; break;
+    default: break;
+  }
+  if (!config_.save_optimized_model()) {
+    options->SetGraphOptimizationLevel(level);
+    return (model_dir / ONNX_MODEL_FILE).string();
+  }
+  // 已有优化后的模型时不再做图优化; 优化结果与机器相关, 换机器部署时需删除该文件
+  auto optimized_file = model_dir / ONNX_OPTIMIZED_MODEL_FILE;
+  if (boost::filesystem::exists(optimized_file)) {
+    options->SetGraphOptimizationLevel(ORT_DISABLE_ALL);
+    LOG(INFO) << "load optimized model " << optimized_file.string();
+    return optimized_file.string();
+  }
+  options->SetGraphOptimizationLevel(level);
+  auto tmp_file = model_dir / (std::string(ONNX_OPTIMIZED_MODEL_FILE) + ".tmp");
+  options->SetOptimizedModelFilePath(tmp_file.string().c_str());
+  return (model_dir / ONNX_MODEL_FILE).string();
+}
 const std::string &OnnxServable::GetLabel() {
   return a_module_->label;
 }
@@ -140,140 +330,64 @@ const inference::ModelSpec &OnnxServable::GetSpec() {
 }
 PredictStatus OnnxServable::BuildInputTensor(const inference::ModelInferRequest &request,
                                              std::vector<Ort::Value> *input_tensors) {
-  std::unordered_map<std::string, const inference::ModelInferRequest::InferInputTensor*> tensor_map;
-  for (const auto& item : request.inputs()) {
-    tensor_map[item.name()] = &item;
+  auto& module = *a_module_;
+  const size_t input_count = module.input_name_list.size();
+  // session输入下标 -> 请求输入下标
+  std::vector<int> request_index(input_count, -1);
+  for (int i = 0; i < request.inputs_size(); ++i) {
+    auto& name = request.inputs(i).name();
+    auto it = std::lower_bound(module.input_order.begin(), module.input_order.end(), name, [&](int index, const std::string& value) {
+      return value.compare(module.input_name_list[index]) > 0;
+    });
+    if (it != module.input_order.end() && name == module.input_name_list[*it]) {
+      request_index[*it] = i;
+    }
   }
-  const size_t input_count = a_module_->session_->GetInputCount();
+  input_tensors->reserve(input_count);
   for (size_t i=0;i< input_count; ++i) {
-    auto& name = a_module_->input_names[i];
-    auto it = tensor_map.find(name.get());
-    if (it == tensor_map.end()) {
-      return {PredictStatus::Status::MISS_FEATURE, absl::StrCat("miss ", name.get())};
+    if (request_index[i] < 0) {
+      return {PredictStatus::Status::MISS_FEATURE, absl::StrCat("miss ", module.input_name_list[i])};
     }
-    auto& input = it->second;
-
-    switch (input->datatype()) {
-      case inference::DT_INVALID: continue;
-      case inference::DT_BOOL: {
-        input_tensors->push_back(Ort::Value::CreateTensor<bool>(
-            a_module_->memoryInfo.GetConst(),
-            const_cast<bool*>(input->contents().bool_contents().data()), input->contents().bool_contents_size(),
-            input->shape().data(), input->shape_size()));
-        break;
-      }
-      case inference::DT_INT32: {
-        input_tensors->push_back(Ort::Value::CreateTensor<int32_t>(
-            a_module_->memoryInfo.GetConst(),
-            const_cast<int32_t*>(input->contents().int_contents().data()), input->contents().int_contents_size(),
-            input->shape().data(), input->shape_size()));
-        break;
-      }
-      case inference::DT_UINT32: {
-        input_tensors->push_back(Ort::Value::CreateTensor<uint32_t>(
-            a_module_->memoryInfo.GetConst(),
-            const_cast<uint32_t*>(input->contents().uint_contents().data()), input->contents().uint_contents_size(),
-            input->shape().data(), input->shape_size()));
-        break;
-      }
-      case inference::DT_INT64: {
-        input_tensors->push_back(Ort::Value::CreateTensor<int64_t>(
-            a_module_->memoryInfo.GetConst(),
-            const_cast<int64_t*>(input->contents().int64_contents().data()), input->contents().int64_contents_size(),
-            input->shape().data(), input->shape_size()));
-        break;
-      }
-      case inference::DT_UINT64: {
-        input_tensors->push_back(Ort::Value::CreateTensor<uint64_t>(
-            a_module_->memoryInfo.GetConst(),
-            const_cast<uint64_t*>(input->contents().uint64_contents().data()), input->contents().uint64_contents_size(),
-            input->shape().data(), input->shape_size()));
-        break;
-      }
-      case inference::DT_FLOAT: {
-        input_tensors->push_back(Ort::Value::CreateTensor<float>(
-            a_module_->memoryInfo.GetConst(),
-            const_cast<float*>(input->contents().fp32_contents().data()), input->contents().fp32_contents_size(),
-            input->shape().data(), input->shape_size()));
-        break;
-      }
-      case inference::DT_DOUBLE: {
-        input_tensors->push_back(Ort::Value::CreateTensor<double>(
-            a_module_->memoryInfo.GetConst(),
-            const_cast<double*>(input->contents().fp64_contents().data()), input->contents().fp64_contents_size(),
-            input->shape().data(), input->shape_size()));
-        break;
-      }
-      default: {
-        return {PredictStatus::FEATURE_TYPE_ERROR, absl::StrFormat("feature:%s; type:%s, not support", name.get(), inference::DataType_Name(input->datatype()).c_str())};
-        break;
-      };
+    auto& input = request.inputs(request_index[i]);
+    // 直接引用请求中的数据(typed contents或raw_input_contents), 不做拷贝
+    bool support = DispatchDataType(input.datatype(), [&](auto type) {
+      using T = decltype(type);
+      auto data = InputData<T>(request, request_index[i]);
+      input_tensors->push_back(Ort::Value::CreateTensor<T>(
+          module.memoryInfo.GetConst(),
+          const_cast<T*>(data.data()), data.size(),
+          input.shape().data(), input.shape_size()));
+    });
+    if (!support) {
+      return {PredictStatus::FEATURE_TYPE_ERROR, absl::StrFormat("feature:%s; type:%s, not support", module.input_name_list[i], inference::DataType_Name(input.datatype()).c_str())};
     }
   }
   return {PredictStatus::OK};
 }
-PredictStatus OnnxServable::ParseOutputTensor(const std::vector<Ort::Value> &output_tensors,
+PredictStatus OnnxServable::ParseOutputTensor(const std::vector<Ort::Value> &output_tensors, bool raw_output,
                                               inference::ModelInferResponse *response) {
-  auto& session = a_module_->session_;
-  const size_t output_count = std::min(output_tensors.size(), a_module_->output_names.size());
+  auto& module = *a_module_;
+  const size_t output_count = std::min(output_tensors.size(), module.output_name_list.size());
 
   for (size_t i=0; i<output_count; ++i) {
-    auto& name = a_module_->output_names[i];
-    auto type_info = session->GetOutputTypeInfo(i);
-    auto type_shape = type_info.GetTensorTypeAndShapeInfo();
     auto& line = output_tensors[i];
+    // 使用运行时的形状, 动态维度(如批次维度)为实际大小
+    auto type_shape = line.GetTensorTypeAndShapeInfo();
     auto* output = response->add_outputs();
-    output->set_name(name.get());
+    output->set_name(module.output_name_list[i]);
     auto shape = type_shape.GetShape();
     output->mutable_shape()->Add(shape.begin(), shape.end());
-    switch (type_shape.GetElementType()) {
-      case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT: {
-        output->set_datatype(inference::DT_FLOAT);
-        absl::Span<float> data(const_cast<float*>(line.GetTensorData<float>()), type_shape.GetElementCount());
-        output->mutable_contents()->mutable_fp32_contents()->Add(data.begin(), data.end());
-        break;
-      }
-      case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE: {
-        output->set_datatype(inference::DT_DOUBLE);
-        absl::Span<double> data(const_cast<double*>(line.GetTensorData<double>()), type_shape.GetElementCount());
-        output->mutable_contents()->mutable_fp64_contents()->Add(data.begin(), data.end());
-        break;
-      }
-      case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32: {
-        output->set_datatype(inference::DT_INT32);
-        absl::Span<int32_t> data(const_cast<int32_t*>(line.GetTensorData<int32_t>()), type_shape.GetElementCount());
-        output->mutable_contents()->mutable_int_contents()->Add(data.begin(), data.end());
-        break;
-      }
-      case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64: {
-        output->set_datatype(inference::DT_INT64);
-        absl::Span<int64_t> data(const_cast<int64_t*>(line.GetTensorData<int64_t>()), type_shape.GetElementCount());
-        output->mutable_contents()->mutable_int64_contents()->Add(data.begin(), data.end());
-        break;
-      }
-      case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32: {
-        output->set_datatype(inference::DT_UINT32);
-        absl::Span<uint32_t> data(const_cast<uint32_t*>(line.GetTensorData<uint32_t>()), type_shape.GetElementCount());
-        output->mutable_contents()->mutable_uint_contents()->Add(data.begin(), data.end());
-        break;
-      }
-      case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64: {
-        output->set_datatype(inference::DT_UINT64);
-        absl::Span<uint64_t> data(const_cast<uint64_t*>(line.GetTensorData<uint64_t>()), type_shape.GetElementCount());
-        output->mutable_contents()->mutable_uint64_contents()->Add(data.begin(), data.end());
-        break;
-      }
-      case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL: {
-        output->set_datatype(inference::DT_BOOL);
-        absl::Span<bool> data(const_cast<bool*>(line.GetTensorData<bool>()), type_shape.GetElementCount());
-        output->mutable_contents()->mutable_bool_contents()->Add(data.begin(), data.end());
-        break;
-      }
-      default: break;
+    output->set_datatype(ToDataType(module.output_types[i]));
+    bool support = DispatchDataType(output->datatype(), [&](auto type) {
+      using T = decltype(type);
+      AddOutputData<T>(line.GetTensorData<T>(), type_shape.GetElementCount(), raw_output, response, output);
+    });
+    // 不支持的类型也占位, 保证raw_output_contents与outputs对齐
+    if (!support && raw_output) {
+      response->add_raw_output_contents();
     }
   }
 
   return {PredictStatus::OK};
 }
 }
-
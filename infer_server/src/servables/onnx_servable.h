@@ -4,27 +4,45 @@
 #include <onnxruntime/core/session/onnxruntime_cxx_api.h>
 #include "servable.h"
 #include "kserve_predict_v2.pb.h"
+#include "server_config.pb.h"
 
 namespace torch::serving {
 
 class OnnxServable : public IServable {
  public:
+  OnnxServable(const OnnxConfig& config, const OnnxEnvConfig& env_config);
   bool Init(const std::string &path) override;
   PredictStatus PredictWithoutCheck(const std::shared_ptr<PredictContext> &predict_contexts) override;
   const std::string &GetLabel() override;
   const inference::ModelSpec &GetSpec() override;
 
  private:
+  struct Binding;
+  using BindingPtr = std::unique_ptr<Binding>;
+
+  // 按session的输入顺序构建输入, 数据直接引用请求
   PredictStatus BuildInputTensor(const inference::ModelInferRequest& request, std::vector<Ort::Value>* input_tensors);
 
-  PredictStatus ParseOutputTensor(const std::vector<Ort::Value>& output_tensors, inference::ModelInferResponse* response);
+  // 按配置生成session选项, 返回实际加载的模型文件
+  std::string BuildSessionOptions(const std::string& path, Ort::SessionOptions* options);
+
+  // raw_output: 结果写入raw_output_contents
+  PredictStatus ParseOutputTensor(const std::vector<Ort::Value>& output_tensors, bool raw_output, inference::ModelInferResponse* response);
+
+  PredictStatus Run(std::vector<Ort::Value>& input_tensors, std::vector<Ort::Value>* output_tensors);
+  PredictStatus RunWithBinding(Binding* binding, std::vector<Ort::Value>& input_tensors, std::vector<Ort::Value>* output_tensors);
+
+  // 同一批次大小的输出形状相同, 按批次大小复用预分配的输出; 创建失败时返回nullptr
+  BindingPtr AcquireBinding(int64_t batch_size);
+  void ReleaseBinding(int64_t batch_size, BindingPtr binding);
 
  private:
   struct GlobalEnv;
   struct Module;
   static std::shared_ptr<GlobalEnv> global_env_;
   std::shared_ptr<Module> a_module_;
+  const OnnxConfig config_;
+  const OnnxEnvConfig env_config_;
 };
 
 }
-
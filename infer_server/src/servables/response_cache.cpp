@@ -0,0 +1,180 @@
+#include "response_cache.h"
+
+#include <absl/hash/hash.h>
+#include <absl/time/clock.h>
+#include <absl/types/span.h>
+#include <absl/strings/string_view.h>
+#include <absl/strings/strip.h>
+
+#include "server_config.pb.h"
+#include "kserve_predict_v2.pb.h"
+#include "utils/tensor_utils.h"
+
+namespace torch::serving {
+
+namespace {
+// max_mb未配置时的默认值
+constexpr uint64_t kDefaultMaxMb = 64;
+
+template<typename T>
+absl::string_view ValueView(const T& value) {
+  return absl::string_view(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// 按顺序输出请求输入编码的各段, 由名称, 类型, 形状, 数据以及结果编码方式组成; 变长部分带长度前缀, 保证编码无歧义
+// 数据直接引用请求中的内存
+template<typename Visitor>
+void VisitEncoding(const inference::ModelInferRequest& request, Visitor&& visit) {
+  const bool raw = UseRawOutput(request);
+  const int inputs_size = request.inputs_size();
+  visit(ValueView(raw));
+  visit(ValueView(inputs_size));
+  auto visit_bytes = [&visit](absl::string_view data) {
+    const uint64_t size = data.size();
+    visit(ValueView(size));
+    visit(data);
+  };
+  for (int i = 0; i < inputs_size; ++i) {
+    auto& input = request.inputs(i);
+    absl::string_view data;
+    std::string serialized;
+    if (raw) {
+      if (i < request.raw_input_contents_size()) {
+        auto& raw_contents = request.raw_input_contents(i);
+        data = absl::string_view(raw_contents.data(), raw_contents.size());
+      }
+    } else if (!DispatchDataType(input.datatype(), [&](auto type) {
+      using T = decltype(type);
+      auto& contents = GetContents<T>(input.contents());
+      data = absl::string_view(reinterpret_cast<const char*>(contents.data()), contents.size() * sizeof(T));
+    })) {
+      // bytes等类型没有连续内存, 按序列化结果计算
+      serialized = input.contents().SerializeAsString();
+      data = serialized;
+    }
+    const int dtype = input.datatype();
+    visit_bytes(input.name());
+    visit(ValueView(dtype));
+    visit_bytes(absl::string_view(reinterpret_cast<const char*>(input.shape().data()), input.shape_size() * sizeof(int64_t)));
+    visit_bytes(data);
+  }
+}
+
+// 按编码的各段计算哈希
+struct EncodingHash {
+  const inference::ModelInferRequest& request;
+
+  template<typename H>
+  friend H AbslHashValue(H state, const EncodingHash& value) {
+    VisitEncoding(value.request, [&state](absl::string_view piece) {
+      state = H::combine(std::move(state), piece);
+    });
+    return state;
+  }
+};
+
+std::string Encode(const inference::ModelInferRequest& request) {
+  std::string output;
+  VisitEncoding(request, [&output](absl::string_view piece) {
+    output.append(piece.data(), piece.size());
+  });
+  return output;
+}
+
+// 逐段与已保存的编码比较, 不生成请求的编码
+bool SameEncoding(absl::string_view encoded, const inference::ModelInferRequest& request) {
+  bool same = true;
+  VisitEncoding(request, [&](absl::string_view piece) {
+    same = same && absl::ConsumePrefix(&encoded, piece);
+  });
+  return same && encoded.empty();
+}
+}
+
+ResponseCache::ResponseCache(const CacheConfig& config)
+  : ttl_(config.ttl_ms() > 0 ? absl::Milliseconds(config.ttl_ms()) : absl::InfiniteDuration()),
+    shard_capacity_(((config.max_mb() > 0 ? config.max_mb() : kDefaultMaxMb) << 20) / kShardNum) {
+
+}
+CacheKey ResponseCache::Key(const inference::ModelInferRequest& request) {
+  return {absl::HashOf(EncodingHash{request}), &request};
+}
+ResponseCache::Shard& ResponseCache::GetShard(uint64_t key) {
+  // 低位用于哈希表, 取高位选择分片
+  return shards_[(key >> 56) % kShardNum];
+}
+std::shared_ptr<const inference::ModelInferResponse> ResponseCache::Lookup(const CacheKey& key) {
+  auto& shard = GetShard(key.hash);
+  std::lock_guard lock(shard.mutex);
+  auto it = shard.index.find(key.hash);
+  if (it == shard.index.end()) {
+    return nullptr;
+  }
+  auto entry = it->second;
+  // 哈希相同但输入不同, 按未命中处理
+  if (!SameEncoding(entry->input, *key.request)) {
+    return nullptr;
+  }
+  if (entry->expire <= absl::Now()) {
+    shard.bytes -= entry->bytes;
+    shard.lru.erase(entry);
+    shard.index.erase(it);
+    return nullptr;
+  }
+  shard.lru.splice(shard.lru.begin(), shard.lru, entry);
+  return entry->response;
+}
+size_t ResponseCache::Insert(const CacheKey& key, const inference::ModelInferResponse& response) {
+  // 在锁外编码和拷贝
+  auto input = Encode(*key.request);
+  const size_t bytes = response.ByteSizeLong() + input.size() + sizeof(Entry);
+  if (bytes > shard_capacity_) {
+    return 0;
+  }
+  auto copy = std::make_shared<const inference::ModelInferResponse>(response);
+  auto expire = absl::Now() + ttl_;
+
+  auto& shard = GetShard(key.hash);
+  std::lock_guard lock(shard.mutex);
+  // 在分片锁内检查, Close清空该分片之后不会再写入
+  if (closed_.load(std::memory_order_relaxed)) {
+    return 0;
+  }
+  auto it = shard.index.find(key.hash);
+  if (it != shard.index.end()) {
+    shard.bytes -= it->second->bytes;
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+  }
+  size_t evicted = 0;
+  while (!shard.lru.empty() && shard.bytes + bytes > shard_capacity_) {
+    auto& last = shard.lru.back();
+    shard.bytes -= last.bytes;
+    shard.index.erase(last.key);
+    shard.lru.pop_back();
+    ++evicted;
+  }
+  shard.lru.push_front({key.hash, std::move(input), expire, bytes, std::move(copy)});
+  shard.index[key.hash] = shard.lru.begin();
+  shard.bytes += bytes;
+  return evicted;
+}
+void ResponseCache::Close() {
+  closed_.store(true, std::memory_order_relaxed);
+  for (auto& shard : shards_) {
+    std::lock_guard lock(shard.mutex);
+    shard.index.clear();
+    shard.lru.clear();
+    shard.bytes = 0;
+  }
+}
+size_t ResponseCache::Bytes() const {
+  size_t bytes = 0;
+  for (auto& shard : shards_) {
+    std::lock_guard lock(shard.mutex);
+    bytes += shard.bytes;
+  }
+  return bytes;
+}
+
+}
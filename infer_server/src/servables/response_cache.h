@@ -0,0 +1,73 @@
+#pragma once
+
+#include <list>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <absl/time/time.h>
+
+namespace inference {
+class ModelInferRequest;
+class ModelInferResponse;
+}
+
+namespace torch::serving {
+class CacheConfig;
+
+// 请求输入的哈希, 计算时不拷贝输入; 命中时与缓存项保存的输入编码比较, 哈希冲突时不会返回其他请求的结果
+// 只引用请求, 使用期间请求需有效
+struct CacheKey {
+  uint64_t hash{0};
+  const inference::ModelInferRequest* request{nullptr};
+};
+
+// 按请求哈希缓存推理结果, 分片LRU, 超过内存上限时淘汰最久未使用的结果
+class ResponseCache {
+ public:
+  explicit ResponseCache(const CacheConfig& config);
+
+  // 由输入名, 类型, 形状, 数据以及结果编码方式计算; 版本由缓存所属的servable区分
+  static CacheKey Key(const inference::ModelInferRequest& request);
+
+  // 未命中或已过期时返回nullptr
+  std::shared_ptr<const inference::ModelInferResponse> Lookup(const CacheKey& key);
+
+  // 返回淘汰的结果个数; 只在写入时生成输入编码, 计入内存
+  size_t Insert(const CacheKey& key, const inference::ModelInferResponse& response);
+
+  // 清空并不再写入, 版本卸载时调用
+  void Close();
+
+  size_t Bytes() const;
+
+ private:
+  struct Entry {
+    uint64_t key;
+    std::string input;
+    absl::Time expire;
+    size_t bytes;
+    std::shared_ptr<const inference::ModelInferResponse> response;
+  };
+  struct Shard {
+    mutable std::mutex mutex;
+    // 头部为最近使用
+    std::list<Entry> lru;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    size_t bytes{0};
+  };
+  static constexpr size_t kShardNum = 16;
+
+  Shard& GetShard(uint64_t key);
+
+ private:
+  std::array<Shard, kShardNum> shards_;
+  const absl::Duration ttl_;
+  const size_t shard_capacity_;
+  std::atomic<bool> closed_{false};
+};
+
+}
@@ -5,6 +5,8 @@
 #include <absl/strings/numbers.h>
 
 #include "model/predict_context.h"
+#include "utils/item_utils.h"
+#include "utils/request_merge.h"
 #include "utils/stop_watch.h"
 #include "utils/pbtext.h"
 #include "model_spec.pb.h"
@@ -12,6 +14,10 @@
 
 namespace torch::serving {
 
+namespace {
+constexpr int kWarmupRounds = 3;
+}
+
 PredictStatus IServable::Check(const std::shared_ptr<PredictContext> &predict_context) {
   if (predict_context == nullptr || !predict_context->Check()) {
     LOG(WARNING) << "module nullptr";
@@ -20,7 +26,7 @@ PredictStatus IServable::Check(const std::shared_ptr<PredictContext> &predict_co
 
   StopWatch stop_watch;
   predict_context->time_state_.before_check = stop_watch.Current();
-  auto status = checker_.Check(*predict_context->request_, GetSpec());
+  auto status = checker_.Check(*predict_context->request_);
   predict_context->time_state_.after_check = stop_watch.Current();
   return status;
 }
@@ -31,6 +37,9 @@ PredictStatus IServable::Predict(const std::shared_ptr<PredictContext> &predict_
   }
   return PredictWithoutCheck(predict_context);
 }
+void IServable::PredictAsync(const std::shared_ptr<PredictContext> &predict_context, PredictCallback done) {
+  done(Predict(predict_context));
+}
 
 
 bool IServable::ReadSpec(const std::string& model_dir, inference::ModelSpec* model_spec) {
@@ -44,8 +53,12 @@ bool IServable::ReadSpec(const std::string& model_dir, inference::ModelSpec* mod
     LOG(WARNING) << "parse " << spec_file.string() << " error";
     return false;
   }
+  CompileChecker(*model_spec);
   return true;
 }
+void IServable::CompileChecker(const inference::ModelSpec& model_spec) {
+  checker_.Compile(model_spec);
+}
 bool IServable::ReadVersion(const std::string& model_dir, int64_t* model_version) {
   if (model_version == nullptr) {
     return false;
@@ -53,7 +66,7 @@ bool IServable::ReadVersion(const std::string& model_dir, int64_t* model_version
   boost::filesystem::path path(model_dir);
   return absl::SimpleAtoi(path.filename().string(), model_version);
 }
-bool IServable::Warmup(const std::string& model_dir) {
+bool IServable::Warmup(const std::string& model_dir, const std::vector<uint32_t>& batch_sizes) {
   boost::filesystem::path path(model_dir);
   auto warmup_file = path / WARMUP_FILE;
   inference::ModelInferRequest request;
@@ -68,6 +81,25 @@ bool IServable::Warmup(const std::string& model_dir) {
     LOG(WARNING) << "warmup error: " << status.Message();
     return false;
   }
+
+  const size_t item_size = std::max<size_t>(CountItem(request), 1);
+  for (const auto& batch_size : batch_sizes) {
+    // 重复预热请求, 不足的部分补零
+    std::vector<const inference::ModelInferRequest*> request_list(std::max<size_t>(batch_size / item_size, 1), &request);
+    inference::ModelInferRequest batch_request;
+    status = MergeRequest(request_list, GetSpec(), batch_size, true, &batch_request);
+    // 预热请求的item数超过批次大小时截断, 保证按批次大小的形状预热
+    TruncateRequest(batch_size, &batch_request);
+    // 多次执行, profiling executor按形状特化后才会生成优化的图
+    for (int i = 0; status.Ok() && i < kWarmupRounds; ++i) {
+      inference::ModelInferResponse batch_response;
+      status = Predict(std::make_shared<PredictContext>(&batch_request, &batch_response));
+    }
+    if (!status.Ok()) {
+      LOG(WARNING) << "warmup batch " << batch_size << " error: " << status.Message();
+      return false;
+    }
+  }
   return true;
 }
 
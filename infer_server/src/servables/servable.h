@@ -2,6 +2,8 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <functional>
 
 #include "model/predict_status.h"
 #include "servables/feature_checker.h"
@@ -14,21 +16,31 @@ class ModelSpec;
 namespace torch::serving {
 class PredictContext;
 
+// 异步预测完成时调用, 每个请求恰好调用一次
+using PredictCallback = std::function<void(const PredictStatus&)>;
+
 class IServable {
  public:
   virtual ~IServable() = default;
   virtual bool Init(const std::string &path) = 0;
   virtual PredictStatus Predict(const std::shared_ptr<PredictContext>& predict_contexts);
+  // 默认在调用线程同步执行后回调; 批处理时由批处理线程回调, 不占用调用线程
+  virtual void PredictAsync(const std::shared_ptr<PredictContext>& predict_context, PredictCallback done);
   virtual PredictStatus PredictWithoutCheck(const std::shared_ptr<PredictContext>& predict_context) = 0;
   virtual const std::string& GetLabel() = 0;
   virtual const inference::ModelSpec& GetSpec() = 0;
+  // 版本卸载时调用, 处理中的请求仍持有servable, 这里只释放缓存等可以提前释放的资源
+  virtual void Unload() {}
 
   PredictStatus Check(const std::shared_ptr<PredictContext>& predict_context);
 
  protected:
+  // 读取ModelSpec并编译请求校验器
   bool ReadSpec(const std::string& model_dir, inference::ModelSpec* model_spec);
+  void CompileChecker(const inference::ModelSpec& model_spec);
   bool ReadVersion(const std::string& model_dir, int64_t* model_version);
-  bool Warmup(const std::string& model_dir);
+  // batch_sizes非空时, 再将预热请求复制补齐到各个批次大小分别预热
+  bool Warmup(const std::string& model_dir, const std::vector<uint32_t>& batch_sizes = {});
  private:
   FeatureChecker checker_;
 };
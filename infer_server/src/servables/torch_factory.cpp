@@ -3,9 +3,12 @@
 
 namespace torch::serving {
 
+TorchFactory::TorchFactory(const TorchConfig& config) : config_(config) {
+
+}
 
 std::shared_ptr<IServable> TorchFactory::New() {
-  return std::shared_ptr<TorchServable>();
+  return std::make_shared<TorchServable>(config_);
 }
 
 }
@@ -1,16 +1,19 @@
 #pragma once
 
 #include "servables/servable.h"
+#include "server_config.pb.h"
 
 namespace torch::serving {
 
 class TorchFactory : public ServableFactory {
  public:
+  explicit TorchFactory(const TorchConfig& config);
 
   std::shared_ptr<IServable> New() override;
+
+ private:
+  TorchConfig config_;
 };
 
 
 }
-
-
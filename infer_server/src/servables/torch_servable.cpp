@@ -2,9 +2,11 @@
 
 #include <numeric>
 #include <fstream>
+#include <mutex>
 
 #include <boost/filesystem.hpp>
 #include <torch/script.h>
+#include <ATen/Parallel.h>
 #include <glog/logging.h>
 #include <absl/types/span.h>
 #include <absl/strings/numbers.h>
@@ -16,11 +18,21 @@
 #include "model/model_define.h"
 #include "utils/stop_watch.h"
 #include "utils/pbtext.h"
+#include "utils/tensor_utils.h"
 #include "model/predict_context.h"
 
 namespace torch::serving {
 
-bool AddFeature(torch::Dict<std::string, torch::Tensor>* dict, const inference::ModelInferRequest::InferInputTensor& proto) {
+template<typename T>
+void InsertFeature(torch::Dict<std::string, torch::Tensor>* dict, const inference::ModelInferRequest& request, int index,
+                   torch::IntArrayRef shape, torch::ScalarType type) {
+  // from_blob不拷贝, 直接引用请求中的数据(typed contents或raw_input_contents)
+  auto data = InputData<T>(request, index);
+  dict->insert(request.inputs(index).name(), torch::from_blob(const_cast<T*>(data.data()), shape, torch::TensorOptions(type)));
+}
+
+bool AddFeature(torch::Dict<std::string, torch::Tensor>* dict, const inference::ModelInferRequest& request, int index) {
+  auto& proto = request.inputs(index);
   std::vector<int64_t> shape;
   shape.reserve(proto.shape_size());
   for (auto& item : proto.shape()) {
@@ -30,33 +42,27 @@ bool AddFeature(torch::Dict<std::string, torch::Tensor>* dict, const inference::
   torch::IntArrayRef shape_ref(shape);
   switch (proto.datatype()) {
     case inference::DT_FLOAT: {
-      auto option = torch::TensorOptions(torch::ScalarType::Float);
-      dict->insert(proto.name(), torch::from_blob(const_cast<float*>(proto.contents().fp32_contents().data()), shape_ref, option));
+      InsertFeature<float>(dict, request, index, shape_ref, torch::ScalarType::Float);
       break;
     }
     case inference::DT_DOUBLE: {
-      auto option = torch::TensorOptions(torch::ScalarType::Double);
-      dict->insert(proto.name(), torch::from_blob(const_cast<double*>(proto.contents().fp64_contents().data()), shape_ref, option));
+      InsertFeature<double>(dict, request, index, shape_ref, torch::ScalarType::Double);
       break;
     }
     case inference::DT_INT32: {
-      auto option = torch::TensorOptions(torch::ScalarType::Int);
-      dict->insert(proto.name(), torch::from_blob(const_cast<int32_t *>(proto.contents().int_contents().data()), shape_ref, option));
+      InsertFeature<int32_t>(dict, request, index, shape_ref, torch::ScalarType::Int);
       break;
     }
     case inference::DT_UINT32: {
-      auto option = torch::TensorOptions(torch::ScalarType::Int);
-      dict->insert(proto.name(), torch::from_blob(const_cast<uint32_t *>(proto.contents().uint_contents().data()), shape_ref, option));
+      InsertFeature<uint32_t>(dict, request, index, shape_ref, torch::ScalarType::Int);
       break;
     }
     case inference::DT_INT64: {
-      auto option = torch::TensorOptions(torch::ScalarType::Long);
-      dict->insert(proto.name(), torch::from_blob(const_cast<int64_t*>(proto.contents().int64_contents().data()), shape_ref, option));
+      InsertFeature<int64_t>(dict, request, index, shape_ref, torch::ScalarType::Long);
       break;
     }
     case inference::DT_UINT64: {
-      auto option = torch::TensorOptions(torch::ScalarType::Long);
-      dict->insert(proto.name(), torch::from_blob(const_cast<uint64_t *>(proto.contents().uint64_contents().data()), shape_ref, option));
+      InsertFeature<uint64_t>(dict, request, index, shape_ref, torch::ScalarType::Long);
       break;
     }
     default: {
@@ -67,39 +73,39 @@ bool AddFeature(torch::Dict<std::string, torch::Tensor>* dict, const inference::
   return true;
 }
 
-bool PackResult(const torch::Tensor& tensor, inference::ModelInferResponse::InferOutputTensor * tensor_proto) {
-  int64_t all_size = 1;
+bool PackResult(const torch::Tensor& tensor, bool raw_output, inference::ModelInferResponse* response,
+                inference::ModelInferResponse::InferOutputTensor* tensor_proto) {
   for (const auto& size : tensor.sizes()) {
     tensor_proto->add_shape(size);
-    all_size *= size;
   }
-  auto* content = tensor_proto->mutable_contents();
-  switch (torch::typeMetaToScalarType(tensor.dtype())) {
+  // 模型输出可能不连续, 按行优先拷贝前需要连续内存
+  auto data = tensor.contiguous();
+  switch (torch::typeMetaToScalarType(data.dtype())) {
     case torch::ScalarType::Int:{
       tensor_proto->set_datatype(inference::DT_INT32);
-      absl::Span<int32_t> line(tensor.data_ptr<int32_t>(), all_size);
-      content->mutable_int_contents()->Add(line.begin(), line.end());
+      AddOutputData<int32_t>(data.data_ptr<int32_t>(), data.numel(), raw_output, response, tensor_proto);
       break;
     }
     case torch::ScalarType::Long:{
       tensor_proto->set_datatype(inference::DT_INT64);
-      absl::Span<int64_t> line(tensor.data_ptr<int64_t>(), all_size);
-      content->mutable_int64_contents()->Add(line.begin(), line.end());
+      AddOutputData<int64_t>(data.data_ptr<int64_t>(), data.numel(), raw_output, response, tensor_proto);
       break;
     }
     case torch::ScalarType::Float:{
       tensor_proto->set_datatype(inference::DT_FLOAT);
-      absl::Span<float> line(tensor.data_ptr<float>(), all_size);
-      content->mutable_fp32_contents()->Add(line.begin(), line.end());
+      AddOutputData<float>(data.data_ptr<float>(), data.numel(), raw_output, response, tensor_proto);
       break;
     }
     case torch::ScalarType::Double:{
       tensor_proto->set_datatype(inference::DT_DOUBLE);
-      absl::Span<double> line(tensor.data_ptr<double>(), all_size);
-      content->mutable_fp64_contents()->Add(line.begin(), line.end());
+      AddOutputData<double>(data.data_ptr<double>(), data.numel(), raw_output, response, tensor_proto);
       break;
     }
     default: {
+      // 占位, 保证raw_output_contents与outputs对齐
+      if (raw_output) {
+        response->add_raw_output_contents();
+      }
       return false;
     }
   }
@@ -108,21 +114,20 @@ bool PackResult(const torch::Tensor& tensor, inference::ModelInferResponse::Infe
 
 torch::serving::PredictStatus PrePredict(const inference::ModelInferRequest& request, std::vector<torch::jit::IValue>* inputs) {
   torch::Dict<std::string, torch::Tensor> features;
-  for (const auto& entry : request.inputs()) {
-    if (!AddFeature(&features, entry)) {
-      return {PredictStatus::FEATURE_TYPE_ERROR, entry.name() + " not support"};
+  for (int i = 0; i < request.inputs_size(); ++i) {
+    if (!AddFeature(&features, request, i)) {
+      return {PredictStatus::FEATURE_TYPE_ERROR, request.inputs(i).name() + " not support"};
     }
   }
   inputs->emplace_back(features);
   return {PredictStatus::OK};
 }
 
-PredictStatus PostPredict(const torch::IValue& result, inference::ModelInferResponse* response) {
+PredictStatus PostPredict(const torch::IValue& result, bool raw_output, inference::ModelInferResponse* response) {
   if (!result.isGenericDict()) {
     LOG(WARNING) << "result not dict";
     return {PredictStatus::RESULT_TYPE_ERROR, "model result is no dict"};
   }
-  auto* result_map = response->mutable_outputs();
   for (const auto& entry : result.toGenericDict()) {
     auto& key = entry.key();
     auto& value = entry.value();
@@ -133,7 +138,7 @@ PredictStatus PostPredict(const torch::IValue& result, inference::ModelInferResp
     auto* line_result = response->add_outputs();
     line_result->set_name(key.toStringRef());
     const auto& tensor = value.toTensor();
-    if (!PackResult(tensor, line_result)) {
+    if (!PackResult(tensor, raw_output, response, line_result)) {
       LOG(WARNING) << "result [" << key.toStringRef() << "] not support";
     }
   }
@@ -147,8 +152,24 @@ struct TorchServable::TorchModule {
   std::string label;
 };
 
+TorchServable::TorchServable(const TorchConfig& config) : config_(config) {
+
+}
+
 bool TorchServable::Init(const std::string& path) {
   StopWatch stop_watch;
+  // 进程级设置, 只执行一次
+  static std::once_flag flag;
+  std::call_once(flag, [this]() {
+    torch::jit::setGraphExecutorOptimize(true);
+    if (config_.inter_op_num_threads() > 0) {
+      try {
+        at::set_num_interop_threads(config_.inter_op_num_threads());
+      } catch (const c10::Error& e) {
+        LOG(WARNING) << "set interop threads error: " << e.msg();
+      }
+    }
+  });
   auto torch_model = std::make_shared<TorchModule>();
   boost::filesystem::path model_dir(path);
 
@@ -166,6 +187,11 @@ bool TorchServable::Init(const std::string& path) {
   try {
     auto a_module = torch::jit::load(model_file.string());
     a_module.eval();
+    if (config_.optimize_for_inference()) {
+      a_module = torch::jit::optimize_for_inference(a_module);
+    } else if (config_.freeze()) {
+      a_module = torch::jit::freeze(a_module);
+    }
     torch_model->a_module = a_module;
   } catch (const c10::Error& e) {
     LOG(WARNING) << "load " << path << " error: " << e.msg();
@@ -173,7 +199,8 @@ bool TorchServable::Init(const std::string& path) {
   }
   torch_module_ = torch_model;
   // 预热
-  if (!Warmup(path)) {
+  std::vector<uint32_t> batch_sizes(config_.warmup_batch_sizes().begin(), config_.warmup_batch_sizes().end());
+  if (!Warmup(path, batch_sizes)) {
     return false;
   }
 
@@ -214,8 +241,11 @@ PredictStatus TorchServable::PredictWithoutCheck(const PredictContextPtr &predic
   }
   predict_context->time_state_.before_predict = stop_watch.Current();
   torch::IValue result;
+  // 对调用线程生效, 与配置一致时不重复设置
+  if (config_.intra_op_num_threads() > 0 && at::get_num_threads() != config_.intra_op_num_threads()) {
+    at::set_num_threads(config_.intra_op_num_threads());
+  }
   try {
-    torch::jit::setGraphExecutorOptimize(true);
     torch::InferenceMode inference_mode(true);
     torch::NoGradGuard no_grad;
     result = torch_module_->a_module.forward(inputs);
@@ -228,7 +258,7 @@ PredictStatus TorchServable::PredictWithoutCheck(const PredictContextPtr &predic
   }
   predict_context->time_state_.before_unpack = stop_watch.Current();
   {
-    auto status = PostPredict(result, response);
+    auto status = PostPredict(result, UseRawOutput(*request), response);
     if (!status.Ok()) {
       return status;
     }
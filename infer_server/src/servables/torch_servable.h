@@ -1,12 +1,14 @@
 #pragma once
 
 #include "servables/servable.h"
+#include "server_config.pb.h"
 
 namespace torch::serving {
 
 
 class TorchServable : public IServable {
  public:
+  explicit TorchServable(const TorchConfig& config = {});
   bool Init(const std::string &path) override;
   PredictStatus PredictWithoutCheck(const std::shared_ptr<PredictContext>& predict_context) override;
 
@@ -16,6 +18,7 @@ class TorchServable : public IServable {
  private:
   struct TorchModule;
   std::shared_ptr<TorchModule> torch_module_;
+  const TorchConfig config_;
 };
 
 }
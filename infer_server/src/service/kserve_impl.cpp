@@ -10,7 +10,7 @@
 namespace torch::serving {
 
 KServeImpl::KServeImpl(const std::shared_ptr<ModelManager>& model_manager, const std::shared_ptr<Metrics>& metrics)
-  : model_manager_(model_manager) {
+  : model_manager_(model_manager), metrics_(metrics) {
   std::vector<std::string> model_list;
   model_manager->GetModelList(&model_list);
   for (const auto& item : model_list) {
@@ -33,7 +33,8 @@ grpc::Status KServeImpl::ServerReady(::grpc::ServerContext *context,
 grpc::Status KServeImpl::ModelReady(::grpc::ServerContext *context,
                                     const ::inference::ModelReadyRequest *request,
                                     ::inference::ModelReadyResponse *response) {
-  if (model_manager_ == nullptr || !model_manager_->Ready()) {
+  // 逐个模型报告, 不等待其他模型加载完成
+  if (model_manager_ == nullptr) {
     response->set_ready(false);
   } else {
     auto servable = model_manager_->GetServableByVersion(request->name(), request->version());
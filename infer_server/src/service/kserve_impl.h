@@ -10,7 +10,9 @@ namespace torch::serving {
 class Metrics;
 class ModelManager;
 
-class KServeImpl : public inference::GRPCInferenceService::Service {
+// ModelInfer使用callback接口: 批处理线程直接结束rpc, 排队中的请求不占用grpc线程
+// 其它接口仍为同步接口
+class KServeImpl : public inference::GRPCInferenceService::WithCallbackMethod_ModelInfer<inference::GRPCInferenceService::Service> {
  public:
   KServeImpl(const std::shared_ptr<ModelManager>& model_manager, const std::shared_ptr<Metrics>& metrics);
   grpc::Status ServerLive(::grpc::ServerContext *context,
@@ -28,9 +30,9 @@ class KServeImpl : public inference::GRPCInferenceService::Service {
   grpc::Status ModelMetadata(::grpc::ServerContext *context,
                              const ::inference::ModelMetadataRequest *request,
                              ::inference::ModelMetadataResponse *response) override;
-  grpc::Status ModelInfer(::grpc::ServerContext *context,
-                          const ::inference::ModelInferRequest *request,
-                          ::inference::ModelInferResponse *response) override;
+  grpc::ServerUnaryReactor* ModelInfer(::grpc::CallbackServerContext *context,
+                                       const ::inference::ModelInferRequest *request,
+                                       ::inference::ModelInferResponse *response) override;
   grpc::Status RepositoryModelLoad(::grpc::ServerContext *context,
                                    const ::inference::RepositoryModelLoadRequest *request,
                                    ::inference::RepositoryModelLoadResponse *response) override;
@@ -40,6 +42,7 @@ class KServeImpl : public inference::GRPCInferenceService::Service {
 
  private:
   const std::shared_ptr<ModelManager> model_manager_;
+  const std::shared_ptr<Metrics> metrics_;
   std::unordered_map<std::string, prometheus::Summary*> model_metrics_;
   prometheus::Summary* service_metrics_;
 };
@@ -1,8 +1,11 @@
 #include "kserve_impl.h"
 
+#include <atomic>
 #include <unordered_set>
 
+#include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <absl/time/clock.h>
 #include <absl/strings/str_join.h>
 
 #include "model/model_manager.h"
@@ -10,6 +13,9 @@
 #include "model/predict_context.h"
 #include "service/metrics.h"
 #include "utils/latency_guard.h"
+#include "utils/histogram.h"
+
+DEFINE_int32(predict_log_interval, 1000, "每N个成功的请求打印一条耗时日志, 0为不打印; 耗时统计见stage_latency_us");
 
 
 namespace {
@@ -45,49 +51,95 @@ std::shared_ptr<IServable> GetServableBySpec(const std::shared_ptr<ModelManager>
   return nullptr;
 }
 
-PredictStatus PredictInner(const std::shared_ptr<IServable>& servable, const std::shared_ptr<PredictContext>& predict_context) {
-  auto status = servable->Predict(predict_context);
-  if (!status.Ok()) {
-    return status;
+void LogPredict(const PredictContext& predict_context) {
+  static std::atomic<uint64_t> counter{0};
+  const int32_t interval = FLAGS_predict_log_interval;
+  if (interval <= 0 || counter.fetch_add(1, std::memory_order_relaxed) % interval != 0) {
+    return;
   }
-
   int64_t item_size = 0;
   std::unordered_set<std::string> feature_name;
-  for (const auto& entry : predict_context->request_->inputs()) {
+  for (const auto& entry : predict_context.request_->inputs()) {
     item_size = entry.shape(0);
     feature_name.insert(entry.name());
   }
-  auto* response = predict_context->response_;
+  auto* response = predict_context.response_;
   LOG(INFO) << response->model_name() << ":" << response->model_version() << "; feature:" << absl::StrJoin(feature_name, ",")
-            << "; item:" << item_size << "; " << predict_context->time_state_.ToString();
-  return {PredictStatus::OK};
+            << "; item:" << item_size << "; " << predict_context.time_state_.ToString();
 }
 
+void ObserveStages(Metrics* metrics, const PredictContext& predict_context) {
+  if (metrics == nullptr) {
+    return;
+  }
+  auto* response = predict_context.response_;
+  auto* histograms = metrics->GetStageHistograms(predict_context.request_->model_name(), response->model_version());
+  // 版本已卸载
+  if (histograms == nullptr) {
+    return;
+  }
+  auto& state = predict_context.time_state_;
+  histograms->total->Observe(absl::ToUnixMicros(absl::Now()) - state.before_queue);
+  if (state.before_check == 0 || state.after_check == 0 || state.before_pack == 0 || state.before_predict == 0
+      || state.before_unpack == 0 || state.after_unpack == 0) {
+    return;
+  }
+  histograms->check->Observe(state.after_check - state.before_check);
+  histograms->queue->Observe(state.before_pack - state.after_check);
+  histograms->pack->Observe(state.before_predict - state.before_pack);
+  histograms->predict->Observe(state.before_unpack - state.before_predict);
+  histograms->unpack->Observe(state.after_unpack - state.before_unpack);
+  if (predict_context.batch_size_ > 0) {
+    histograms->batch_size->Observe(static_cast<int64_t>(predict_context.batch_size_));
+  }
+}
 
-grpc::Status KServeImpl::ModelInfer(::grpc::ServerContext *context,
-                                    const ::inference::ModelInferRequest *request,
-                                    ::inference::ModelInferResponse *response) {
-  auto service_lr = std::make_unique<LatencyGuard>(service_metrics_);
-  if (!request->model_name().empty()) {
-    return {grpc::INVALID_ARGUMENT, "miss model spec"};
+grpc::Status ToGrpcStatus(const PredictStatus& status) {
+  if (status.Ok()) {
+    return grpc::Status::OK;
   }
-  auto model_lr = MakeModelLr(model_metrics_, request->model_name());
+  switch (status.Code()) {
+    case PredictStatus::DEADLINE_EXCEEDED: return {grpc::DEADLINE_EXCEEDED, status.Message()};
+    // 服务停止或版本卸载, 客户端可以重试
+    case PredictStatus::UNAVAILABLE: return {grpc::UNAVAILABLE, status.Message()};
+    default: break;
+  }
+  return {grpc::INTERNAL, status.Message()};
+}
+
+
+grpc::ServerUnaryReactor* KServeImpl::ModelInfer(::grpc::CallbackServerContext *context,
+                                                 const ::inference::ModelInferRequest *request,
+                                                 ::inference::ModelInferResponse *response) {
+  auto* reactor = context->DefaultReactor();
+  auto service_lr = std::make_shared<LatencyGuard>(service_metrics_);
+  if (request->model_name().empty()) {
+    reactor->Finish({grpc::INVALID_ARGUMENT, "miss model spec"});
+    return reactor;
+  }
+  std::shared_ptr<LatencyGuard> model_lr = MakeModelLr(model_metrics_, request->model_name());
 
   std::shared_ptr<IServable> servable = GetServableBySpec(model_manager_, *request);
   if (servable == nullptr) {
-    return {grpc::INTERNAL, absl::StrCat(request->model_name(), "'s servable not found")};
+    reactor->Finish({grpc::INTERNAL, absl::StrCat(request->model_name(), "'s servable not found")});
+    return reactor;
   }
 
   auto predict_context = std::make_shared<PredictContext>(request, response);
-  auto status = PredictInner(servable, predict_context);
-
-  if (!status.Ok()) {
-    return {grpc::INTERNAL, status.Message()};
+  auto deadline = context->deadline();
+  if (deadline != std::chrono::system_clock::time_point::max()) {
+    predict_context->deadline_ = absl::FromChrono(deadline);
   }
-
-  return grpc::Status::OK;
+  // 回调持有servable和延迟统计, 直到rpc结束
+  auto* metrics = metrics_.get();
+  servable->PredictAsync(predict_context, [reactor, servable, predict_context, service_lr, model_lr, metrics](const PredictStatus& status) {
+    if (status.Ok()) {
+      ObserveStages(metrics, *predict_context);
+      LogPredict(*predict_context);
+    }
+    reactor->Finish(ToGrpcStatus(status));
+  });
+  return reactor;
 }
 
 }
-
-
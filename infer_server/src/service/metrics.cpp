@@ -1,10 +1,24 @@
 #include "metrics.h"
+#include <atomic>
+#include <limits>
+#include <unordered_map>
 #include <prometheus/registry.h>
 #include <prometheus/summary.h>
+#include <prometheus/counter.h>
+#include <prometheus/collectable.h>
+#include <prometheus/metric_family.h>
 
 #include "server_config.pb.h"
+#include "utils/histogram.h"
 
 namespace {
+const char* STAGE_LATENCY = "stage_latency_us";
+const char* BATCH_SIZE = "batch_size";
+
+std::atomic<uint64_t> metrics_id{0};
+// 删除直方图时递增, 各线程发现变化后清空缓存
+std::atomic<uint64_t> stage_generation{0};
+
 const prometheus::Summary::Quantiles& GetQuantiles(const std::shared_ptr<torch::serving::MetricsConfig>& config) {
   static prometheus::Summary::Quantiles quantiles;
   static std::once_flag flag;
@@ -29,6 +43,72 @@ const prometheus::Summary::Quantiles& GetQuantiles(const std::shared_ptr<torch::
 
 namespace torch::serving {
 
+// 按指标名和标签管理直方图, 拉取时合并各线程分片
+class HistogramCollector : public prometheus::Collectable {
+ public:
+  using Labels = std::map<std::string, std::string>;
+
+  std::shared_ptr<Histogram> Add(const std::string& name, const std::string& help, const Labels& labels, const std::vector<int64_t>& bounds) {
+    std::lock_guard lock(mutex_);
+    auto& family = families_[name];
+    family.help = help;
+    auto& histogram = family.histograms[labels];
+    if (histogram == nullptr) {
+      histogram = std::make_shared<Histogram>(bounds);
+    }
+    return histogram;
+  }
+
+  void Remove(const std::string& name, const Labels& labels) {
+    std::lock_guard lock(mutex_);
+    auto it = families_.find(name);
+    if (it == families_.end()) {
+      return;
+    }
+    it->second.histograms.erase(labels);
+    if (it->second.histograms.empty()) {
+      families_.erase(it);
+    }
+  }
+
+  std::vector<prometheus::MetricFamily> Collect() const override {
+    std::lock_guard lock(mutex_);
+    std::vector<prometheus::MetricFamily> result;
+    result.reserve(families_.size());
+    for (const auto& [name, family] : families_) {
+      auto& metric_family = result.emplace_back();
+      metric_family.name = name;
+      metric_family.help = family.help;
+      metric_family.type = prometheus::MetricType::Histogram;
+      for (const auto& [labels, histogram] : family.histograms) {
+        auto& metric = metric_family.metric.emplace_back();
+        for (const auto& [key, value] : labels) {
+          metric.label.push_back({key, value});
+        }
+        auto snapshot = histogram->Collect();
+        auto& bounds = histogram->Bounds();
+        metric.histogram.sample_count = snapshot.count;
+        metric.histogram.sample_sum = static_cast<double>(snapshot.sum);
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < snapshot.counts.size(); ++i) {
+          cumulative += snapshot.counts[i];
+          double upper_bound = i < bounds.size() ? static_cast<double>(bounds[i]) : std::numeric_limits<double>::infinity();
+          metric.histogram.bucket.push_back({cumulative, upper_bound});
+        }
+      }
+    }
+    return result;
+  }
+
+ private:
+  struct Family {
+    std::string help;
+    std::map<Labels, std::shared_ptr<Histogram>> histograms;
+  };
+  mutable std::mutex mutex_;
+  std::map<std::string, Family> families_;
+};
+
 Metrics::Metrics(const std::shared_ptr<prometheus::Registry> &registry, const MetricsConfig& config)
   : registry_(registry),
     model_family_(prometheus::BuildSummary()
@@ -39,7 +119,25 @@ Metrics::Metrics(const std::shared_ptr<prometheus::Registry> &registry, const Me
       .Name("service_latency")
       .Help("no thing")
       .Register(*registry)),
-    windows_(config.time_windows()) {
+    batch_family_(prometheus::BuildCounter()
+      .Name("batch_bucket_total")
+      .Help("batches per allowed batch size")
+      .Register(*registry)),
+    padding_family_(prometheus::BuildCounter()
+      .Name("batch_padding_items_total")
+      .Help("items padded to allowed batch size")
+      .Register(*registry)),
+    dedup_family_(prometheus::BuildCounter()
+      .Name("batch_dedup_items_total")
+      .Help("items skipped by batch deduplication")
+      .Register(*registry)),
+    cache_family_(prometheus::BuildCounter()
+      .Name("response_cache_total")
+      .Help("response cache lookups and evictions")
+      .Register(*registry)),
+    windows_(config.time_windows()),
+    collector_(std::make_shared<HistogramCollector>()),
+    id_(metrics_id.fetch_add(1)) {
   config_ = std::make_shared<MetricsConfig>(config);
 }
 
@@ -53,16 +151,130 @@ Metrics::Metrics(const std::shared_ptr<prometheus::Registry> &registry)
                         .Name("service_latency")
                         .Help("no thing")
                         .Register(*registry)),
-    windows_(60) {
+    batch_family_(prometheus::BuildCounter()
+                      .Name("batch_bucket_total")
+                      .Help("batches per allowed batch size")
+                      .Register(*registry)),
+    padding_family_(prometheus::BuildCounter()
+                        .Name("batch_padding_items_total")
+                        .Help("items padded to allowed batch size")
+                        .Register(*registry)),
+    dedup_family_(prometheus::BuildCounter()
+                      .Name("batch_dedup_items_total")
+                      .Help("items skipped by batch deduplication")
+                      .Register(*registry)),
+    cache_family_(prometheus::BuildCounter()
+                      .Name("response_cache_total")
+                      .Help("response cache lookups and evictions")
+                      .Register(*registry)),
+    windows_(60),
+    collector_(std::make_shared<HistogramCollector>()),
+    id_(metrics_id.fetch_add(1)) {
 
 }
 
 prometheus::Summary *Metrics::GetModelSummary(const std::string &model) {
+  if (config_ != nullptr && config_->disable_summary()) {
+    return nullptr;
+  }
   return &model_family_.Add({{"model", model}}, GetQuantiles(config_), std::chrono::seconds{windows_});
 }
 prometheus::Summary *Metrics::GetServiceSummary(const std::string &service) {
+  if (config_ != nullptr && config_->disable_summary()) {
+    return nullptr;
+  }
   return &service_family_.Add({{"service", service}}, GetQuantiles(config_), std::chrono::seconds{windows_});
 }
+prometheus::Counter *Metrics::GetBatchCounter(const std::string &bucket) {
+  return &batch_family_.Add({{"bucket", bucket}});
+}
+prometheus::Counter *Metrics::GetBatchPaddingCounter() {
+  return &padding_family_.Add({});
+}
+prometheus::Counter *Metrics::GetBatchDedupCounter(const std::string &result) {
+  return &dedup_family_.Add({{"result", result}});
+}
+prometheus::Counter *Metrics::GetCacheCounter(const std::string &model, const std::string &result) {
+  return &cache_family_.Add({{"model", model}, {"result", result}});
+}
+const StageHistograms *Metrics::GetStageHistograms(const std::string &model, ModelVersion version) {
+  // <model, <<metrics id, version>, histograms>>, 查找时不构造新的key
+  struct StageCache {
+    uint64_t generation{0};
+    std::unordered_map<std::string, std::map<std::pair<uint64_t, ModelVersion>, std::shared_ptr<const StageHistograms>>> entries;
+  };
+  thread_local StageCache cache;
+  auto generation = stage_generation.load(std::memory_order_acquire);
+  if (cache.generation != generation) {
+    cache.entries.clear();
+    cache.generation = generation;
+  }
+  auto model_it = cache.entries.find(model);
+  if (model_it != cache.entries.end()) {
+    auto it = model_it->second.find(std::make_pair(id_, version));
+    if (it != model_it->second.end()) {
+      return it->second.get();
+    }
+  }
+  std::shared_ptr<const StageHistograms> result;
+  {
+    std::lock_guard lock(stage_mutex_);
+    auto key = std::make_pair(model, version);
+    if (removed_stages_.count(key) > 0) {
+      cache.entries[model][std::make_pair(id_, version)] = nullptr;
+      return nullptr;
+    }
+    auto& histograms = stage_histograms_[key];
+    if (histograms == nullptr) {
+      histograms = std::make_shared<StageHistograms>();
+      auto version_label = std::to_string(version);
+      auto add_stage = [&](const std::string& stage) {
+        return collector_->Add(STAGE_LATENCY, "predict latency per stage",
+                               {{"model", model}, {"version", version_label}, {"stage", stage}}, LatencyBuckets());
+      };
+      histograms->total = add_stage("total");
+      histograms->check = add_stage("check");
+      histograms->queue = add_stage("queue");
+      histograms->pack = add_stage("pack");
+      histograms->predict = add_stage("predict");
+      histograms->unpack = add_stage("unpack");
+      histograms->batch_size = collector_->Add(BATCH_SIZE, "merged batch size",
+                                               {{"model", model}, {"version", version_label}}, BatchSizeBuckets());
+    }
+    result = histograms;
+  }
+  cache.entries[model][std::make_pair(id_, version)] = result;
+  return result.get();
+}
+void Metrics::AddStageHistograms(const std::string &model, ModelVersion version) {
+  {
+    std::lock_guard lock(stage_mutex_);
+    if (removed_stages_.erase(std::make_pair(model, version)) == 0) {
+      return;
+    }
+  }
+  // 线程缓存中可能有该版本的nullptr
+  stage_generation.fetch_add(1, std::memory_order_release);
+}
+void Metrics::RemoveStageHistograms(const std::string &model, ModelVersion version) {
+  {
+    std::lock_guard lock(stage_mutex_);
+    auto key = std::make_pair(model, version);
+    removed_stages_.insert(key);
+    if (stage_histograms_.erase(key) == 0) {
+      return;
+    }
+    auto version_label = std::to_string(version);
+    for (const auto* stage : {"total", "check", "queue", "pack", "predict", "unpack"}) {
+      collector_->Remove(STAGE_LATENCY, {{"model", model}, {"version", version_label}, {"stage", stage}});
+    }
+    collector_->Remove(BATCH_SIZE, {{"model", model}, {"version", version_label}});
+  }
+  stage_generation.fetch_add(1, std::memory_order_release);
+}
+std::shared_ptr<prometheus::Collectable> Metrics::GetCollectable() {
+  return collector_;
+}
 
 }
 
@@ -1,19 +1,43 @@
 #pragma once
 
+#include <map>
+#include <set>
+#include <mutex>
 #include <memory>
+#include <string>
+#include <vector>
+
+#include "model/model_define.h"
 
 namespace prometheus {
 class Registry;
+class Collectable;
 
 template<typename TT>
 class Family;
 
 class Summary;
+class Counter;
 }
 
 
 namespace torch::serving {
 class MetricsConfig;
+class Histogram;
+class HistogramCollector;
+
+// 单个模型版本的分阶段延迟(us)和批次大小
+// 与采集器共享所有权, 版本卸载后线程缓存中的引用仍然有效
+struct StageHistograms {
+  std::shared_ptr<Histogram> total;
+  std::shared_ptr<Histogram> check;
+  // 校验结束到开始组装输入, 批处理时为排队和合并耗时
+  std::shared_ptr<Histogram> queue;
+  std::shared_ptr<Histogram> pack;
+  std::shared_ptr<Histogram> predict;
+  std::shared_ptr<Histogram> unpack;
+  std::shared_ptr<Histogram> batch_size;
+};
 
 class Metrics {
  public:
@@ -22,12 +46,37 @@ class Metrics {
 
   prometheus::Summary* GetModelSummary(const std::string& model);
   prometheus::Summary* GetServiceSummary(const std::string& service);
+  // 批次大小分桶的命中次数, bucket为允许的批次大小
+  prometheus::Counter* GetBatchCounter(const std::string& bucket);
+  prometheus::Counter* GetBatchPaddingCounter();
+  // 批次去重省去推理的item数, result为duplicate, cached
+  prometheus::Counter* GetBatchDedupCounter(const std::string& result);
+  // 结果缓存的命中/未命中/淘汰次数, result为hit, miss, evict
+  prometheus::Counter* GetCacheCounter(const std::string& model, const std::string& result);
+  // 每个线程缓存查找结果, 只有首次访问某个模型版本时加锁; 版本已卸载时返回nullptr
+  const StageHistograms* GetStageHistograms(const std::string& model, ModelVersion version);
+  // 模型版本加载时清除卸载标记, 同一版本卸载后可重新加载
+  void AddStageHistograms(const std::string& model, ModelVersion version);
+  // 模型版本卸载后删除其直方图并标记, 仍在处理的请求不会重新创建; 使各线程的缓存失效
+  void RemoveStageHistograms(const std::string& model, ModelVersion version);
+  // 直方图不经过Registry, 需要单独注册到Exposer
+  std::shared_ptr<prometheus::Collectable> GetCollectable();
 
  private:
   const std::shared_ptr<prometheus::Registry> registry_;
   prometheus::Family<prometheus::Summary>& model_family_;
   prometheus::Family<prometheus::Summary>& service_family_;
+  prometheus::Family<prometheus::Counter>& batch_family_;
+  prometheus::Family<prometheus::Counter>& padding_family_;
+  prometheus::Family<prometheus::Counter>& dedup_family_;
+  prometheus::Family<prometheus::Counter>& cache_family_;
   const uint32_t windows_;
   std::shared_ptr<MetricsConfig> config_{nullptr};
+  std::shared_ptr<HistogramCollector> collector_;
+  std::mutex stage_mutex_;
+  std::map<std::pair<std::string, ModelVersion>, std::shared_ptr<StageHistograms>> stage_histograms_;
+  std::set<std::pair<std::string, ModelVersion>> removed_stages_;
+  // 区分不同的Metrics实例, 用于线程缓存
+  const uint64_t id_;
 };
 }
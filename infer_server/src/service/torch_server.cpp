@@ -32,12 +32,13 @@ bool TorchServer::Init() {
     metrics_ = std::make_shared<Metrics>(registry, server_config.metrics_config());
     metrics_server_ = std::make_shared<prometheus::Exposer>(absl::StrFormat("0.0.0.0:%d", server_config.metrics_config().port()));
     metrics_server_->RegisterCollectable(registry);
+    metrics_server_->RegisterCollectable(metrics_->GetCollectable());
   } else {
     metrics_ = std::make_shared<Metrics>(registry);
   }
   model_manager_ = std::make_shared<ModelManager>();
 
-  if (!model_manager_->Init(server_config.model_manager_config())) {
+  if (!model_manager_->Init(server_config.model_manager_config(), metrics_)) {
     LOG(WARNING) << "model manager init error";
     return false;
   }
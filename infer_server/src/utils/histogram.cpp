@@ -0,0 +1,64 @@
+#include "histogram.h"
+
+#include <algorithm>
+
+namespace torch::serving {
+
+namespace {
+constexpr size_t kCacheLine = 64;
+constexpr size_t kSlotPerLine = kCacheLine / sizeof(std::atomic<int64_t>);
+
+size_t ThreadSlot() {
+  static std::atomic<size_t> next_slot{0};
+  thread_local const size_t slot = next_slot.fetch_add(1, std::memory_order_relaxed);
+  return slot;
+}
+}
+
+Histogram::Histogram(std::vector<int64_t> bounds)
+  : bounds_(std::move(bounds)),
+    stride_((bounds_.size() + 2 + kSlotPerLine - 1) / kSlotPerLine * kSlotPerLine),
+    data_(new std::atomic<int64_t>[kShardNum * stride_ + kSlotPerLine]) {
+  for (size_t i = 0; i < kShardNum * stride_ + kSlotPerLine; ++i) {
+    data_[i].store(0, std::memory_order_relaxed);
+  }
+  auto address = reinterpret_cast<uintptr_t>(data_.get());
+  shards_ = data_.get() + (kCacheLine - address % kCacheLine) % kCacheLine / sizeof(std::atomic<int64_t>);
+}
+void Histogram::Observe(int64_t value) {
+  auto* shard = shards_ + (ThreadSlot() % kShardNum) * stride_;
+  auto index = std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin();
+  shard[index].fetch_add(1, std::memory_order_relaxed);
+  shard[bounds_.size() + 1].fetch_add(value, std::memory_order_relaxed);
+}
+Histogram::Snapshot Histogram::Collect() const {
+  Snapshot snapshot;
+  snapshot.counts.resize(bounds_.size() + 1, 0);
+  for (size_t i = 0; i < kShardNum; ++i) {
+    auto* shard = shards_ + i * stride_;
+    for (size_t j = 0; j <= bounds_.size(); ++j) {
+      auto count = static_cast<uint64_t>(shard[j].load(std::memory_order_relaxed));
+      snapshot.counts[j] += count;
+      snapshot.count += count;
+    }
+    snapshot.sum += shard[bounds_.size() + 1].load(std::memory_order_relaxed);
+  }
+  return snapshot;
+}
+const std::vector<int64_t>& Histogram::Bounds() const {
+  return bounds_;
+}
+
+const std::vector<int64_t>& LatencyBuckets() {
+  static const std::vector<int64_t> buckets{
+      50, 100, 200, 500,
+      1000, 2000, 5000, 10000, 20000, 50000,
+      100000, 200000, 500000, 1000000, 2000000, 5000000};
+  return buckets;
+}
+const std::vector<int64_t>& BatchSizeBuckets() {
+  static const std::vector<int64_t> buckets{1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024};
+  return buckets;
+}
+
+}
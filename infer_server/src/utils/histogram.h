@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+namespace torch::serving {
+
+// 固定分桶的直方图, 按线程分片计数: 观测时只写本线程所在分片, 没有锁和跨线程的缓存行竞争
+// 读取时合并所有分片, 供prometheus拉取
+class Histogram {
+ public:
+  // bounds为各桶上界(包含), 升序; 最后隐含一个+Inf桶
+  explicit Histogram(std::vector<int64_t> bounds);
+
+  void Observe(int64_t value);
+
+  struct Snapshot {
+    // 与bounds一一对应, 最后一个为+Inf桶, 非累计
+    std::vector<uint64_t> counts;
+    uint64_t count{0};
+    int64_t sum{0};
+  };
+  Snapshot Collect() const;
+
+  const std::vector<int64_t>& Bounds() const;
+
+ private:
+  static constexpr size_t kShardNum = 16;
+
+  const std::vector<int64_t> bounds_;
+  // 每个分片: 各桶计数 + sum, 按缓存行对齐
+  const size_t stride_;
+  std::unique_ptr<std::atomic<int64_t>[]> data_;
+  // data_中首个缓存行对齐的位置
+  std::atomic<int64_t>* shards_;
+};
+
+// 延迟分桶, 单位us
+const std::vector<int64_t>& LatencyBuckets();
+// 批次大小分桶
+const std::vector<int64_t>& BatchSizeBuckets();
+
+}
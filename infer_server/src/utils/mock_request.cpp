@@ -0,0 +1,30 @@
+#include "mock_request.h"
+
+#include <boost/filesystem.hpp>
+
+#include "mock.pb.h"
+#include "kserve_predict_v2.pb.h"
+#include "utils/pbtext.h"
+
+namespace torch::serving {
+
+void MockToRequest(const MockRequest& mock_request, const std::string& input_name, inference::ModelInferRequest* request) {
+  auto* tensor_proto = request->add_inputs();
+  tensor_proto->set_name(input_name);
+  tensor_proto->set_datatype(inference::DT_FLOAT);
+  tensor_proto->mutable_shape()->Add(mock_request.shape().begin(), mock_request.shape().end());
+  tensor_proto->mutable_contents()->mutable_fp32_contents()->Add(mock_request.data().begin(), mock_request.data().end());
+}
+bool ReadRequest(const std::string& filename, const std::string& input_name, inference::ModelInferRequest* request) {
+  if (boost::filesystem::path(filename).extension() == ".bin") {
+    return ReadPbBin(filename, request);
+  }
+  MockRequest mock_request;
+  if (!ReadPbJson(filename, &mock_request)) {
+    return false;
+  }
+  MockToRequest(mock_request, input_name, request);
+  return true;
+}
+
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+namespace inference {
+class ModelInferRequest;
+}
+
+namespace torch::serving {
+class MockRequest;
+
+// 将json格式的MockRequest转为推理请求, 数据作为名为input_name的fp32输入
+void MockToRequest(const MockRequest& mock_request, const std::string& input_name, inference::ModelInferRequest* request);
+
+// 读取请求文件: .bin为序列化的ModelInferRequest(如warmup.bin), 其余按json格式的MockRequest解析
+bool ReadRequest(const std::string& filename, const std::string& input_name, inference::ModelInferRequest* request);
+
+}
@@ -0,0 +1,74 @@
+#include "rcu.h"
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace torch::serving::rcu {
+
+namespace {
+
+// 槽位只增不减, 线程退出后归还, 由新线程复用
+class SlotRegistry {
+ public:
+  ReaderSlot* Acquire() {
+    std::lock_guard lock(mutex_);
+    for (auto& slot : slots_) {
+      if (!slot->in_use.load(std::memory_order_relaxed)) {
+        slot->in_use.store(true, std::memory_order_relaxed);
+        return slot.get();
+      }
+    }
+    slots_.push_back(std::make_unique<ReaderSlot>());
+    slots_.back()->in_use.store(true, std::memory_order_relaxed);
+    return slots_.back().get();
+  }
+
+  void Release(ReaderSlot* slot) {
+    std::lock_guard lock(mutex_);
+    slot->reading.store(nullptr, std::memory_order_relaxed);
+    slot->in_use.store(false, std::memory_order_relaxed);
+  }
+
+  void Synchronize(const void* ptr) {
+    std::lock_guard lock(mutex_);
+    for (auto& slot : slots_) {
+      while (slot->reading.load(std::memory_order_seq_cst) == ptr) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<ReaderSlot>> slots_;
+};
+
+SlotRegistry& Registry() {
+  // 不析构, 线程退出时仍可能归还槽位
+  static auto* registry = new SlotRegistry();
+  return *registry;
+}
+
+struct LocalHolder {
+  ReaderSlot* slot{Registry().Acquire()};
+  ~LocalHolder() {
+    Registry().Release(slot);
+  }
+};
+
+}
+
+ReaderSlot* LocalSlot() {
+  thread_local LocalHolder holder;
+  return holder.slot;
+}
+
+void Synchronize(const void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  Registry().Synchronize(ptr);
+}
+
+}
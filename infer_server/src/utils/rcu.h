@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include <boost/noncopyable.hpp>
+
+namespace torch::serving {
+
+namespace rcu {
+
+// 每个读线程一个槽位, 独占缓存行, 登记正在读取的快照; 线程退出后槽位被复用
+struct alignas(64) ReaderSlot {
+  std::atomic<const void*> reading{nullptr};
+  std::atomic<bool> in_use{false};
+};
+
+ReaderSlot* LocalSlot();
+
+// 等待所有读线程不再持有ptr
+void Synchronize(const void* ptr);
+
+}
+
+// 读多写少的不可变快照: 读者一次原子读取, 只写自己线程的槽位, 不与其他读者竞争缓存行
+// 写者发布新快照后等待读取旧快照的读者离开再释放, 读者持有快照的时间只有回调执行的时间
+template<typename T>
+class RcuCell : public boost::noncopyable {
+ public:
+  explicit RcuCell(std::unique_ptr<const T> value) : current_(value.release()) {}
+  ~RcuCell() {
+    delete current_.load();
+  }
+
+  // func在快照上执行, 不能保存快照的引用, 也不能嵌套调用Read
+  template<typename Func>
+  auto Read(Func&& func) const {
+    auto* slot = rcu::LocalSlot();
+    const T* value = current_.load(std::memory_order_acquire);
+    while (true) {
+      slot->reading.store(value, std::memory_order_seq_cst);
+      // 登记后确认仍是当前快照, 否则写者可能已经错过这次登记
+      const T* check = current_.load(std::memory_order_seq_cst);
+      if (check == value) {
+        break;
+      }
+      value = check;
+    }
+    struct Release {
+      rcu::ReaderSlot* slot;
+      ~Release() {
+        slot->reading.store(nullptr, std::memory_order_release);
+      }
+    } release{slot};
+    return func(*value);
+  }
+
+  // 写者之间需要外部加锁
+  void Update(std::unique_ptr<const T> value) {
+    const T* old = current_.exchange(value.release(), std::memory_order_seq_cst);
+    rcu::Synchronize(old);
+    delete old;
+  }
+
+ private:
+  std::atomic<const T*> current_;
+};
+
+}
@@ -0,0 +1,149 @@
+#include "request_merge.h"
+
+#include <cstring>
+#include <unordered_map>
+
+#include <absl/strings/str_cat.h>
+
+#include "model_spec.pb.h"
+#include "kserve_predict_v2.pb.h"
+#include "utils/tensor_utils.h"
+
+namespace torch::serving {
+
+namespace {
+
+// <请求, 输入下标>
+using InputRef = std::pair<const inference::ModelInferRequest*, int>;
+
+// 直接写入合并后特征的连续内存, 补齐部分为0
+template<typename T>
+void MergeFeature(const std::vector<InputRef>& input_list, const std::vector<int64_t>& shape, std::string* buffer) {
+  buffer->resize(ShapeSize(shape.begin(), shape.end()) * sizeof(T));
+  const int64_t shape_per_item = ShapeSize(shape.begin() + 1, shape.end());
+  T* data = reinterpret_cast<T*>(buffer->data());
+  std::vector<int64_t> sub_shape;
+  for (const auto& [sub_request, index] : input_list) {
+    auto& proto = sub_request->inputs(index);
+    auto sub_data = InputData<T>(*sub_request, index);
+    if (std::equal(proto.shape().begin() + 1, proto.shape().end(), shape.begin() + 1)) {
+      std::memcpy(data, sub_data.data(), sub_data.size() * sizeof(T));
+    } else {
+      sub_shape.assign(proto.shape().begin(), proto.shape().end());
+      PadCopy(sub_data.data(), sub_shape.data(), shape.data(), shape.size(), data);
+    }
+    data += proto.shape(0) * shape_per_item;
+  }
+}
+
+}
+
+PredictStatus MergeRequest(const std::vector<const inference::ModelInferRequest*>& request_list, const inference::ModelSpec& spec,
+                           size_t batch_size, bool pad_variable_length, inference::ModelInferRequest* request) {
+  if (request_list.empty()) {
+    return {PredictStatus::OK};
+  }
+  auto& first = request_list[0];
+  request->set_id(first->id());
+  request->set_model_name(first->model_name());
+  std::unordered_map<std::string, std::vector<InputRef>> tensor_map;
+  for (const auto& sub_request : request_list) {
+    for (int i = 0; i < sub_request->inputs_size(); ++i) {
+      tensor_map[sub_request->inputs(i).name()].emplace_back(sub_request, i);
+    }
+  }
+  for (const auto& feature_spec : spec.feature_specs()) {
+    auto* merge_proto = request->add_inputs();
+    auto* buffer = request->add_raw_input_contents();
+    auto& input_list = tensor_map[feature_spec.name()];
+    // 合并后的形状, 变长维度取最大值
+    std::vector<int64_t> shape(feature_spec.shape_size() + 1, 0);
+    bool variable_length = false;
+    for (const auto& [sub_request, index] : input_list) {
+      auto& proto = sub_request->inputs(index);
+      for (size_t i = 1; i < shape.size(); ++i) {
+        if (shape[0] > 0 && shape[i] != proto.shape(i)) {
+          variable_length = true;
+        }
+        shape[i] = std::max(shape[i], proto.shape(i));
+      }
+      shape[0] += proto.shape(0);
+    }
+    if (variable_length && !pad_variable_length) {
+      return {PredictStatus::SHAPE_ERROR, absl::StrCat(feature_spec.name(), " has variable length, enable pad_variable_length_inputs")};
+    }
+    // 补齐到允许的批次大小, 补齐的item在SplitResponse中丢弃
+    shape[0] = std::max<int64_t>(shape[0], batch_size);
+    // 各请求的变长维度取最大值后, 合并的元素数可能远大于输入之和
+    int64_t merge_size = 0;
+    if (!CheckedShapeSize(shape.begin(), shape.end(), &merge_size)) {
+      return {PredictStatus::SHAPE_ERROR, absl::StrCat(feature_spec.name(), " merged shape too large")};
+    }
+
+    merge_proto->set_name(feature_spec.name());
+    merge_proto->set_datatype(feature_spec.dtype());
+    merge_proto->mutable_shape()->Add(shape.begin(), shape.end());
+    DispatchDataType(feature_spec.dtype(), [&](auto type) {
+      MergeFeature<decltype(type)>(input_list, shape, buffer);
+    });
+  }
+  return {PredictStatus::OK};
+}
+
+void SplitResponse(const inference::ModelInferResponse& response, const std::vector<const inference::ModelInferRequest*>& request_list,
+                   const std::vector<inference::ModelInferResponse*>& response_list, const std::vector<size_t>& item_size_list) {
+  for (size_t i = 0; i < response_list.size(); ++i) {
+    response_list[i]->set_id(request_list[i]->id());
+    response_list[i]->set_model_name(response.model_name());
+    response_list[i]->set_model_version(response.model_version());
+  }
+  for (int output_index = 0; output_index < response.outputs_size(); ++output_index) {
+    auto& merge_proto = response.outputs(output_index);
+    if (merge_proto.shape_size() == 0) {
+      continue;
+    }
+
+    size_t shape_per_item = ShapeSize(merge_proto.shape().begin() + 1, merge_proto.shape().end());
+    size_t data_index = 0;
+    for (size_t i=0; i<response_list.size(); ++i) {
+      auto& sub_response = response_list[i];
+      const auto& item_size = item_size_list[i];
+      const bool raw_output = UseRawOutput(*request_list[i]);
+      auto* proto = sub_response->add_outputs();
+      proto->set_name(merge_proto.name());
+      proto->set_datatype(merge_proto.datatype());
+      proto->add_shape(item_size);
+      proto->mutable_shape()->Add(merge_proto.shape().begin() + 1, merge_proto.shape().end());
+      size_t item_data_size = item_size * shape_per_item;
+      bool added = false;
+      DispatchDataType(merge_proto.datatype(), [&](auto type) {
+        using T = decltype(type);
+        auto data = OutputData<T>(response, output_index);
+        if (data_index + item_data_size > data.size()) {
+          return;
+        }
+        AddOutputData<T>(data.data() + data_index, item_data_size, raw_output, sub_response, proto);
+        added = true;
+      });
+      // 占位, 保证raw_output_contents与outputs对齐
+      if (!added && raw_output) {
+        sub_response->add_raw_output_contents();
+      }
+      data_index += item_data_size;
+    }
+  }
+}
+
+void TruncateRequest(size_t item_size, inference::ModelInferRequest* request) {
+  for (int i = 0; i < request->inputs_size() && i < request->raw_input_contents_size(); ++i) {
+    auto* proto = request->mutable_inputs(i);
+    if (proto->shape_size() == 0 || proto->shape(0) <= static_cast<int64_t>(item_size)) {
+      continue;
+    }
+    const int64_t shape_per_item = ShapeSize(proto->shape().begin() + 1, proto->shape().end());
+    request->mutable_raw_input_contents(i)->resize(item_size * shape_per_item * DataTypeSize(proto->datatype()));
+    proto->set_shape(0, item_size);
+  }
+}
+
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+#include "model/predict_status.h"
+
+namespace inference {
+class ModelInferRequest;
+class ModelInferResponse;
+class ModelSpec;
+}
+
+namespace torch::serving {
+
+// 合并请求, item数补齐到batch_size; 变长特征在pad_variable_length时按各维最大值补零
+PredictStatus MergeRequest(const std::vector<const inference::ModelInferRequest*>& request_list, const inference::ModelSpec& spec,
+                           size_t batch_size, bool pad_variable_length, inference::ModelInferRequest* request);
+// 按item数切分结果, 补齐的item被丢弃; 使用raw_input_contents的子请求得到raw_output_contents
+void SplitResponse(const inference::ModelInferResponse& response, const std::vector<const inference::ModelInferRequest*>& request_list,
+                   const std::vector<inference::ModelInferResponse*>& response_list, const std::vector<size_t>& item_size_list);
+// 只保留前item_size个item, 用于按批次大小截断合并后的请求; 只支持raw_input_contents
+void TruncateRequest(size_t item_size, inference::ModelInferRequest* request);
+
+}
@@ -13,7 +13,7 @@ int64_t StopWatch::Elapsed() {
   return absl::ToInt64Microseconds(absl::Now() - check_point_);
 }
 int64_t StopWatch::Current() {
-  return ToUnixMicros(check_point_);
+  return absl::ToUnixMicros(absl::Now());
 }
 }
 
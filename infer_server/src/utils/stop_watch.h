@@ -12,6 +12,7 @@ class StopWatch {
 
   int64_t Elapsed();
 
+  // 当前时间戳, us
   int64_t Current();
 
  private:
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <google/protobuf/repeated_field.h>
+#include <absl/types/span.h>
+
+#include "kserve_predict_v2.pb.h"
+
+namespace torch::serving {
+
+// InferTensorContents中各类型对应的repeated字段
+template<typename T>
+const google::protobuf::RepeatedField<T>& GetContents(const inference::InferTensorContents& contents);
+template<typename T>
+google::protobuf::RepeatedField<T>* MutableContents(inference::InferTensorContents* contents);
+
+#define TENSOR_CONTENTS_FIELD(TYPE, FIELD) \
+template<> \
+inline const google::protobuf::RepeatedField<TYPE>& GetContents<TYPE>(const inference::InferTensorContents& contents) { \
+  return contents.FIELD(); \
+} \
+template<> \
+inline google::protobuf::RepeatedField<TYPE>* MutableContents<TYPE>(inference::InferTensorContents* contents) { \
+  return contents->mutable_##FIELD(); \
+}
+
+TENSOR_CONTENTS_FIELD(bool, bool_contents)
+TENSOR_CONTENTS_FIELD(int32_t, int_contents)
+TENSOR_CONTENTS_FIELD(uint32_t, uint_contents)
+TENSOR_CONTENTS_FIELD(int64_t, int64_contents)
+TENSOR_CONTENTS_FIELD(uint64_t, uint64_contents)
+TENSOR_CONTENTS_FIELD(float, fp32_contents)
+TENSOR_CONTENTS_FIELD(double, fp64_contents)
+
+#undef TENSOR_CONTENTS_FIELD
+
+// 按数据类型分发, func以对应类型的值为参数: func(T{})
+// 类型不支持时返回false
+template<typename Func>
+bool DispatchDataType(inference::DataType dtype, Func&& func) {
+  switch (dtype) {
+    case inference::DT_BOOL: func(bool{}); return true;
+    case inference::DT_INT32: func(int32_t{}); return true;
+    case inference::DT_UINT32: func(uint32_t{}); return true;
+    case inference::DT_INT64: func(int64_t{}); return true;
+    case inference::DT_UINT64: func(uint64_t{}); return true;
+    case inference::DT_FLOAT: func(float{}); return true;
+    case inference::DT_DOUBLE: func(double{}); return true;
+    default: return false;
+  }
+}
+
+// 单个元素的字节数, 类型不支持时返回0
+inline size_t DataTypeSize(inference::DataType dtype) {
+  size_t size = 0;
+  DispatchDataType(dtype, [&](auto type) {
+    size = sizeof(type);
+  });
+  return size;
+}
+
+// 第index个输入的数据, 请求使用raw_input_contents时直接指向原始字节
+template<typename T>
+absl::Span<const T> InputData(const inference::ModelInferRequest& request, int index) {
+  if (request.raw_input_contents_size() > 0) {
+    auto& raw = request.raw_input_contents(index);
+    return absl::Span<const T>(reinterpret_cast<const T*>(raw.data()), raw.size() / sizeof(T));
+  }
+  auto& contents = GetContents<T>(request.inputs(index).contents());
+  return absl::Span<const T>(contents.data(), contents.size());
+}
+
+// 第index个输出的数据, 结果使用raw_output_contents时直接指向原始字节
+template<typename T>
+absl::Span<const T> OutputData(const inference::ModelInferResponse& response, int index) {
+  if (response.raw_output_contents_size() > 0) {
+    auto& raw = response.raw_output_contents(index);
+    return absl::Span<const T>(reinterpret_cast<const T*>(raw.data()), raw.size() / sizeof(T));
+  }
+  auto& contents = GetContents<T>(response.outputs(index).contents());
+  return absl::Span<const T>(contents.data(), contents.size());
+}
+
+// 请求使用raw_input_contents时结果也使用raw_output_contents
+inline bool UseRawOutput(const inference::ModelInferRequest& request) {
+  return request.raw_input_contents_size() > 0;
+}
+
+// 写入一个输出的数据; raw时追加到raw_output_contents, 与outputs一一对应
+template<typename T>
+void AddOutputData(const T* data, size_t size, bool raw, inference::ModelInferResponse* response,
+                   inference::ModelInferResponse::InferOutputTensor* output) {
+  if (raw) {
+    response->add_raw_output_contents()->assign(reinterpret_cast<const char*>(data), size * sizeof(T));
+  } else {
+    MutableContents<T>(output->mutable_contents())->Add(data, data + size);
+  }
+}
+
+template<typename Iter>
+int64_t ShapeSize(Iter begin, Iter end) {
+  int64_t size = 1;
+  for (auto it = begin; it != end; ++it) {
+    size *= *it;
+  }
+  return size;
+}
+
+// 单个张量的元素数上限, 防止请求中的形状乘积溢出或申请过大内存
+constexpr int64_t kMaxTensorElements = int64_t{1} << 32;
+
+// 形状中有负数或元素数超过kMaxTensorElements时返回false
+template<typename Iter>
+bool CheckedShapeSize(Iter begin, Iter end, int64_t* size) {
+  *size = 1;
+  for (auto it = begin; it != end; ++it) {
+    if (*it < 0 || __builtin_mul_overflow(*size, static_cast<int64_t>(*it), size) || *size > kMaxTensorElements) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// 将形状为src_shape的张量拷贝到形状为dst_shape的张量中, 每一维dst >= src, 多余部分保持原值(补零)
+template<typename T>
+void PadCopy(const T* src, const int64_t* src_shape, const int64_t* dst_shape, size_t dims, T* dst) {
+  if (dims == 0) {
+    *dst = *src;
+    return;
+  }
+  if (dims == 1) {
+    std::copy(src, src + src_shape[0], dst);
+    return;
+  }
+  int64_t src_stride = ShapeSize(src_shape + 1, src_shape + dims);
+  int64_t dst_stride = ShapeSize(dst_shape + 1, dst_shape + dims);
+  for (int64_t i = 0; i < src_shape[0]; ++i) {
+    PadCopy(src + i * src_stride, src_shape + 1, dst_shape + 1, dims - 1, dst + i * dst_stride);
+  }
+}
+
+}
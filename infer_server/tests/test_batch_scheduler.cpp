@@ -0,0 +1,666 @@
+#define BOOST_TEST_MODULE torch
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <list>
+#include <future>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <absl/time/clock.h>
+#include <glog/logging.h>
+#include <boost/filesystem.hpp>
+
+#include "batch_config.pb.h"
+#include "model_spec.pb.h"
+#include "kserve_predict_v2.pb.h"
+#include "batch/batch_servable.h"
+#include "batch/shared_batch_scheduler.h"
+#include "batch/item_dedup.h"
+#include "model/predict_context.h"
+#include "utils/tensor_utils.h"
+#include "utils/pbtext.h"
+#include "model/model_define.h"
+
+namespace {
+
+constexpr int kDim = 4;
+
+// 输出每个item的特征和, 并模拟固定的推理耗时
+class MockServable : public torch::serving::IServable {
+ public:
+  MockServable() {
+    auto* feature = spec_.add_feature_specs();
+    feature->set_name("x");
+    feature->set_dtype(inference::DT_FLOAT);
+    feature->add_shape(kDim);
+    CompileChecker(spec_);
+  }
+  bool Init(const std::string &path) override {
+    return true;
+  }
+  torch::serving::PredictStatus PredictWithoutCheck(const torch::serving::PredictContextPtr &predict_context) override {
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+    auto& input = predict_context->request_->inputs(0);
+    auto data = torch::serving::InputData<float>(*predict_context->request_, 0);
+    auto* output = predict_context->response_->add_outputs();
+    output->set_name("sum");
+    output->set_datatype(inference::DT_FLOAT);
+    output->add_shape(input.shape(0));
+    output->add_shape(1);
+    for (int i = 0; i < input.shape(0); ++i) {
+      float sum = 0;
+      for (int j = 0; j < kDim; ++j) {
+        sum += data[i * kDim + j];
+      }
+      output->mutable_contents()->add_fp32_contents(sum);
+    }
+    return {torch::serving::PredictStatus::OK};
+  }
+  const std::string &GetLabel() override {
+    return label_;
+  }
+  const inference::ModelSpec &GetSpec() override {
+    return spec_;
+  }
+
+ private:
+  std::string label_;
+  inference::ModelSpec spec_;
+};
+
+// 记录每次预测的item数, 并从模型目录预热
+class WarmupServable : public MockServable {
+ public:
+  bool Init(const std::string &path) override {
+    return Warmup(path, {4, 8});
+  }
+  torch::serving::PredictStatus PredictWithoutCheck(const torch::serving::PredictContextPtr &predict_context) override {
+    batch_list_.push_back(predict_context->request_->inputs(0).shape(0));
+    return MockServable::PredictWithoutCheck(predict_context);
+  }
+  std::vector<int64_t> batch_list_;
+};
+
+// 推理时抛出异常
+class ThrowServable : public MockServable {
+ public:
+  torch::serving::PredictStatus PredictWithoutCheck(const torch::serving::PredictContextPtr &predict_context) override {
+    throw std::runtime_error("mock error");
+  }
+};
+
+// 写入输出后返回错误
+class FailServable : public MockServable {
+ public:
+  torch::serving::PredictStatus PredictWithoutCheck(const torch::serving::PredictContextPtr &predict_context) override {
+    MockServable::PredictWithoutCheck(predict_context);
+    return {torch::serving::PredictStatus::PREDICT_ERROR, "mock error"};
+  }
+};
+
+void AddInput(const std::vector<int64_t>& shape, const std::vector<float>& data, inference::ModelInferRequest* request) {
+  auto* input = request->add_inputs();
+  input->set_name("x");
+  input->set_datatype(inference::DT_FLOAT);
+  input->mutable_shape()->Add(shape.begin(), shape.end());
+  input->mutable_contents()->mutable_fp32_contents()->Add(data.begin(), data.end());
+}
+
+// 每个item的特征为seed + j
+void AddItems(const std::vector<int>& seeds, inference::ModelInferRequest* request) {
+  std::vector<float> data;
+  for (auto seed : seeds) {
+    for (int j = 0; j < kDim; ++j) {
+      data.push_back(static_cast<float>(seed + j));
+    }
+  }
+  AddInput({static_cast<int64_t>(seeds.size()), kDim}, data, request);
+}
+
+float ItemSum(int seed) {
+  return kDim * seed + kDim * (kDim - 1) / 2;
+}
+
+void BuildRequest(int seed, inference::ModelInferRequest* request) {
+  auto* input = request->add_inputs();
+  input->set_name("x");
+  input->set_datatype(inference::DT_FLOAT);
+  input->add_shape(1);
+  input->add_shape(kDim);
+  for (int j = 0; j < kDim; ++j) {
+    input->mutable_contents()->add_fp32_contents(static_cast<float>(seed + j));
+  }
+}
+
+// 改动前的调度方式, 作为对比基准: 工作线程在全局锁下轮询队列, 批次按超时或大小关闭, 没有就绪批次时休眠1ms
+class PollingScheduler {
+ public:
+  PollingScheduler(const std::shared_ptr<torch::serving::IServable>& servable, size_t max_batch_size, absl::Duration timeout, int thread_num)
+    : servable_(servable), max_batch_size_(max_batch_size), timeout_(timeout) {
+    for (int i = 0; i < thread_num; ++i) {
+      workers_.emplace_back([this]() {
+        while (running_) {
+          Work();
+        }
+      });
+    }
+  }
+  ~PollingScheduler() {
+    running_ = false;
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  torch::serving::PredictStatus Predict(const torch::serving::PredictContextPtr& context) {
+    auto task = std::make_shared<Task>();
+    task->context = context;
+    auto future = task->promise.get_future();
+    {
+      std::unique_lock lock(mutex_);
+      if (groups_.empty() || IsClosed(groups_.back())) {
+        groups_.emplace_back();
+      }
+      groups_.back().begin = groups_.back().tasks.empty() ? absl::Now() : groups_.back().begin;
+      groups_.back().tasks.push_back(task);
+    }
+    return future.get();
+  }
+
+ private:
+  struct Task {
+    torch::serving::PredictContextPtr context;
+    std::promise<torch::serving::PredictStatus> promise;
+  };
+  struct Group {
+    absl::Time begin;
+    std::vector<std::shared_ptr<Task>> tasks;
+  };
+
+  bool IsClosed(const Group& group) const {
+    return group.tasks.size() >= max_batch_size_ || absl::Now() - group.begin >= timeout_;
+  }
+
+  void Work() {
+    Group group;
+    {
+      std::unique_lock lock(mutex_);
+      if (!groups_.empty() && IsClosed(groups_.front())) {
+        group = std::move(groups_.front());
+        groups_.pop_front();
+      }
+    }
+    if (group.tasks.empty()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      return;
+    }
+    std::vector<const inference::ModelInferRequest*> request_list;
+    std::vector<inference::ModelInferResponse*> response_list;
+    std::vector<size_t> item_size_list;
+    for (const auto& task : group.tasks) {
+      request_list.push_back(task->context->request_);
+      response_list.push_back(task->context->response_);
+      item_size_list.push_back(1);
+    }
+    inference::ModelInferRequest request;
+    inference::ModelInferResponse response;
+    auto status = torch::serving::MergeRequest(request_list, servable_->GetSpec(), 0, false, &request);
+    if (status.Ok()) {
+      status = servable_->Predict(std::make_shared<torch::serving::PredictContext>(&request, &response));
+      torch::serving::SplitResponse(response, request_list, response_list, item_size_list);
+    }
+    for (const auto& task : group.tasks) {
+      task->promise.set_value(status);
+    }
+  }
+
+ private:
+  std::shared_ptr<torch::serving::IServable> servable_;
+  const size_t max_batch_size_;
+  const absl::Duration timeout_;
+  std::mutex mutex_;
+  std::list<Group> groups_;
+  std::atomic_bool running_{true};
+  std::vector<std::thread> workers_;
+};
+
+using PredictFunc = std::function<torch::serving::PredictStatus(const torch::serving::PredictContextPtr&)>;
+
+void RunSchedulerBench(const std::string& name, const PredictFunc& predict) {
+  const int client_num = 32;
+  const int request_num = 500;
+
+  std::vector<std::vector<int64_t>> latency_list(client_num);
+  std::atomic_int error_num{0};
+  auto begin = absl::Now();
+  std::vector<std::thread> clients;
+  for (int c = 0; c < client_num; ++c) {
+    clients.emplace_back([&, c]() {
+      for (int i = 0; i < request_num; ++i) {
+        inference::ModelInferRequest request;
+        inference::ModelInferResponse response;
+        BuildRequest(c * request_num + i, &request);
+        auto context = std::make_shared<torch::serving::PredictContext>(&request, &response);
+        auto start = absl::Now();
+        auto status = predict(context);
+        latency_list[c].push_back(absl::ToInt64Microseconds(absl::Now() - start));
+        float expect = 0;
+        for (const auto& value : request.inputs(0).contents().fp32_contents()) {
+          expect += value;
+        }
+        if (!status.Ok() || response.outputs_size() != 1 || response.outputs(0).contents().fp32_contents(0) != expect) {
+          ++error_num;
+        }
+      }
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  auto cost = absl::Now() - begin;
+
+  std::vector<int64_t> latency;
+  for (const auto& item : latency_list) {
+    latency.insert(latency.end(), item.begin(), item.end());
+  }
+  std::sort(latency.begin(), latency.end());
+  LOG(INFO) << name << " qps: " << latency.size() / absl::ToDoubleSeconds(cost)
+            << "; p50: " << latency[latency.size() / 2] << "us"
+            << "; p99: " << latency[latency.size() * 99 / 100] << "us"
+            << "; max: " << latency.back() << "us";
+  BOOST_CHECK_EQUAL(error_num.load(), 0);
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(batch_scheduler_bench) {
+  auto mock = std::make_shared<MockServable>();
+  {
+    PollingScheduler polling(mock, 16, absl::Microseconds(1000), 4);
+    RunSchedulerBench("polling", [&polling](const torch::serving::PredictContextPtr& context) {
+      return polling.Predict(context);
+    });
+  }
+  torch::serving::BatchConfig config;
+  config.set_max_batch_size(16);
+  config.set_batch_timeout_micros(1000);
+  config.set_num_batch_threads(4);
+  auto scheduler = std::make_shared<torch::serving::SharedBatchScheduler>(config);
+  auto servable = std::make_shared<torch::serving::BatchServable>(mock, scheduler);
+  RunSchedulerBench("event", [&servable](const torch::serving::PredictContextPtr& context) {
+    return servable->Predict(context);
+  });
+}
+
+BOOST_AUTO_TEST_CASE(batch_deadline) {
+  torch::serving::BatchConfig config;
+  config.set_max_batch_size(16);
+  config.set_batch_timeout_micros(1000000);
+  config.set_batch_deadline_margin_micros(1000);
+  config.set_num_batch_threads(1);
+  auto scheduler = std::make_shared<torch::serving::SharedBatchScheduler>(config);
+  auto servable = std::make_shared<torch::serving::BatchServable>(std::make_shared<MockServable>(), scheduler);
+
+  inference::ModelInferRequest request;
+  inference::ModelInferResponse response;
+  BuildRequest(0, &request);
+  {
+    // 已过期的请求不参与推理
+    auto context = std::make_shared<torch::serving::PredictContext>(&request, &response);
+    context->deadline_ = absl::Now() - absl::Milliseconds(1);
+    auto status = servable->Predict(context);
+    BOOST_CHECK(status.Code() == torch::serving::PredictStatus::DEADLINE_EXCEEDED);
+    BOOST_CHECK_EQUAL(response.outputs_size(), 0);
+  }
+  {
+    // 截止时间早于批次超时, 批次提前关闭
+    auto context = std::make_shared<torch::serving::PredictContext>(&request, &response);
+    context->deadline_ = absl::Now() + absl::Milliseconds(50);
+    auto start = absl::Now();
+    auto status = servable->Predict(context);
+    BOOST_CHECK(status.Ok());
+    BOOST_CHECK(absl::Now() - start < absl::Milliseconds(50));
+    BOOST_CHECK_EQUAL(response.outputs_size(), 1);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(batch_shutdown) {
+  torch::serving::BatchConfig config;
+  config.set_max_batch_size(16);
+  config.set_batch_timeout_micros(10000000);
+  config.set_num_batch_threads(1);
+  auto scheduler = std::make_shared<torch::serving::SharedBatchScheduler>(config);
+  auto mock = std::make_shared<MockServable>();
+
+  inference::ModelInferRequest request;
+  BuildRequest(0, &request);
+  std::promise<torch::serving::PredictStatus> promise;
+  auto done = [&promise](const torch::serving::PredictStatus& status) {
+    promise.set_value(status);
+  };
+  {
+    // 卸载版本时未满的批次立即推理, 不等批次超时
+    inference::ModelInferResponse response;
+    auto servable = std::make_shared<torch::serving::BatchServable>(mock, scheduler);
+    servable->PredictAsync(std::make_shared<torch::serving::PredictContext>(&request, &response), done);
+    auto future = promise.get_future();
+    servable.reset();
+    BOOST_REQUIRE(future.wait_for(std::chrono::seconds(1)) == std::future_status::ready);
+    BOOST_CHECK(future.get().Ok());
+    BOOST_CHECK_EQUAL(response.outputs_size(), 1);
+  }
+  {
+    // 调度器停止时队列中的请求以UNAVAILABLE结束
+    promise = {};
+    inference::ModelInferResponse response;
+    auto queue = scheduler->AddQueue();
+    auto task = std::make_shared<torch::serving::BatchTask>();
+    task->context = std::make_shared<torch::serving::PredictContext>(&request, &response);
+    task->servable = mock;
+    task->size = 1;
+    task->done = done;
+    scheduler->Schedule(queue, task);
+    auto future = promise.get_future();
+    scheduler.reset();
+    queue.reset();
+    BOOST_REQUIRE(future.wait_for(std::chrono::seconds(1)) == std::future_status::ready);
+    BOOST_CHECK(future.get().Code() == torch::serving::PredictStatus::UNAVAILABLE);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(batch_predict_error) {
+  torch::serving::BatchConfig config;
+  config.set_max_batch_size(16);
+  config.set_batch_timeout_micros(1000);
+  config.set_num_batch_threads(1);
+  auto scheduler = std::make_shared<torch::serving::SharedBatchScheduler>(config);
+  auto servable = std::make_shared<torch::serving::BatchServable>(std::make_shared<ThrowServable>(), scheduler);
+
+  // 异常不会漏掉回调, 整组以INTERNAL结束, 批处理线程继续工作
+  for (int i = 0; i < 2; ++i) {
+    inference::ModelInferRequest request;
+    inference::ModelInferResponse response;
+    BuildRequest(i, &request);
+    auto status = servable->Predict(std::make_shared<torch::serving::PredictContext>(&request, &response));
+    BOOST_CHECK(status.Code() == torch::serving::PredictStatus::INTERNAL);
+  }
+
+  // 推理失败时不拆分输出
+  auto fail_servable = std::make_shared<torch::serving::BatchServable>(std::make_shared<FailServable>(), scheduler);
+  inference::ModelInferRequest request;
+  inference::ModelInferResponse response;
+  BuildRequest(0, &request);
+  auto status = fail_servable->Predict(std::make_shared<torch::serving::PredictContext>(&request, &response));
+  BOOST_CHECK(status.Code() == torch::serving::PredictStatus::PREDICT_ERROR);
+  BOOST_CHECK_EQUAL(response.outputs_size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(batch_padding) {
+  inference::ModelSpec spec;
+  auto* feature = spec.add_feature_specs();
+  feature->set_name("x");
+  feature->set_dtype(inference::DT_FLOAT);
+  feature->add_shape(-1);
+
+  inference::ModelInferRequest first;
+  inference::ModelInferRequest second;
+  AddInput({1, 2}, {1, 2}, &first);
+  AddInput({2, 3}, {3, 4, 5, 6, 7, 8}, &second);
+
+  inference::ModelInferRequest merged;
+  BOOST_CHECK(!torch::serving::MergeRequest({&first, &second}, spec, 4, false, &merged).Ok());
+  merged.Clear();
+  BOOST_CHECK(torch::serving::MergeRequest({&first, &second}, spec, 4, true, &merged).Ok());
+  auto& merged_input = merged.inputs(0);
+  BOOST_CHECK_EQUAL(merged_input.shape(0), 4);
+  BOOST_CHECK_EQUAL(merged_input.shape(1), 3);
+  std::vector<float> expect{1, 2, 0, 3, 4, 5, 6, 7, 8, 0, 0, 0};
+  auto merged_data = torch::serving::InputData<float>(merged, 0);
+  BOOST_CHECK_EQUAL_COLLECTIONS(merged_data.begin(), merged_data.end(), expect.begin(), expect.end());
+
+  inference::ModelInferResponse response;
+  auto* output = response.add_outputs();
+  output->set_name("y");
+  output->set_datatype(inference::DT_FLOAT);
+  output->add_shape(4);
+  std::vector<float> result{1, 2, 3, -1};
+  output->mutable_contents()->mutable_fp32_contents()->Add(result.begin(), result.end());
+  inference::ModelInferResponse first_response;
+  inference::ModelInferResponse second_response;
+  torch::serving::SplitResponse(response, {&first, &second}, {&first_response, &second_response}, {1, 2});
+  BOOST_CHECK_EQUAL(first_response.outputs(0).contents().fp32_contents_size(), 1);
+  BOOST_CHECK_EQUAL(second_response.outputs(0).contents().fp32_contents_size(), 2);
+  BOOST_CHECK_EQUAL(second_response.outputs(0).contents().fp32_contents(1), 3);
+}
+
+BOOST_AUTO_TEST_CASE(batch_group_split) {
+  torch::serving::ServableQueue queue(absl::Seconds(10), absl::ZeroDuration(), 32, 64, 1);
+  inference::ModelInferRequest request;
+  inference::ModelInferResponse response;
+  auto context = std::make_shared<torch::serving::PredictContext>(&request, &response);
+  auto add = [&](uint64_t size) {
+    auto task = std::make_shared<torch::serving::BatchTask>();
+    task->context = context;
+    task->size = size;
+    task->done = [](const torch::serving::PredictStatus&) {};
+    torch::serving::BatchTaskGroupPtr timer_group;
+    absl::Time close_time;
+    return queue.AddTask(task, &timer_group, &close_time);
+  };
+
+  // 30 + 10超过32, 先关闭30的批次
+  BOOST_CHECK_EQUAL(add(30), 0);
+  BOOST_CHECK_EQUAL(add(10), 1);
+  auto group = queue.GetTaskGroup();
+  BOOST_REQUIRE(group != nullptr);
+  BOOST_CHECK_EQUAL(group->item_size_, 30);
+  BOOST_CHECK(queue.GetTaskGroup() == nullptr);
+  // 超过最大批次的单个请求单独成批
+  BOOST_CHECK_EQUAL(add(40), 2);
+  group = queue.GetTaskGroup();
+  BOOST_REQUIRE(group != nullptr);
+  BOOST_CHECK_EQUAL(group->item_size_, 10);
+  group = queue.GetTaskGroup();
+  BOOST_REQUIRE(group != nullptr);
+  BOOST_CHECK_EQUAL(group->item_size_, 40);
+  BOOST_CHECK_EQUAL(group->task_list_.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(batch_async) {
+  const int request_num = 2000;
+
+  torch::serving::BatchConfig config;
+  config.set_max_batch_size(64);
+  config.set_batch_timeout_micros(1000);
+  config.set_num_batch_threads(2);
+  auto scheduler = std::make_shared<torch::serving::SharedBatchScheduler>(config);
+  auto servable = std::make_shared<torch::serving::BatchServable>(std::make_shared<MockServable>(), scheduler);
+
+  // 单个线程提交全部请求, 由批处理线程回调结束
+  std::vector<inference::ModelInferRequest> requests(request_num);
+  std::vector<inference::ModelInferResponse> responses(request_num);
+  std::mutex mutex;
+  std::condition_variable cv;
+  int finish_num = 0;
+  std::atomic_int error_num{0};
+  auto begin = absl::Now();
+  for (int i = 0; i < request_num; ++i) {
+    BuildRequest(i, &requests[i]);
+    auto context = std::make_shared<torch::serving::PredictContext>(&requests[i], &responses[i]);
+    servable->PredictAsync(context, [&, i](const torch::serving::PredictStatus& status) {
+      if (!status.Ok() || responses[i].outputs_size() != 1) {
+        ++error_num;
+      }
+      std::unique_lock lock(mutex);
+      if (++finish_num == request_num) {
+        cv.notify_one();
+      }
+    });
+  }
+  auto submit_cost = absl::Now() - begin;
+  {
+    std::unique_lock lock(mutex);
+    cv.wait(lock, [&]() { return finish_num == request_num; });
+  }
+  LOG(INFO) << "submit: " << absl::ToInt64Microseconds(submit_cost) << "us"
+            << "; total: " << absl::ToInt64Microseconds(absl::Now() - begin) << "us";
+  BOOST_CHECK_EQUAL(error_num.load(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(servable_warmup) {
+  auto path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  boost::filesystem::create_directories(path);
+  inference::ModelInferRequest request;
+  AddInput({5, kDim}, std::vector<float>(5 * kDim, 1), &request);
+  BOOST_REQUIRE(torch::serving::WritePbBin((path / torch::serving::WARMUP_FILE).string(), request));
+
+  // 原始请求一次, 之后每个批次大小各预热若干次; 超过批次大小的预热请求被截断
+  WarmupServable servable;
+  BOOST_CHECK(servable.Init(path.string()));
+  BOOST_REQUIRE(!servable.batch_list_.empty());
+  BOOST_CHECK_EQUAL(servable.batch_list_.front(), 5);
+  BOOST_CHECK(std::count(servable.batch_list_.begin(), servable.batch_list_.end(), 4) > 0);
+  BOOST_CHECK(std::count(servable.batch_list_.begin(), servable.batch_list_.end(), 8) > 0);
+  BOOST_CHECK(std::all_of(servable.batch_list_.begin() + 1, servable.batch_list_.end(), [](int64_t size) {
+    return size == 4 || size == 8;
+  }));
+  boost::filesystem::remove_all(path);
+}
+
+BOOST_AUTO_TEST_CASE(batch_dedup) {
+  MockServable servable;
+  auto& spec = servable.GetSpec();
+  torch::serving::ItemDeduper deduper(16);
+  auto run = [&](const std::vector<std::vector<int>>& seeds_list) {
+    std::vector<inference::ModelInferRequest> requests(seeds_list.size());
+    std::vector<inference::ModelInferResponse> responses(seeds_list.size());
+    std::vector<const inference::ModelInferRequest*> request_list;
+    std::vector<inference::ModelInferResponse*> response_list;
+    std::vector<size_t> item_size_list;
+    for (size_t i = 0; i < seeds_list.size(); ++i) {
+      AddItems(seeds_list[i], &requests[i]);
+      request_list.push_back(&requests[i]);
+      response_list.push_back(&responses[i]);
+      item_size_list.push_back(seeds_list[i].size());
+    }
+    inference::ModelInferRequest merged;
+    BOOST_REQUIRE(torch::serving::MergeRequest(request_list, spec, 0, false, &merged).Ok());
+    torch::serving::ItemDeduper::Plan plan;
+    deduper.Compact(&merged, &plan);
+    inference::ModelInferResponse response;
+    if (plan.infer_size > 0) {
+      torch::serving::PadRequest(plan.infer_size + 1, &merged);
+      BOOST_CHECK_EQUAL(merged.inputs(0).shape(0), plan.infer_size + 1);
+      auto context = std::make_shared<torch::serving::PredictContext>(&merged, &response);
+      BOOST_REQUIRE(servable.PredictWithoutCheck(context).Ok());
+    }
+    inference::ModelInferResponse expanded;
+    BOOST_REQUIRE(deduper.Expand(plan, response, &expanded).Ok());
+    torch::serving::SplitResponse(expanded, request_list, response_list, item_size_list);
+    for (size_t i = 0; i < seeds_list.size(); ++i) {
+      auto data = torch::serving::OutputData<float>(responses[i], 0);
+      std::vector<float> expect;
+      for (auto seed : seeds_list[i]) {
+        expect.push_back(ItemSum(seed));
+      }
+      BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), expect.begin(), expect.end());
+    }
+    return plan;
+  };
+
+  // 批次内重复的item只推理一次
+  auto plan = run({{1, 2, 1}, {2, 3}});
+  BOOST_CHECK_EQUAL(plan.item_size, 5);
+  BOOST_CHECK_EQUAL(plan.infer_size, 3);
+  BOOST_CHECK_EQUAL(plan.duplicate, 2);
+  // 之前批次的item命中缓存
+  plan = run({{3, 4}, {1, 4}});
+  BOOST_CHECK_EQUAL(plan.infer_size, 1);
+  BOOST_CHECK_EQUAL(plan.duplicate, 1);
+  plan = run({{2}, {1, 3}});
+  BOOST_CHECK_EQUAL(plan.infer_size, 0);
+
+  // 输出格式变化时本批次失败, 并清空缓存, 之后的批次重新推理
+  inference::ModelInferRequest request;
+  AddItems({1, 5}, &request);
+  inference::ModelInferRequest merged;
+  BOOST_REQUIRE(torch::serving::MergeRequest({&request}, spec, 0, false, &merged).Ok());
+  deduper.Compact(&merged, &plan);
+  BOOST_REQUIRE_EQUAL(plan.infer_size, 1);
+  inference::ModelInferResponse response;
+  auto* output = response.add_outputs();
+  output->set_name("other");
+  output->set_datatype(inference::DT_FLOAT);
+  output->add_shape(1);
+  output->mutable_contents()->add_fp32_contents(0);
+  inference::ModelInferResponse expanded;
+  BOOST_CHECK(deduper.Expand(plan, response, &expanded).Code() == torch::serving::PredictStatus::RESULT_TYPE_ERROR);
+  plan = run({{1, 2}});
+  BOOST_CHECK_EQUAL(plan.infer_size, 2);
+}
+
+BOOST_AUTO_TEST_CASE(batch_dedup_scheduler) {
+  const int request_num = 2000;
+  const int candidate_num = 64;
+  const int item_num = 8;
+
+  torch::serving::BatchConfig config;
+  config.set_max_batch_size(256);
+  config.set_batch_timeout_micros(1000);
+  config.set_num_batch_threads(1);
+  config.set_dedup_items(true);
+  config.set_item_cache_size(candidate_num / 2);
+  auto scheduler = std::make_shared<torch::serving::SharedBatchScheduler>(config);
+  auto inner = std::make_shared<WarmupServable>();
+  auto servable = std::make_shared<torch::serving::BatchServable>(inner, scheduler);
+
+  // 每个请求从候选集中取若干item, 候选在并发请求间大量重复
+  std::vector<inference::ModelInferRequest> requests(request_num);
+  std::vector<inference::ModelInferResponse> responses(request_num);
+  std::vector<std::vector<int>> seeds_list(request_num);
+  std::mutex mutex;
+  std::condition_variable cv;
+  int finish_num = 0;
+  std::atomic_int error_num{0};
+  for (int i = 0; i < request_num; ++i) {
+    for (int j = 0; j < item_num; ++j) {
+      seeds_list[i].push_back((i * 7 + j * 13) % candidate_num);
+    }
+    AddItems(seeds_list[i], &requests[i]);
+  }
+  for (int i = 0; i < request_num; ++i) {
+    auto context = std::make_shared<torch::serving::PredictContext>(&requests[i], &responses[i]);
+    servable->PredictAsync(context, [&, i](const torch::serving::PredictStatus& status) {
+      auto data = torch::serving::OutputData<float>(responses[i], 0);
+      if (!status.Ok() || data.size() != item_num) {
+        ++error_num;
+      } else {
+        for (int j = 0; j < item_num; ++j) {
+          error_num += data[j] != ItemSum(seeds_list[i][j]);
+        }
+      }
+      std::unique_lock lock(mutex);
+      if (++finish_num == request_num) {
+        cv.notify_one();
+      }
+    });
+  }
+  {
+    std::unique_lock lock(mutex);
+    cv.wait(lock, [&]() { return finish_num == request_num; });
+  }
+  int64_t infer_num = 0;
+  for (auto size : inner->batch_list_) {
+    infer_num += size;
+  }
+  LOG(INFO) << "items: " << request_num * item_num << "; inferred: " << infer_num
+            << "; batches: " << inner->batch_list_.size();
+  BOOST_CHECK_EQUAL(error_num.load(), 0);
+  BOOST_CHECK_LT(infer_num, request_num * item_num);
+}
@@ -0,0 +1,244 @@
+#define BOOST_TEST_MODULE torch
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+
+#include "server_config.pb.h"
+#include "model_spec.pb.h"
+#include "kserve_predict_v2.pb.h"
+#include "model/model_loader.h"
+#include "model/predict_context.h"
+#include "servables/ensemble_servable.h"
+#include "utils/tensor_utils.h"
+
+namespace {
+
+constexpr int kDim = 4;
+
+// 记录同时执行的步骤数; 进入后最多等待1s, 直到有两个步骤同时执行, 串行执行时最大值为1
+struct InFlight {
+  std::mutex mutex;
+  std::condition_variable cond;
+  int current{0};
+  int max{0};
+
+  void Enter() {
+    std::unique_lock lock(mutex);
+    max = std::max(max, ++current);
+    cond.notify_all();
+    cond.wait_for(lock, std::chrono::seconds(1), [this]() { return max >= 2; });
+  }
+  void Leave() {
+    std::lock_guard lock(mutex);
+    --current;
+  }
+};
+
+// 输出scale * (各输入之和) + bias; in_flight非空时记录并发, 并记录最近一次执行的线程
+class AffineServable : public torch::serving::IServable {
+ public:
+  AffineServable(const std::vector<std::string>& inputs, float scale, float bias, InFlight* in_flight = nullptr)
+    : scale_(scale), bias_(bias), in_flight_(in_flight) {
+    for (const auto& name : inputs) {
+      auto* feature = spec_.add_feature_specs();
+      feature->set_name(name);
+      feature->set_dtype(inference::DT_FLOAT);
+      feature->add_shape(kDim);
+    }
+    CompileChecker(spec_);
+  }
+  bool Init(const std::string &path) override {
+    return true;
+  }
+  torch::serving::PredictStatus PredictWithoutCheck(const torch::serving::PredictContextPtr &predict_context) override {
+    thread = std::this_thread::get_id();
+    if (in_flight_ != nullptr) {
+      in_flight_->Enter();
+      in_flight_->Leave();
+    }
+    auto& request = *predict_context->request_;
+    std::vector<float> result(torch::serving::InputData<float>(request, 0).size(), 0);
+    for (int i = 0; i < request.inputs_size(); ++i) {
+      auto data = torch::serving::InputData<float>(request, i);
+      for (size_t j = 0; j < result.size(); ++j) {
+        result[j] += data[j];
+      }
+    }
+    for (auto& value : result) {
+      value = value * scale_ + bias_;
+    }
+    auto* response = predict_context->response_;
+    auto* output = response->add_outputs();
+    output->set_name("y");
+    output->set_datatype(inference::DT_FLOAT);
+    output->mutable_shape()->CopyFrom(request.inputs(0).shape());
+    torch::serving::AddOutputData(result.data(), result.size(), torch::serving::UseRawOutput(request), response, output);
+    return {torch::serving::PredictStatus::OK};
+  }
+  const std::string &GetLabel() override {
+    return label_;
+  }
+  const inference::ModelSpec &GetSpec() override {
+    return spec_;
+  }
+
+  std::thread::id thread;
+
+ private:
+  const float scale_;
+  const float bias_;
+  InFlight* const in_flight_;
+  std::string label_;
+  inference::ModelSpec spec_;
+};
+
+void AddStep(const std::string& model, const std::map<std::string, std::string>& inputs, const std::string& output,
+             torch::serving::EnsembleConfig* config) {
+  auto* step = config->add_steps();
+  step->set_model_name(model);
+  step->mutable_input_map()->insert(inputs.begin(), inputs.end());
+  (*step->mutable_output_map())["y"] = output;
+}
+
+// transform -> (embedding, feature) -> ranker
+torch::serving::EnsembleConfig DiamondConfig() {
+  torch::serving::EnsembleConfig config;
+  AddStep("transform", {{"x", "raw"}}, "feature", &config);
+  AddStep("embedding", {{"x", "feature"}}, "embedding", &config);
+  AddStep("cross", {{"x", "feature"}}, "cross", &config);
+  AddStep("ranker", {{"a", "embedding"}, {"b", "cross"}}, "score", &config);
+  return config;
+}
+
+inference::ModelInferRequest BuildRequest(bool raw) {
+  inference::ModelInferRequest request;
+  request.set_id("id");
+  request.set_model_name("ensemble");
+  auto* input = request.add_inputs();
+  input->set_name("raw");
+  input->set_datatype(inference::DT_FLOAT);
+  input->add_shape(2);
+  input->add_shape(kDim);
+  std::vector<float> data(2 * kDim);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = i;
+  }
+  if (raw) {
+    request.add_raw_input_contents()->assign(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(float));
+  } else {
+    input->mutable_contents()->mutable_fp32_contents()->Add(data.begin(), data.end());
+  }
+  return request;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(ensemble_dag) {
+  InFlight in_flight;
+  auto transform = std::make_shared<AffineServable>(std::vector<std::string>{"x"}, 1, 1);
+  auto cross = std::make_shared<AffineServable>(std::vector<std::string>{"x"}, 3, 0, &in_flight);
+  std::map<std::string, std::shared_ptr<torch::serving::IServable>> servables{
+      {"transform", transform},
+      {"embedding", std::make_shared<AffineServable>(std::vector<std::string>{"x"}, 2, 0, &in_flight)},
+      {"cross", cross},
+      {"ranker", std::make_shared<AffineServable>(std::vector<std::string>{"a", "b"}, 1, -1)},
+  };
+  auto resolver = [&](const std::string& name, torch::serving::ModelVersion version) -> std::shared_ptr<torch::serving::IServable> {
+    auto it = servables.find(name);
+    return it == servables.end() ? nullptr : it->second;
+  };
+  torch::serving::ModelLoader pool(2);
+  torch::serving::EnsembleServable ensemble(DiamondConfig(), resolver, [&pool](std::function<void()> task) {
+    pool.Schedule(std::move(task));
+  });
+  BOOST_REQUIRE(ensemble.Init("ensemble"));
+  BOOST_REQUIRE_EQUAL(ensemble.GetSpec().feature_specs_size(), 1);
+  BOOST_CHECK_EQUAL(ensemble.GetSpec().feature_specs(0).name(), "raw");
+
+  for (bool raw : {false, true}) {
+    auto request = BuildRequest(raw);
+    inference::ModelInferResponse response;
+    auto context = std::make_shared<torch::serving::PredictContext>(&request, &response);
+    in_flight.max = 0;
+    auto status = ensemble.Predict(context);
+    BOOST_REQUIRE_MESSAGE(status.Ok(), status.Message());
+    BOOST_REQUIRE_EQUAL(response.outputs_size(), 1);
+    BOOST_CHECK_EQUAL(response.outputs(0).name(), "score");
+    BOOST_CHECK_EQUAL(response.raw_output_contents_size(), raw ? 1 : 0);
+    auto data = torch::serving::OutputData<float>(response, 0);
+    BOOST_REQUIRE_EQUAL(data.size(), 2 * kDim);
+    for (size_t i = 0; i < data.size(); ++i) {
+      // (x + 1) * 2 + (x + 1) * 3 - 1
+      BOOST_CHECK_EQUAL(data[i], (i + 1) * 5 - 1);
+    }
+    // 两个分支并发执行
+    BOOST_CHECK_EQUAL(in_flight.max, 2);
+    // 根步骤在请求线程执行, 后续步骤不占用上游步骤的回调线程
+    BOOST_CHECK(transform->thread == std::this_thread::get_id());
+    BOOST_CHECK(cross->thread != std::this_thread::get_id());
+  }
+  {
+    // 请求不能覆盖步骤生产的张量
+    auto request = BuildRequest(false);
+    request.add_inputs()->CopyFrom(request.inputs(0));
+    request.mutable_inputs(1)->set_name("feature");
+    inference::ModelInferResponse response;
+    auto status = ensemble.Predict(std::make_shared<torch::serving::PredictContext>(&request, &response));
+    BOOST_CHECK(status.Code() == torch::serving::PredictStatus::FEATURE_SIZE_ERROR);
+  }
+  {
+    // 重复的输入
+    auto request = BuildRequest(false);
+    request.add_inputs()->CopyFrom(request.inputs(0));
+    inference::ModelInferResponse response;
+    auto status = ensemble.Predict(std::make_shared<torch::serving::PredictContext>(&request, &response));
+    BOOST_CHECK(status.Code() == torch::serving::PredictStatus::FEATURE_SIZE_ERROR);
+  }
+
+  {
+    // raw_input_contents与inputs个数不一致
+    auto request = BuildRequest(true);
+    request.add_raw_input_contents();
+    inference::ModelInferResponse response;
+    auto status = ensemble.Predict(std::make_shared<torch::serving::PredictContext>(&request, &response));
+    BOOST_CHECK(status.Code() == torch::serving::PredictStatus::FEATURE_SIZE_ERROR);
+  }
+
+  // 步骤的模型不存在
+  servables.erase("cross");
+  auto request = BuildRequest(false);
+  inference::ModelInferResponse response;
+  auto status = ensemble.Predict(std::make_shared<torch::serving::PredictContext>(&request, &response));
+  BOOST_CHECK(status.Code() == torch::serving::PredictStatus::MISS_SERVABLE);
+}
+
+BOOST_AUTO_TEST_CASE(ensemble_invalid) {
+  auto resolver = [](const std::string& name, torch::serving::ModelVersion version) {
+    return std::shared_ptr<torch::serving::IServable>();
+  };
+  {
+    torch::serving::EnsembleConfig config;
+    AddStep("a", {{"x", "t2"}}, "t1", &config);
+    AddStep("b", {{"x", "t1"}}, "t2", &config);
+    config.add_outputs("t2");
+    BOOST_CHECK(!torch::serving::EnsembleServable(config, resolver).Init("cycle"));
+  }
+  {
+    torch::serving::EnsembleConfig config;
+    AddStep("a", {{"x", "in"}}, "t1", &config);
+    AddStep("b", {{"x", "in"}}, "t1", &config);
+    BOOST_CHECK(!torch::serving::EnsembleServable(config, resolver).Init("duplicate"));
+  }
+  {
+    torch::serving::EnsembleConfig config;
+    AddStep("a", {{"x", "in"}}, "t1", &config);
+    config.add_outputs("t2");
+    BOOST_CHECK(!torch::serving::EnsembleServable(config, resolver).Init("output"));
+  }
+}
@@ -0,0 +1,174 @@
+#define BOOST_TEST_MODULE torch
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <set>
+#include <vector>
+#include <unordered_map>
+#include <absl/time/clock.h>
+#include <absl/strings/str_cat.h>
+#include <glog/logging.h>
+
+#include "model_spec.pb.h"
+#include "kserve_predict_v2.pb.h"
+#include "servables/feature_checker.h"
+
+namespace {
+
+constexpr int kFeatureNum = 20;
+constexpr int kDim = 8;
+constexpr int kRound = 100000;
+
+inference::ModelSpec BuildSpec() {
+  inference::ModelSpec spec;
+  for (int i = 0; i < kFeatureNum; ++i) {
+    auto* feature = spec.add_feature_specs();
+    feature->set_name(absl::StrCat("feature_", i));
+    feature->set_dtype(inference::DT_FLOAT);
+    feature->add_shape(kDim);
+  }
+  return spec;
+}
+
+void BuildRequest(int64_t item_size, inference::ModelInferRequest* request) {
+  // 与spec逆序, 覆盖按名查找
+  for (int i = kFeatureNum - 1; i >= 0; --i) {
+    auto* input = request->add_inputs();
+    input->set_name(absl::StrCat("feature_", i));
+    input->set_datatype(inference::DT_FLOAT);
+    input->add_shape(item_size);
+    input->add_shape(kDim);
+    input->mutable_contents()->mutable_fp32_contents()->Resize(item_size * kDim, 0);
+  }
+}
+
+// 原std::set实现, 作为对比基准
+bool LegacyCheck(const inference::ModelInferRequest& request, const inference::ModelSpec& model_spec) {
+  std::set<std::string> input_name;
+  std::set<std::string> expect_name;
+  for (const auto& entry : request.inputs()) {
+    input_name.insert(entry.name());
+  }
+  for (const auto& entry : model_spec.feature_specs()) {
+    expect_name.insert(entry.name());
+  }
+  if (input_name != expect_name) {
+    return false;
+  }
+  std::unordered_map<std::string, const inference::ModelInferRequest::InferInputTensor*> input_map;
+  for (const auto& entry : request.inputs()) {
+    input_map.insert(std::make_pair(entry.name(), &entry));
+  }
+  for (const auto& feature : model_spec.feature_specs()) {
+    auto& tensor_proto = *input_map[feature.name()];
+    if (tensor_proto.datatype() != feature.dtype() || tensor_proto.shape_size() != feature.shape_size() + 1) {
+      return false;
+    }
+    std::vector<int64_t> shape(tensor_proto.shape().begin() + 1, tensor_proto.shape().end());
+    for (int i = 0; i < feature.shape_size(); ++i) {
+      if (feature.shape(i) >= 0 && shape[i] != feature.shape(i)) {
+        return false;
+      }
+    }
+    int64_t expect_size = 1;
+    for (const auto& dim : tensor_proto.shape()) {
+      expect_size *= dim;
+    }
+    if (tensor_proto.contents().fp32_contents_size() != expect_size) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(feature_checker_bench) {
+  auto spec = BuildSpec();
+  torch::serving::FeatureChecker checker;
+  checker.Compile(spec);
+  inference::ModelInferRequest request;
+  BuildRequest(1, &request);
+
+  int ok_num = 0;
+  auto begin = absl::Now();
+  for (int i = 0; i < kRound; ++i) {
+    ok_num += LegacyCheck(request, spec);
+  }
+  auto legacy_cost = absl::Now() - begin;
+  begin = absl::Now();
+  for (int i = 0; i < kRound; ++i) {
+    ok_num += checker.Check(request).Ok();
+  }
+  auto compiled_cost = absl::Now() - begin;
+  LOG(INFO) << "feature: " << kFeatureNum
+            << "; legacy: " << absl::ToDoubleNanoseconds(legacy_cost) / kRound << "ns"
+            << "; compiled: " << absl::ToDoubleNanoseconds(compiled_cost) / kRound << "ns";
+  BOOST_CHECK_EQUAL(ok_num, 2 * kRound);
+}
+
+BOOST_AUTO_TEST_CASE(feature_checker_error) {
+  auto spec = BuildSpec();
+  spec.mutable_feature_specs(0)->set_shape(0, -1);
+  torch::serving::FeatureChecker checker;
+  checker.Compile(spec);
+  {
+    // 变长维度
+    inference::ModelInferRequest request;
+    BuildRequest(2, &request);
+    auto* input = request.mutable_inputs(kFeatureNum - 1);
+    input->set_shape(1, 3);
+    input->mutable_contents()->mutable_fp32_contents()->Resize(6, 0);
+    BOOST_CHECK(checker.Check(request).Ok());
+  }
+  {
+    // 负数维度, 乘积与元素数相同
+    inference::ModelInferRequest request;
+    BuildRequest(2, &request);
+    auto* input = request.mutable_inputs(kFeatureNum - 1);
+    input->set_shape(0, -2);
+    input->set_shape(1, -3);
+    input->mutable_contents()->mutable_fp32_contents()->Resize(6, 0);
+    BOOST_CHECK(checker.Check(request).Code() == torch::serving::PredictStatus::SHAPE_ERROR);
+  }
+  {
+    // 乘积溢出后等于元素数
+    inference::ModelInferRequest request;
+    BuildRequest(4, &request);
+    auto* input = request.mutable_inputs(kFeatureNum - 1);
+    input->set_shape(1, (int64_t{1} << 62) + 2);
+    input->mutable_contents()->mutable_fp32_contents()->Resize(8, 0);
+    BOOST_CHECK(checker.Check(request).Code() == torch::serving::PredictStatus::SHAPE_ERROR);
+  }
+  {
+    inference::ModelInferRequest request;
+    BuildRequest(1, &request);
+    request.mutable_inputs(0)->set_name("unknown");
+    BOOST_CHECK(checker.Check(request).Code() == torch::serving::PredictStatus::MISS_FEATURE);
+  }
+  {
+    inference::ModelInferRequest request;
+    BuildRequest(1, &request);
+    request.mutable_inputs(0)->set_name(request.inputs(1).name());
+    BOOST_CHECK(checker.Check(request).Code() == torch::serving::PredictStatus::FEATURE_SIZE_ERROR);
+  }
+  {
+    inference::ModelInferRequest request;
+    BuildRequest(1, &request);
+    request.mutable_inputs(1)->set_datatype(inference::DT_INT32);
+    BOOST_CHECK(checker.Check(request).Code() == torch::serving::PredictStatus::FEATURE_TYPE_ERROR);
+  }
+  {
+    inference::ModelInferRequest request;
+    BuildRequest(1, &request);
+    request.mutable_inputs(1)->mutable_contents()->add_fp32_contents(0);
+    BOOST_CHECK(checker.Check(request).Code() == torch::serving::PredictStatus::SHAPE_ERROR);
+  }
+  {
+    inference::ModelInferRequest request;
+    BuildRequest(1, &request);
+    request.mutable_inputs(1)->set_shape(0, 2);
+    request.mutable_inputs(1)->mutable_contents()->mutable_fp32_contents()->Resize(2 * kDim, 0);
+    BOOST_CHECK(checker.Check(request).Code() == torch::serving::PredictStatus::ITEM_ERROR);
+  }
+}
@@ -0,0 +1,130 @@
+#define BOOST_TEST_MODULE torch
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <absl/time/clock.h>
+#include <glog/logging.h>
+#include <prometheus/registry.h>
+#include <prometheus/collectable.h>
+#include <prometheus/metric_family.h>
+
+#include "service/metrics.h"
+#include "utils/histogram.h"
+
+namespace {
+
+constexpr int kThreadNum = 8;
+constexpr int kRound = 200000;
+
+// 单锁直方图, 作为对比基准
+class LockedHistogram {
+ public:
+  explicit LockedHistogram(std::vector<int64_t> bounds) : bounds_(std::move(bounds)), counts_(bounds_.size() + 1, 0) {}
+  void Observe(int64_t value) {
+    std::lock_guard lock(mutex_);
+    counts_[std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin()]++;
+    sum_ += value;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<int64_t> bounds_;
+  std::vector<uint64_t> counts_;
+  int64_t sum_{0};
+};
+
+template<typename H>
+double RunConcurrent(H& histogram) {
+  auto begin = absl::Now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreadNum; ++i) {
+    threads.emplace_back([&histogram, i]() {
+      for (int j = 0; j < kRound; ++j) {
+        histogram.Observe((i * kRound + j) % 3000);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return absl::ToDoubleNanoseconds(absl::Now() - begin) / (kThreadNum * kRound);
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(histogram_bucket) {
+  torch::serving::Histogram histogram({10, 100});
+  for (int64_t value : {1, 10, 11, 100, 1000}) {
+    histogram.Observe(value);
+  }
+  auto snapshot = histogram.Collect();
+  BOOST_CHECK_EQUAL(snapshot.count, 5);
+  BOOST_CHECK_EQUAL(snapshot.sum, 1122);
+  BOOST_REQUIRE_EQUAL(snapshot.counts.size(), 3);
+  BOOST_CHECK_EQUAL(snapshot.counts[0], 2);
+  BOOST_CHECK_EQUAL(snapshot.counts[1], 2);
+  BOOST_CHECK_EQUAL(snapshot.counts[2], 1);
+}
+
+BOOST_AUTO_TEST_CASE(histogram_concurrent) {
+  torch::serving::Histogram histogram(torch::serving::LatencyBuckets());
+  auto sharded_cost = RunConcurrent(histogram);
+  LockedHistogram locked(torch::serving::LatencyBuckets());
+  auto locked_cost = RunConcurrent(locked);
+  LOG(INFO) << "threads: " << kThreadNum << "; sharded: " << sharded_cost << "ns/observe"
+            << "; locked: " << locked_cost << "ns/observe";
+  BOOST_CHECK_EQUAL(histogram.Collect().count, kThreadNum * kRound);
+}
+
+BOOST_AUTO_TEST_CASE(stage_histograms_collect) {
+  auto registry = std::make_shared<prometheus::Registry>();
+  torch::serving::Metrics metrics(registry);
+  auto* histograms = metrics.GetStageHistograms("model", 1);
+  BOOST_CHECK_EQUAL(histograms, metrics.GetStageHistograms("model", 1));
+  BOOST_CHECK_NE(histograms, metrics.GetStageHistograms("model", 2));
+  histograms->predict->Observe(300);
+  histograms->batch_size->Observe(16);
+
+  auto families = metrics.GetCollectable()->Collect();
+  BOOST_REQUIRE_EQUAL(families.size(), 2);
+  for (const auto& family : families) {
+    for (const auto& metric : family.metric) {
+      bool first_version = false;
+      bool predict_stage = family.name == "batch_size";
+      for (const auto& label : metric.label) {
+        first_version |= label.name == "version" && label.value == "1";
+        predict_stage |= label.name == "stage" && label.value == "predict";
+      }
+      bool observed = first_version && predict_stage;
+      BOOST_CHECK_EQUAL(metric.histogram.sample_count, observed ? 1 : 0);
+      BOOST_CHECK_EQUAL(metric.histogram.bucket.back().cumulative_count, metric.histogram.sample_count);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(stage_histograms_remove) {
+  auto registry = std::make_shared<prometheus::Registry>();
+  torch::serving::Metrics metrics(registry);
+  auto* histograms = metrics.GetStageHistograms("model", 1);
+  metrics.GetStageHistograms("model", 2);
+  // 卸载版本后不再导出, 之前取得的指针在本线程下次查找前仍可使用
+  metrics.RemoveStageHistograms("model", 1);
+  histograms->predict->Observe(300);
+  // 卸载后仍在处理的请求不会重新创建
+  BOOST_CHECK(metrics.GetStageHistograms("model", 1) == nullptr);
+  for (const auto& family : metrics.GetCollectable()->Collect()) {
+    for (const auto& metric : family.metric) {
+      for (const auto& label : metric.label) {
+        BOOST_CHECK(label.name != "version" || label.value == "2");
+      }
+    }
+  }
+  BOOST_CHECK_EQUAL(metrics.GetStageHistograms("model", 2), metrics.GetStageHistograms("model", 2));
+  // 同一版本重新加载
+  metrics.AddStageHistograms("model", 1);
+  BOOST_CHECK(metrics.GetStageHistograms("model", 1) != nullptr);
+}
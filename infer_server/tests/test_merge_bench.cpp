@@ -0,0 +1,153 @@
+#define BOOST_TEST_MODULE torch
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+#include <absl/time/clock.h>
+#include <glog/logging.h>
+
+#include "model_spec.pb.h"
+#include "kserve_predict_v2.pb.h"
+#include "batch/tensor_arena.h"
+#include "batch/shared_batch_scheduler.h"
+#include "utils/tensor_utils.h"
+
+namespace {
+
+constexpr int kBatch = 64;
+constexpr int kDim = 256;
+constexpr int kRound = 2000;
+
+inference::ModelSpec BuildSpec() {
+  inference::ModelSpec spec;
+  auto* feature = spec.add_feature_specs();
+  feature->set_name("x");
+  feature->set_dtype(inference::DT_FLOAT);
+  feature->add_shape(kDim);
+  return spec;
+}
+
+// 模拟推理结果: 每个item输出kDim维
+void BuildResponse(const inference::ModelInferRequest& request, inference::ModelInferResponse* response) {
+  auto* output = response->add_outputs();
+  output->set_name("y");
+  output->set_datatype(inference::DT_FLOAT);
+  output->mutable_shape()->Add(request.inputs(0).shape().begin(), request.inputs(0).shape().end());
+  auto data = torch::serving::InputData<float>(request, 0);
+  output->mutable_contents()->mutable_fp32_contents()->Add(data.begin(), data.end());
+}
+
+// 改动前的合并方式, 作为对比基准: 每个批次新建请求, 特征拷贝到typed repeated字段
+void TypedMerge(const std::vector<const inference::ModelInferRequest*>& request_list, const inference::ModelSpec& spec,
+                inference::ModelInferRequest* request) {
+  for (const auto& feature_spec : spec.feature_specs()) {
+    auto* merge_proto = request->add_inputs();
+    merge_proto->set_name(feature_spec.name());
+    merge_proto->set_datatype(feature_spec.dtype());
+    merge_proto->add_shape(request_list.size());
+    merge_proto->add_shape(kDim);
+    auto* merge_data = torch::serving::MutableContents<float>(merge_proto->mutable_contents());
+    merge_data->Resize(request_list.size() * kDim, 0);
+    float* data = merge_data->mutable_data();
+    for (const auto& sub_request : request_list) {
+      auto& sub_data = torch::serving::GetContents<float>(sub_request->inputs(0).contents());
+      std::copy(sub_data.begin(), sub_data.end(), data);
+      data += sub_data.size();
+    }
+  }
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(merge_bench) {
+  auto spec = BuildSpec();
+  std::vector<inference::ModelInferRequest> sub_requests(kBatch);
+  std::vector<inference::ModelInferResponse> sub_responses(kBatch);
+  std::vector<const inference::ModelInferRequest*> request_list;
+  std::vector<inference::ModelInferResponse*> response_list;
+  std::vector<size_t> item_size_list(kBatch, 1);
+  for (int i = 0; i < kBatch; ++i) {
+    auto* input = sub_requests[i].add_inputs();
+    input->set_name("x");
+    input->set_datatype(inference::DT_FLOAT);
+    input->add_shape(1);
+    input->add_shape(kDim);
+    for (int j = 0; j < kDim; ++j) {
+      input->mutable_contents()->add_fp32_contents(static_cast<float>(i * kDim + j));
+    }
+    request_list.push_back(&sub_requests[i]);
+    response_list.push_back(&sub_responses[i]);
+  }
+
+  auto run = [&](auto&& acquire, auto&& release, bool typed = false) {
+    auto begin = absl::Now();
+    for (int round = 0; round < kRound; ++round) {
+      auto block = acquire();
+      if (typed) {
+        TypedMerge(request_list, spec, &block->request);
+      } else {
+        BOOST_REQUIRE(torch::serving::MergeRequest(request_list, spec, kBatch, false, &block->request).Ok());
+      }
+      BuildResponse(block->request, &block->response);
+      for (auto& response : sub_responses) {
+        response.Clear();
+      }
+      torch::serving::SplitResponse(block->response, request_list, response_list, item_size_list);
+      release(std::move(block));
+    }
+    return absl::ToDoubleMicroseconds(absl::Now() - begin) / kRound;
+  };
+
+  // 每个批次重新分配请求/结果对象
+  auto fresh = []() { return std::make_unique<torch::serving::TensorArena::Block>(); };
+  auto drop = [](torch::serving::TensorArena::BlockPtr block) {};
+  auto typed_cost = run(fresh, drop, true);
+  auto fresh_cost = run(fresh, drop);
+  // 复用TensorArena中的对象
+  torch::serving::TensorArena arena(1);
+  auto pooled_cost = run([&]() { return arena.Acquire(); },
+                         [&](torch::serving::TensorArena::BlockPtr block) { arena.Release(std::move(block)); });
+  LOG(INFO) << "batch: " << kBatch << "; dim: " << kDim
+            << "; typed: " << typed_cost << "us/batch"
+            << "; fresh: " << fresh_cost << "us/batch"
+            << "; pooled: " << pooled_cost << "us/batch";
+
+  for (int i = 0; i < kBatch; ++i) {
+    auto& output = sub_responses[i].outputs(0);
+    BOOST_REQUIRE_EQUAL(output.contents().fp32_contents_size(), kDim);
+    BOOST_CHECK_EQUAL(output.contents().fp32_contents(kDim - 1), static_cast<float>(i * kDim + kDim - 1));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(merge_raw_input) {
+  auto spec = BuildSpec();
+  // 子请求本身使用raw_input_contents
+  inference::ModelInferRequest sub_request;
+  auto* input = sub_request.add_inputs();
+  input->set_name("x");
+  input->set_datatype(inference::DT_FLOAT);
+  input->add_shape(2);
+  input->add_shape(kDim);
+  std::vector<float> data(2 * kDim);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<float>(i);
+  }
+  sub_request.add_raw_input_contents()->assign(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(float));
+
+  torch::serving::TensorArena arena(1);
+  auto block = arena.Acquire();
+  BOOST_REQUIRE(torch::serving::MergeRequest({&sub_request}, spec, 4, false, &block->request).Ok());
+  BOOST_CHECK_EQUAL(block->request.raw_input_contents_size(), 1);
+  BOOST_CHECK_EQUAL(block->request.inputs(0).shape(0), 4);
+  auto merged = torch::serving::InputData<float>(block->request, 0);
+  BOOST_REQUIRE_EQUAL(merged.size(), 4 * kDim);
+  BOOST_CHECK_EQUAL(merged[2 * kDim - 1], data.back());
+  BOOST_CHECK_EQUAL(merged[2 * kDim], 0);
+
+  // 归还后内存保留, 再次合并不重新分配
+  const char* buffer = block->request.raw_input_contents(0).data();
+  arena.Release(std::move(block));
+  block = arena.Acquire();
+  BOOST_REQUIRE(torch::serving::MergeRequest({&sub_request}, spec, 4, false, &block->request).Ok());
+  BOOST_CHECK(block->request.raw_input_contents(0).data() == buffer);
+}
@@ -0,0 +1,167 @@
+#define BOOST_TEST_MODULE torch
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <absl/time/clock.h>
+#include <glog/logging.h>
+#include <boost/filesystem.hpp>
+
+#include "model_spec.pb.h"
+#include "kserve_predict_v2.pb.h"
+#include "servables/servable.h"
+#include "servables/async_servable.h"
+#include "model/model_loader.h"
+#include "model/servable_model.h"
+#include "model/predict_context.h"
+
+namespace {
+
+constexpr int kLoadMs = 50;
+
+// 模拟耗时的模型加载
+class SlowServable : public torch::serving::IServable {
+ public:
+  bool Init(const std::string &path) override {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kLoadMs));
+    return true;
+  }
+  torch::serving::PredictStatus PredictWithoutCheck(const torch::serving::PredictContextPtr &predict_context) override {
+    return {torch::serving::PredictStatus::OK};
+  }
+  const std::string &GetLabel() override {
+    return label_;
+  }
+  const inference::ModelSpec &GetSpec() override {
+    return spec_;
+  }
+
+ private:
+  std::string label_;
+  inference::ModelSpec spec_;
+};
+
+class SlowFactory : public torch::serving::ServableFactory {
+ public:
+  std::shared_ptr<torch::serving::IServable> New() override {
+    return std::make_shared<SlowServable>();
+  }
+};
+
+std::unique_ptr<torch::serving::ServableModel> NewModel(const std::shared_ptr<torch::serving::MemoryBudget>& budget, uint64_t memory_bytes) {
+  return std::make_unique<torch::serving::ServableModel>(std::make_shared<SlowFactory>(), "model", "/tmp", budget, memory_bytes);
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(memory_budget) {
+  torch::serving::MemoryBudget budget(100);
+  BOOST_CHECK(budget.Reserve(60));
+  BOOST_CHECK(!budget.Reserve(50));
+  BOOST_CHECK(budget.Reserve(40));
+  budget.Release(60);
+  BOOST_CHECK_EQUAL(budget.Used(), 40);
+  BOOST_CHECK(budget.Reserve(50));
+
+  torch::serving::MemoryBudget unlimited(0);
+  BOOST_CHECK(unlimited.Reserve(1ull << 40));
+}
+
+BOOST_AUTO_TEST_CASE(model_loader_parallel) {
+  constexpr int kTaskNum = 8;
+  auto run = [](uint32_t thread_num) {
+    torch::serving::ModelLoader loader(thread_num);
+    std::mutex mutex;
+    std::condition_variable cond;
+    int remain = kTaskNum;
+    auto begin = absl::Now();
+    for (int i = 0; i < kTaskNum; ++i) {
+      loader.Schedule([&]() {
+        SlowServable().Init("");
+        std::lock_guard lock(mutex);
+        --remain;
+        cond.notify_all();
+      });
+    }
+    std::unique_lock lock(mutex);
+    cond.wait(lock, [&]() { return remain == 0; });
+    return absl::ToDoubleMilliseconds(absl::Now() - begin);
+  };
+  auto serial_cost = run(1);
+  auto parallel_cost = run(kTaskNum);
+  LOG(INFO) << "load " << kTaskNum << " versions; serial: " << serial_cost << "ms; parallel: " << parallel_cost << "ms";
+  BOOST_CHECK_LT(parallel_cost, serial_cost);
+}
+
+BOOST_AUTO_TEST_CASE(async_servable) {
+  auto loader = std::make_shared<torch::serving::ModelLoader>(1);
+  torch::serving::AsyncServable servable(std::make_shared<SlowServable>(), [loader](std::function<void()> task) {
+    loader->Schedule(std::move(task));
+  });
+  inference::ModelInferRequest request;
+  inference::ModelInferResponse response;
+  auto context = std::make_shared<torch::serving::PredictContext>(&request, &response);
+  // 推理在线程池中执行并回调, 不占用调用线程
+  std::promise<std::thread::id> promise;
+  servable.PredictAsync(context, [&promise](const torch::serving::PredictStatus& status) {
+    BOOST_CHECK(status.Ok());
+    promise.set_value(std::this_thread::get_id());
+  });
+  auto future = promise.get_future();
+  BOOST_REQUIRE(future.wait_for(std::chrono::seconds(1)) == std::future_status::ready);
+  BOOST_CHECK(future.get() != std::this_thread::get_id());
+}
+
+BOOST_AUTO_TEST_CASE(latest_policy_swap) {
+  auto budget = std::make_shared<torch::serving::MemoryBudget>(250);
+  torch::serving::LatestPolicyTorchModel model(NewModel(budget, 100), 1);
+  {
+    torch::serving::ModelState state;
+    state.to_add_list = {1, 2};
+    model.UpdateModel(&state);
+    // 只加载最新版本
+    BOOST_CHECK(state.to_add_list == std::vector<torch::serving::ModelVersion>{2});
+    BOOST_CHECK_EQUAL(budget->Used(), 100);
+  }
+  {
+    // 加载新版本时老版本仍可用, 切换后卸载
+    torch::serving::ModelState state;
+    state.to_add_list = {3};
+    model.Plan(&state);
+    BOOST_REQUIRE(model.Load(3));
+    BOOST_CHECK_EQUAL(budget->Used(), 200);
+    model.Retain(&state);
+    BOOST_CHECK(model.GetServableByVersion(2) == nullptr);
+    BOOST_CHECK(model.GetServableByVersion() != nullptr);
+    BOOST_CHECK_EQUAL(budget->Used(), 100);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(memory_budget_admission) {
+  auto budget = std::make_shared<torch::serving::MemoryBudget>(150);
+  torch::serving::AllPolicyTorchModel first(NewModel(budget, 100));
+  torch::serving::AllPolicyTorchModel second(NewModel(budget, 100));
+  torch::serving::ModelState state;
+  state.to_add_list = {1};
+  first.UpdateModel(&state);
+  BOOST_CHECK(first.Ready());
+  // 预算不足, 拒绝加载
+  state.to_add_list = {1};
+  second.UpdateModel(&state);
+  BOOST_CHECK(state.to_add_list.empty());
+  BOOST_CHECK(!second.Ready());
+  BOOST_CHECK_EQUAL(budget->Used(), 100);
+  // 卸载后归还预算, 下一轮重试成功
+  state.to_add_list.clear();
+  state.to_rm_list = {1};
+  first.UpdateModel(&state);
+  BOOST_CHECK_EQUAL(budget->Used(), 0);
+  state.to_add_list = {1};
+  state.to_rm_list.clear();
+  second.UpdateModel(&state);
+  BOOST_CHECK(second.Ready());
+}
@@ -0,0 +1,163 @@
+#define BOOST_TEST_MODULE torch
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+#include <absl/time/clock.h>
+#include <glog/logging.h>
+
+#include "model_spec.pb.h"
+#include "kserve_predict_v2.pb.h"
+#include "batch/shared_batch_scheduler.h"
+#include "servables/feature_checker.h"
+#include "utils/tensor_utils.h"
+
+namespace {
+
+constexpr int kDim = 16;
+constexpr int kRound = 20;
+
+inference::ModelSpec BuildSpec() {
+  inference::ModelSpec spec;
+  auto* feature = spec.add_feature_specs();
+  feature->set_name("x");
+  feature->set_dtype(inference::DT_FLOAT);
+  feature->add_shape(kDim);
+  return spec;
+}
+
+void BuildRequest(const std::vector<float>& data, int64_t item_size, bool raw, inference::ModelInferRequest* request) {
+  auto* input = request->add_inputs();
+  input->set_name("x");
+  input->set_datatype(inference::DT_FLOAT);
+  input->add_shape(item_size);
+  input->add_shape(kDim);
+  if (raw) {
+    request->add_raw_input_contents()->assign(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(float));
+  } else {
+    input->mutable_contents()->mutable_fp32_contents()->Add(data.begin(), data.end());
+  }
+}
+
+}
+
+// 对比typed和raw两种编码下: 客户端序列化, 服务端反序列化, 特征校验, 结果序列化的耗时
+BOOST_AUTO_TEST_CASE(raw_contents_bench) {
+  auto spec = BuildSpec();
+  torch::serving::FeatureChecker checker;
+  checker.Compile(spec);
+  for (int64_t item_size : {1000, 10000, 100000}) {
+    std::vector<float> data(item_size * kDim);
+    for (size_t i = 0; i < data.size(); ++i) {
+      data[i] = static_cast<float>(i) * 0.5f;
+    }
+    for (bool raw : {false, true}) {
+      absl::Duration encode_cost;
+      absl::Duration decode_cost;
+      absl::Duration check_cost;
+      absl::Duration output_cost;
+      size_t bytes = 0;
+      for (int round = 0; round < kRound; ++round) {
+        std::string buffer;
+        auto start = absl::Now();
+        {
+          inference::ModelInferRequest request;
+          BuildRequest(data, item_size, raw, &request);
+          request.SerializeToString(&buffer);
+        }
+        encode_cost += absl::Now() - start;
+        bytes = buffer.size();
+
+        start = absl::Now();
+        inference::ModelInferRequest request;
+        BOOST_REQUIRE(request.ParseFromString(buffer));
+        decode_cost += absl::Now() - start;
+
+        start = absl::Now();
+        BOOST_REQUIRE(checker.Check(request).Ok());
+        check_cost += absl::Now() - start;
+
+        // 结果与输入同尺寸, 按请求的编码方式返回
+        start = absl::Now();
+        inference::ModelInferResponse response;
+        auto* output = response.add_outputs();
+        output->set_name("y");
+        auto input_data = torch::serving::InputData<float>(request, 0);
+        torch::serving::AddOutputData<float>(input_data.data(), input_data.size(), torch::serving::UseRawOutput(request), &response, output);
+        response.SerializeToString(&buffer);
+        output_cost += absl::Now() - start;
+        BOOST_CHECK_EQUAL(input_data.size(), data.size());
+      }
+      LOG(INFO) << (raw ? "raw  " : "typed") << " items: " << item_size << "; bytes: " << bytes
+                << "; encode: " << absl::ToDoubleMicroseconds(encode_cost) / kRound << "us"
+                << "; decode: " << absl::ToDoubleMicroseconds(decode_cost) / kRound << "us"
+                << "; check: " << absl::ToDoubleMicroseconds(check_cost) / kRound << "us"
+                << "; output: " << absl::ToDoubleMicroseconds(output_cost) / kRound << "us";
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(raw_contents_check) {
+  auto spec = BuildSpec();
+  torch::serving::FeatureChecker checker;
+  checker.Compile(spec);
+  std::vector<float> data(2 * kDim, 1);
+  {
+    inference::ModelInferRequest request;
+    BuildRequest(data, 2, true, &request);
+    BOOST_CHECK(checker.Check(request).Ok());
+  }
+  {
+    // 字节数与形状不符
+    inference::ModelInferRequest request;
+    BuildRequest(data, 3, true, &request);
+    BOOST_CHECK(!checker.Check(request).Ok());
+  }
+  {
+    // 字节数不是元素大小的整数倍
+    inference::ModelInferRequest request;
+    BuildRequest(data, 2, true, &request);
+    request.mutable_raw_input_contents(0)->push_back('\0');
+    BOOST_CHECK(!checker.Check(request).Ok());
+  }
+  {
+    // raw和typed混用
+    inference::ModelInferRequest request;
+    BuildRequest(data, 2, true, &request);
+    request.mutable_inputs(0)->mutable_contents()->add_fp32_contents(1);
+    BOOST_CHECK(!checker.Check(request).Ok());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(raw_contents_split) {
+  auto spec = BuildSpec();
+  std::vector<float> first_data(kDim, 1);
+  std::vector<float> second_data(2 * kDim, 2);
+  inference::ModelInferRequest first;
+  inference::ModelInferRequest second;
+  BuildRequest(first_data, 1, false, &first);
+  BuildRequest(second_data, 2, true, &second);
+
+  inference::ModelInferRequest merged;
+  BOOST_REQUIRE(torch::serving::MergeRequest({&first, &second}, spec, 3, false, &merged).Ok());
+  auto merged_data = torch::serving::InputData<float>(merged, 0);
+  BOOST_REQUIRE_EQUAL(merged_data.size(), 3 * kDim);
+
+  // 合并后的结果使用raw, typed子请求得到typed结果, raw子请求得到raw结果
+  inference::ModelInferResponse response;
+  auto* output = response.add_outputs();
+  output->set_name("y");
+  output->set_datatype(inference::DT_FLOAT);
+  output->mutable_shape()->Add(merged.inputs(0).shape().begin(), merged.inputs(0).shape().end());
+  torch::serving::AddOutputData<float>(merged_data.data(), merged_data.size(), true, &response, output);
+
+  inference::ModelInferResponse first_response;
+  inference::ModelInferResponse second_response;
+  torch::serving::SplitResponse(response, {&first, &second}, {&first_response, &second_response}, {1, 2});
+  BOOST_CHECK_EQUAL(first_response.raw_output_contents_size(), 0);
+  BOOST_CHECK_EQUAL(first_response.outputs(0).contents().fp32_contents_size(), kDim);
+  BOOST_REQUIRE_EQUAL(second_response.raw_output_contents_size(), 1);
+  BOOST_CHECK_EQUAL(second_response.outputs(0).contents().fp32_contents_size(), 0);
+  auto second_output = torch::serving::OutputData<float>(second_response, 0);
+  BOOST_CHECK_EQUAL_COLLECTIONS(second_output.begin(), second_output.end(), second_data.begin(), second_data.end());
+}
@@ -0,0 +1,206 @@
+#define BOOST_TEST_MODULE torch
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <absl/time/clock.h>
+#include <glog/logging.h>
+
+#include "server_config.pb.h"
+#include "model_spec.pb.h"
+#include "kserve_predict_v2.pb.h"
+#include "model/predict_context.h"
+#include "servables/cache_servable.h"
+#include "servables/response_cache.h"
+#include "utils/tensor_utils.h"
+
+namespace {
+
+constexpr int kDim = 64;
+
+// 返回输入之和, 记录推理次数
+class CountServable : public torch::serving::IServable {
+ public:
+  CountServable() {
+    auto* feature = spec_.add_feature_specs();
+    feature->set_name("x");
+    feature->set_dtype(inference::DT_FLOAT);
+    feature->add_shape(kDim);
+    CompileChecker(spec_);
+  }
+  bool Init(const std::string &path) override {
+    return true;
+  }
+  torch::serving::PredictStatus PredictWithoutCheck(const torch::serving::PredictContextPtr &predict_context) override {
+    ++predict_num;
+    auto data = torch::serving::InputData<float>(*predict_context->request_, 0);
+    float sum = 0;
+    for (auto value : data) {
+      sum += value;
+    }
+    auto* output = predict_context->response_->add_outputs();
+    output->set_name("sum");
+    output->set_datatype(inference::DT_FLOAT);
+    output->add_shape(1);
+    output->mutable_contents()->add_fp32_contents(sum);
+    return {torch::serving::PredictStatus::OK};
+  }
+  const std::string &GetLabel() override {
+    return label_;
+  }
+  const inference::ModelSpec &GetSpec() override {
+    return spec_;
+  }
+
+  std::atomic<int> predict_num{0};
+
+ private:
+  std::string label_;
+  inference::ModelSpec spec_;
+};
+
+inference::ModelInferRequest BuildRequest(float value, bool raw = false) {
+  inference::ModelInferRequest request;
+  request.set_id("id");
+  auto* input = request.add_inputs();
+  input->set_name("x");
+  input->set_datatype(inference::DT_FLOAT);
+  input->add_shape(1);
+  input->add_shape(kDim);
+  std::vector<float> data(kDim, value);
+  if (raw) {
+    request.add_raw_input_contents()->assign(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(float));
+  } else {
+    input->mutable_contents()->mutable_fp32_contents()->Add(data.begin(), data.end());
+  }
+  return request;
+}
+
+torch::serving::CacheConfig BuildConfig(uint32_t ttl_ms, uint64_t max_mb) {
+  torch::serving::CacheConfig config;
+  config.set_enable(true);
+  config.set_ttl_ms(ttl_ms);
+  config.set_max_mb(max_mb);
+  return config;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(response_cache_key) {
+  using torch::serving::ResponseCache;
+  // 哈希相同, 且以left写入后right能命中
+  auto same = [](const inference::ModelInferRequest& left, const inference::ModelInferRequest& right) {
+    auto left_key = ResponseCache::Key(left);
+    auto right_key = ResponseCache::Key(right);
+    ResponseCache cache(BuildConfig(0, 1));
+    cache.Insert(left_key, inference::ModelInferResponse());
+    return left_key.hash == right_key.hash && cache.Lookup(right_key) != nullptr;
+  };
+  auto request = BuildRequest(1);
+  BOOST_CHECK(same(request, BuildRequest(1)));
+  // id不影响结果
+  request.set_id("other");
+  BOOST_CHECK(same(request, BuildRequest(1)));
+  BOOST_CHECK(!same(request, BuildRequest(2)));
+  // 编码方式不同, 结果格式不同
+  BOOST_CHECK(!same(request, BuildRequest(1, true)));
+  request.mutable_inputs(0)->set_shape(1, kDim / 2);
+  request.mutable_inputs(0)->add_shape(2);
+  BOOST_CHECK(!same(request, BuildRequest(1)));
+}
+
+BOOST_AUTO_TEST_CASE(response_cache_bound) {
+  torch::serving::ResponseCache cache(BuildConfig(0, 1));
+  inference::ModelInferResponse response;
+  response.add_outputs()->mutable_contents()->mutable_fp32_contents()->Resize(1024, 0);
+  size_t evicted = 0;
+  for (int i = 0; i < 10000; ++i) {
+    auto request = BuildRequest(i);
+    evicted += cache.Insert(torch::serving::ResponseCache::Key(request), response);
+  }
+  BOOST_CHECK_GT(evicted, 0);
+  BOOST_CHECK_LE(cache.Bytes(), 1 << 20);
+
+  auto request = BuildRequest(1);
+  auto key = torch::serving::ResponseCache::Key(request);
+  torch::serving::ResponseCache ttl_cache(BuildConfig(20, 1));
+  ttl_cache.Insert(key, response);
+  BOOST_CHECK(ttl_cache.Lookup(key) != nullptr);
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  BOOST_CHECK(ttl_cache.Lookup(key) == nullptr);
+  BOOST_CHECK_EQUAL(ttl_cache.Bytes(), 0);
+
+  // 未配置内存上限时使用默认值, 仍可写入
+  torch::serving::ResponseCache default_cache(BuildConfig(0, 0));
+  default_cache.Insert(key, response);
+  BOOST_CHECK(default_cache.Lookup(key) != nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(response_cache_collision) {
+  // 哈希相同但输入不同时不命中
+  torch::serving::ResponseCache cache(BuildConfig(0, 1));
+  inference::ModelInferResponse response;
+  response.set_id("first");
+  auto first = BuildRequest(1);
+  auto second = BuildRequest(2);
+  cache.Insert({1, &first}, response);
+  BOOST_CHECK(cache.Lookup({1, &second}) == nullptr);
+  auto cached = cache.Lookup({1, &first});
+  BOOST_REQUIRE(cached != nullptr);
+  BOOST_CHECK_EQUAL(cached->id(), "first");
+}
+
+BOOST_AUTO_TEST_CASE(cache_servable) {
+  auto inner = std::make_shared<CountServable>();
+  torch::serving::CacheServable servable(inner, BuildConfig(0, 16), {});
+  auto request = BuildRequest(1);
+  auto predict = [&](const inference::ModelInferRequest& request) {
+    inference::ModelInferResponse response;
+    auto context = std::make_shared<torch::serving::PredictContext>(&request, &response);
+    bool ok = false;
+    servable.PredictAsync(context, [&ok](const torch::serving::PredictStatus& status) { ok = status.Ok(); });
+    BOOST_REQUIRE(ok);
+    return response;
+  };
+  auto first = predict(request);
+  request.set_id("retry");
+  auto second = predict(request);
+  BOOST_CHECK_EQUAL(inner->predict_num, 1);
+  BOOST_CHECK_EQUAL(second.id(), "retry");
+  BOOST_CHECK_EQUAL(second.outputs(0).contents().fp32_contents(0), kDim);
+  predict(BuildRequest(2));
+  BOOST_CHECK_EQUAL(inner->predict_num, 2);
+
+  // 卸载后不再命中
+  servable.Unload();
+  predict(request);
+  BOOST_CHECK_EQUAL(inner->predict_num, 3);
+}
+
+BOOST_AUTO_TEST_CASE(response_cache_bench) {
+  constexpr int kRound = 100000;
+  torch::serving::ResponseCache cache(BuildConfig(0, 64));
+  auto request = BuildRequest(1);
+  inference::ModelInferResponse response;
+  response.add_outputs()->mutable_contents()->mutable_fp32_contents()->Resize(16, 0);
+  auto begin = absl::Now();
+  // 累加哈希, 避免计算被优化掉
+  uint64_t checksum = 0;
+  for (int i = 0; i < kRound; ++i) {
+    checksum += torch::serving::ResponseCache::Key(request).hash;
+  }
+  auto key_cost = absl::ToDoubleNanoseconds(absl::Now() - begin) / kRound;
+  auto key = torch::serving::ResponseCache::Key(request);
+  BOOST_CHECK_EQUAL(checksum, key.hash * kRound);
+  cache.Insert(key, response);
+  begin = absl::Now();
+  int hit = 0;
+  for (int i = 0; i < kRound; ++i) {
+    hit += cache.Lookup(key) != nullptr;
+  }
+  auto lookup_cost = absl::ToDoubleNanoseconds(absl::Now() - begin) / kRound;
+  LOG(INFO) << "input: " << kDim << " floats; key: " << key_cost << "ns; lookup: " << lookup_cost << "ns";
+  BOOST_CHECK_EQUAL(hit, kRound);
+}
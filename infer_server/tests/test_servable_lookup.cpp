@@ -0,0 +1,153 @@
+#define BOOST_TEST_MODULE torch
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <shared_mutex>
+#include <absl/time/clock.h>
+#include <glog/logging.h>
+
+#include "model_spec.pb.h"
+#include "servables/servable.h"
+#include "model/servable_model.h"
+#include "model/predict_context.h"
+
+namespace {
+
+constexpr int kThreadNum = 8;
+constexpr int kRound = 200000;
+
+class LabelServable : public torch::serving::IServable {
+ public:
+  bool Init(const std::string &path) override {
+    return true;
+  }
+  torch::serving::PredictStatus PredictWithoutCheck(const torch::serving::PredictContextPtr &predict_context) override {
+    return {torch::serving::PredictStatus::OK};
+  }
+  const std::string &GetLabel() override {
+    return label_;
+  }
+  const inference::ModelSpec &GetSpec() override {
+    return spec_;
+  }
+
+ private:
+  std::string label_{"stable"};
+  inference::ModelSpec spec_;
+};
+
+class LabelFactory : public torch::serving::ServableFactory {
+ public:
+  std::shared_ptr<torch::serving::IServable> New() override {
+    return std::make_shared<LabelServable>();
+  }
+};
+
+// 改动前的查询方式, 作为对比基准: 共享锁, 最新版本查询加锁两次
+class SharedMutexTable {
+ public:
+  void Add(torch::serving::ModelVersion version, const std::shared_ptr<torch::serving::IServable>& servable) {
+    std::unique_lock lock(mutex_);
+    servables_[version] = servable;
+  }
+  std::shared_ptr<torch::serving::IServable> GetServableByVersion(torch::serving::ModelVersion version = 0) {
+    {
+      std::shared_lock lock(mutex_);
+      if (servables_.empty()) {
+        return nullptr;
+      }
+    }
+    std::shared_lock lock(mutex_);
+    if (version == 0) {
+      return servables_.begin()->second;
+    }
+    auto it = servables_.find(version);
+    return it == servables_.end() ? nullptr : it->second;
+  }
+
+ private:
+  std::shared_mutex mutex_;
+  std::map<torch::serving::ModelVersion, std::shared_ptr<torch::serving::IServable>, std::greater<>> servables_;
+};
+
+template<typename Table>
+double RunConcurrent(Table& table) {
+  std::atomic_int miss{0};
+  auto begin = absl::Now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreadNum; ++i) {
+    threads.emplace_back([&]() {
+      for (int j = 0; j < kRound; ++j) {
+        miss += table.GetServableByVersion() == nullptr;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  BOOST_CHECK_EQUAL(miss.load(), 0);
+  return absl::ToDoubleNanoseconds(absl::Now() - begin) / (kThreadNum * kRound);
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_lookup) {
+  torch::serving::ServableModel model(std::make_shared<LabelFactory>(), "model", "/tmp");
+  BOOST_CHECK(model.GetServableByVersion() == nullptr);
+  BOOST_CHECK(model.GetServableByLabel("stable") == nullptr);
+  BOOST_REQUIRE(model.AddServable(1));
+  BOOST_REQUIRE(model.AddServable(3));
+  auto latest = model.GetServableByVersion(3);
+  BOOST_CHECK(latest != nullptr);
+  BOOST_CHECK(model.GetServableByVersion() == latest);
+  BOOST_CHECK(model.GetServableByLabel("stable") == latest);
+  BOOST_CHECK(model.GetServableByVersion(2) == nullptr);
+  model.RmServable(3);
+  BOOST_CHECK(model.GetServableByVersion() == model.GetServableByVersion(1));
+  BOOST_CHECK(model.GetServableByLabel("stable") == model.GetServableByVersion(1));
+  // 卸载后快照不再持有servable
+  BOOST_CHECK_EQUAL(latest.use_count(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_update_concurrent) {
+  torch::serving::ServableModel model(std::make_shared<LabelFactory>(), "model", "/tmp");
+  BOOST_REQUIRE(model.AddServable(1));
+  std::atomic_bool running{true};
+  std::atomic_int miss{0};
+  std::vector<std::thread> readers;
+  for (int i = 0; i < kThreadNum; ++i) {
+    readers.emplace_back([&]() {
+      while (running) {
+        miss += model.GetServableByVersion() == nullptr;
+        miss += model.GetServableByLabel("stable") == nullptr;
+      }
+    });
+  }
+  // 不断加载和卸载新版本, 版本1始终可用
+  for (torch::serving::ModelVersion version = 2; version < 1000; ++version) {
+    BOOST_REQUIRE(model.AddServable(version));
+    model.RmServable(version);
+  }
+  running = false;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  BOOST_CHECK_EQUAL(miss.load(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(servable_lookup_bench) {
+  torch::serving::ServableModel model(std::make_shared<LabelFactory>(), "model", "/tmp");
+  SharedMutexTable table;
+  for (torch::serving::ModelVersion version = 1; version <= 2; ++version) {
+    BOOST_REQUIRE(model.AddServable(version));
+    table.Add(version, model.GetServableByVersion(version));
+  }
+  auto locked_cost = RunConcurrent(table);
+  auto snapshot_cost = RunConcurrent(model);
+  LOG(INFO) << "threads: " << kThreadNum << "; hardware: " << std::thread::hardware_concurrency()
+            << "; shared_mutex: " << locked_cost << "ns/lookup; snapshot: " << snapshot_cost << "ns/lookup";
+}